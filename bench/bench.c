@@ -0,0 +1,225 @@
+#define _XOPEN_SOURCE 700
+#include "bench.h"
+#include "../src/profiler/profiler.h"
+#include "../src/editor/scan.h"
+#include <ftw.h>
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define MAX_RESULTS 64
+#define PATH_MAX 4096
+
+typedef struct BenchResult {
+    const char *name;
+    int iterations;
+    uint64_t min_ns;
+    uint64_t median_ns;
+    uint64_t p99_ns;
+    uint64_t mean_ns;
+} BenchResult;
+
+static BenchResult results[MAX_RESULTS];
+static int result_count = 0;
+static const char *name_filter = NULL;
+static uint64_t rng_state = 0;
+static SCREEN *screen = NULL;
+static FILE *screen_out = NULL;
+static FILE *screen_in = NULL;
+
+void bench_seed(uint64_t seed) {
+    rng_state = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+uint64_t bench_rand(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_run(const char *name, void (*fn)(void *ctx), void *ctx, int iterations) {
+    if (name_filter && strstr(name, name_filter) == NULL) return;
+    if (result_count == MAX_RESULTS || iterations <= 0) return;
+
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    uint64_t total = 0;
+
+    // One untimed warm-up run fills caches the same way for every benchmark
+    fn(ctx);
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = prof_now_ns();
+        fn(ctx);
+        samples[i] = prof_now_ns() - start;
+        total += samples[i];
+    }
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+
+    BenchResult *result = &results[result_count++];
+    result->name = name;
+    result->iterations = iterations;
+    result->min_ns = samples[0];
+    result->median_ns = samples[(iterations - 1) / 2];
+    result->p99_ns = samples[(iterations - 1) * 99 / 100];
+    result->mean_ns = total / iterations;
+    free(samples);
+
+    fprintf(stderr, "%-28s %10.3f ms median %10.3f ms p99 (%d runs)\n",
+            name, result->median_ns / 1e6, result->p99_ns / 1e6, iterations);
+}
+
+void bench_open_screen(void) {
+    // Fixed geometry so results do not depend on the invoking terminal
+    setenv("LINES", "60", 1);
+    setenv("COLUMNS", "200", 1);
+    screen_out = fopen("/dev/null", "w");
+    screen_in = fopen("/dev/null", "r");
+    screen = newterm("xterm", screen_out, screen_in);
+    if (screen == NULL) {
+        fprintf(stderr, "Error: Cannot create off-screen terminal\n");
+        exit(1);
+    }
+    set_term(screen);
+    start_color();
+    init_pair(1, COLOR_WHITE, COLOR_BLACK);
+}
+
+void bench_close_screen(void) {
+    endwin();
+    delscreen(screen);
+    fclose(screen_out);
+    fclose(screen_in);
+    screen = NULL;
+}
+
+static void generate_text(const char *path, int lines) {
+    static const char *words[] = {
+        "int", "char", "return", "buffer", "cursor", "explorer", "node",
+        "if", "while", "for", "size", "capacity", "=", "+", "(", ")", "{", "}", ";"
+    };
+    int word_count = sizeof(words) / sizeof(words[0]);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot create '%s'\n", path);
+        exit(1);
+    }
+    for (int i = 0; i < lines; i++) {
+        int indent = (bench_rand() % 4) * 4;
+        int length = bench_rand() % 12;
+        fprintf(file, "%*s", indent, "");
+        for (int w = 0; w < length; w++) {
+            fprintf(file, "%s%s", w ? " " : "", words[bench_rand() % word_count]);
+        }
+        fputc('\n', file);
+    }
+    fclose(file);
+}
+
+static void generate_tree(const char *path, int depth, int dirs, int files) {
+    mkdir(path, 0755);
+    for (int i = 0; i < files; i++) {
+        char file_path[PATH_MAX];
+        snprintf(file_path, sizeof(file_path), "%s/file_%d.c", path, i);
+        FILE *file = fopen(file_path, "w");
+        if (file) {
+            fprintf(file, "// %d\n", i);
+            fclose(file);
+        }
+    }
+    if (depth == 0) return;
+    for (int i = 0; i < dirs; i++) {
+        char dir_path[PATH_MAX];
+        snprintf(dir_path, sizeof(dir_path), "%s/dir_%d", path, i);
+        generate_tree(dir_path, depth - 1, dirs, files);
+    }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void write_results(const char *path, const char *revision, BenchInputs *inputs) {
+    FILE *file = path ? fopen(path, "w") : stdout;
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", path);
+        exit(1);
+    }
+
+    fprintf(file, "{\n  \"revision\": \"%s\",\n  \"timestamp\": %ld,\n  \"scale\": %d,\n  \"scan_kernel\": \"%s\",\n  \"results\": [\n",
+            revision ? revision : "unknown", (long)time(NULL), inputs->scale, scan_kernel_name());
+    for (int i = 0; i < result_count; i++) {
+        BenchResult *r = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %d, \"min_ns\": %llu, \"median_ns\": %llu, "
+                      "\"p99_ns\": %llu, \"mean_ns\": %llu}%s\n",
+                r->name, r->iterations, (unsigned long long)r->min_ns, (unsigned long long)r->median_ns,
+                (unsigned long long)r->p99_ns, (unsigned long long)r->mean_ns,
+                i + 1 < result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    if (file != stdout) fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = NULL;
+    const char *revision = NULL;
+    BenchInputs inputs = { .scale = 1 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--rev") == 0 && i + 1 < argc) {
+            revision = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            inputs.scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            name_filter = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--out file] [--rev id] [--scale n] [--filter name]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (inputs.scale < 1) inputs.scale = 1;
+
+    // Generate inputs in a scratch directory
+    char root[] = "/tmp/quark-bench-XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        fprintf(stderr, "Error: Cannot create scratch directory\n");
+        return 1;
+    }
+    char text_path[PATH_MAX];
+    char tree_path[PATH_MAX];
+    snprintf(text_path, sizeof(text_path), "%s/input.c", root);
+    snprintf(tree_path, sizeof(tree_path), "%s/tree", root);
+
+    inputs.root = root;
+    inputs.text_path = text_path;
+    inputs.tree_path = tree_path;
+    inputs.text_lines = 20000 * inputs.scale;
+
+    bench_seed(42);
+    generate_text(text_path, inputs.text_lines);
+    generate_tree(tree_path, 3, 6, 10 * inputs.scale);
+
+    bench_src(&inputs);
+    bench_legacy(&inputs);
+    bench_playground(&inputs);
+
+    write_results(out_path, revision, &inputs);
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+typedef struct BenchInputs {
+    char *root;       // scratch directory holding everything below
+    char *text_path;  // synthetic source file
+    char *tree_path;  // synthetic directory tree
+    int text_lines;
+    int scale;
+} BenchInputs;
+
+// Runs fn once per iteration and records the sample under name
+void bench_run(const char *name, void (*fn)(void *ctx), void *ctx, int iterations);
+
+// Deterministic PRNG so every run sees the same inputs and positions
+void bench_seed(uint64_t seed);
+uint64_t bench_rand(void);
+
+// Screen of fixed size backed by /dev/null for render benchmarks
+void bench_open_screen(void);
+void bench_close_screen(void);
+
+void bench_src(BenchInputs *inputs);
+void bench_legacy(BenchInputs *inputs);
+void bench_playground(BenchInputs *inputs);
+
+#endif
@@ -0,0 +1,179 @@
+#include "bench.h"
+#include "../legacy/buffer.h"
+#include "../legacy/editor.h"
+#include "../legacy/journal.h"
+#include "../legacy/block.h"
+#include "../legacy/clipboard.h"
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EDITS_PER_RUN 1000
+#define MOTION_TARGET_LINE 200
+#define MINIMAP_ROWS 50
+
+typedef struct LegacyBench {
+    BenchInputs *inputs;
+    Buffer buffer;
+    int cursor_x;
+    int cursor_y;
+} LegacyBench;
+
+static void run_load_file(void *ctx) {
+    LegacyBench *bench = ctx;
+    Buffer buffer;
+    initBuffer(&buffer);
+    loadFile(&buffer, bench->inputs->text_path);
+    freeBuffer(&buffer);
+}
+
+static void run_build_line_index(void *ctx) {
+    LegacyBench *bench = ctx;
+    line_index_build(&bench->buffer.lines, bench->buffer.content, bench->buffer.size);
+}
+
+// Copying unedited text only references the mapped file
+static void run_copy_whole_file(void *ctx) {
+    LegacyBench *bench = ctx;
+    releaseClip(clipRange(&bench->buffer, 0, bench->buffer.size));
+}
+
+static void run_insert_random(void *ctx) {
+    LegacyBench *bench = ctx;
+    for (int i = 0; i < EDITS_PER_RUN; i++) {
+        insertChar(&bench->buffer, bench_rand() % (bench->buffer.size + 1), 'x');
+    }
+}
+
+static void run_delete_random(void *ctx) {
+    LegacyBench *bench = ctx;
+    for (int i = 0; i < EDITS_PER_RUN && bench->buffer.size > 0; i++) {
+        deleteChar(&bench->buffer, bench_rand() % bench->buffer.size);
+    }
+}
+
+// A handful of typed characters followed by the rehash a reload would do
+static void run_sync_line_hashes(void *ctx) {
+    LegacyBench *bench = ctx;
+    int pos = bench_rand() % (bench->buffer.size + 1);
+    for (int i = 0; i < 8; i++) {
+        insertChar(&bench->buffer, pos + i, 'x');
+    }
+    int first;
+    line_hashes_sync(&bench->buffer.hashes, &bench->buffer.lines, bench->buffer.content, bench->buffer.size, &first);
+}
+
+// Types one character into a block spanning every line, then takes it out
+static void run_block_insert(void *ctx) {
+    LegacyBench *bench = ctx;
+    int last = lineCount(&bench->buffer) - 1;
+    Selection selection = { { 4, 0 }, { 4, last }, SELECTION_BLOCK };
+    insertBlock(&bench->buffer, &selection, "x", 1);
+    selection.end.x = 5;
+    deleteBlock(&bench->buffer, &selection);
+}
+
+// Types a brace, finds the blocks around a random spot, then takes it out
+static void run_bracket_navigate(void *ctx) {
+    LegacyBench *bench = ctx;
+    Buffer *buffer = &bench->buffer;
+    int pos = bench_rand() % (buffer->size + 1);
+    insertChar(buffer, pos, '{');
+    int at = bench_rand() % buffer->size;
+    bracket_block_start(&buffer->brackets, buffer->content, buffer->size, at);
+    bracket_block_end(&buffer->brackets, buffer->content, buffer->size, at);
+    bracket_match(&buffer->brackets, buffer->content, buffer->size, pos);
+    deleteChar(buffer, pos);
+}
+
+// Types a character and sums the ruler again, as every keystroke does
+static void run_minimap_rows(void *ctx) {
+    LegacyBench *bench = ctx;
+    Buffer *buffer = &bench->buffer;
+    MinimapRow rows[MINIMAP_ROWS];
+    insertChar(buffer, bench_rand() % (buffer->size + 1), 'x');
+    minimap_rows(&buffer->minimap, buffer->content, buffer->size, lineCount(buffer), rows, MINIMAP_ROWS);
+}
+
+static void run_cursor_to_line(void *ctx) {
+    LegacyBench *bench = ctx;
+    bench->cursor_x = 0;
+    bench->cursor_y = 0;
+    while (bench->cursor_y < MOTION_TARGET_LINE) {
+        handleInput(&bench->buffer, KEY_DOWN, &bench->cursor_x, &bench->cursor_y);
+    }
+}
+
+static void run_cursor_to_end(void *ctx) {
+    LegacyBench *bench = ctx;
+    bench->cursor_x = 0;
+    bench->cursor_y = 0;
+    handleInput(&bench->buffer, 530, &bench->cursor_x, &bench->cursor_y);
+}
+
+// An edit at the top cuts the line index back, then a jump near the end
+static void run_go_to_line(void *ctx) {
+    LegacyBench *bench = ctx;
+    char target[16];
+    insertChar(&bench->buffer, 0, 'x');
+    deleteChar(&bench->buffer, 0);
+    snprintf(target, sizeof(target), "%d", lineCount(&bench->buffer) - 1);
+    goToTarget(&bench->buffer, target, &bench->cursor_x, &bench->cursor_y);
+    lineStart(&bench->buffer, bench->cursor_y);
+}
+
+static void run_display_buffer(void *ctx) {
+    LegacyBench *bench = ctx;
+    bench->cursor_y = (bench->cursor_y + 1) % bench->inputs->text_lines;
+    displayBuffer(&bench->buffer, 0, bench->cursor_y);
+}
+
+void bench_legacy(BenchInputs *inputs) {
+    LegacyBench bench = { .inputs = inputs };
+
+    bench_run("legacy_loadFile", run_load_file, &bench, 20);
+
+    initBuffer(&bench.buffer);
+    loadFile(&bench.buffer, inputs->text_path);
+
+    bench_run("line_index_build", run_build_line_index, &bench, 50);
+    bench_run("clip_copy_whole_file", run_copy_whole_file, &bench, 50);
+
+    // Inserts and deletes balance out so the buffer size stays stable
+    bench_run("insert_random", run_insert_random, &bench, 50);
+    bench_run("delete_random", run_delete_random, &bench, 50);
+
+    // Same edits with the crash journal on; the difference is its keystroke cost
+    bench.buffer.journal = openJournal(inputs->text_path, 0);
+    bench_run("insert_random_journaled", run_insert_random, &bench, 50);
+    bench_run("delete_random_journaled", run_delete_random, &bench, 50);
+    closeJournal(bench.buffer.journal, 0);
+    bench.buffer.journal = NULL;
+
+    // The first sync hashes every line; later ones only the edited span
+    int first;
+    line_hashes_sync(&bench.buffer.hashes, &bench.buffer.lines, bench.buffer.content, bench.buffer.size, &first);
+    bench_run("line_hashes_sync", run_sync_line_hashes, &bench, 200);
+
+    bench_run("block_insert_all_lines", run_block_insert, &bench, 20);
+
+    // The first query builds the bracket index; later ones patch a chunk
+    bracket_match(&bench.buffer.brackets, bench.buffer.content, bench.buffer.size, 0);
+    bench_run("bracket_navigate", run_bracket_navigate, &bench, 200);
+
+    const char *pattern = "return";
+    minimap_set_pattern(&bench.buffer.minimap, bench.buffer.content, bench.buffer.size, pattern, strlen(pattern));
+    bench_run("minimap_rows", run_minimap_rows, &bench, 200);
+
+    bench_run("cursor_down_to_line", run_cursor_to_line, &bench, 10);
+    bench_run("cursor_to_end", run_cursor_to_end, &bench, 50);
+    bench_run("go_to_line_unindexed", run_go_to_line, &bench, 50);
+
+    bench_open_screen();
+    bench.cursor_y = inputs->text_lines / 2;
+    bench_run("render_displayBuffer", run_display_buffer, &bench, 200);
+    bench_close_screen();
+
+    freeBuffer(&bench.buffer);
+}
@@ -0,0 +1,61 @@
+#include "bench.h"
+#include "../playground/playground.h"
+#include <stdlib.h>
+
+typedef struct PlaygroundBench {
+    BenchInputs *inputs;
+    FileContent *content;
+    FileTree tree;
+    int toggle_row;
+} PlaygroundBench;
+
+static void run_load_file(void *ctx) {
+    PlaygroundBench *bench = ctx;
+    free_file_content(load_file(bench->inputs->text_path));
+}
+
+static void run_build_tree_contents(void *ctx) {
+    PlaygroundBench *bench = ctx;
+    NodeTable nodes;
+    node_table_init(&nodes, ALLOC_PLAYGROUND);
+    int root = node_add(&nodes, NODE_NONE, ".", 1);
+    if (root != NODE_NONE) {
+        build_tree_contents(&nodes, root, bench->inputs->tree_path, NULL);
+    }
+    free_tree_nodes(&nodes);
+}
+
+static void run_tree_toggle(void *ctx) {
+    PlaygroundBench *bench = ctx;
+    tree_collapse(&bench->tree, bench->toggle_row);
+    tree_expand(&bench->tree, bench->toggle_row);
+}
+
+static void run_draw_layout(void *ctx) {
+    PlaygroundBench *bench = ctx;
+    bench->content->scroll_position = (bench->content->scroll_position + 1) % bench->content->line_count;
+    draw_layout(bench->content, &bench->tree);
+}
+
+void bench_playground(BenchInputs *inputs) {
+    PlaygroundBench bench = { .inputs = inputs };
+
+    bench_run("load_file", run_load_file, &bench, 50);
+    bench_run("build_tree_contents", run_build_tree_contents, &bench, 50);
+
+    bench.content = load_file(inputs->text_path);
+    tree_rows_init(&bench.tree, inputs->tree_path);
+    for (int row = bench.tree.row_count - 1; row > 0; row--) {
+        tree_expand(&bench.tree, row);
+        if (NODE(&bench.tree.nodes, bench.tree.rows[row], is_directory)) bench.toggle_row = row;
+    }
+
+    bench_run("tree_toggle", run_tree_toggle, &bench, 200);
+
+    bench_open_screen();
+    bench_run("render_draw_layout", run_draw_layout, &bench, 200);
+    bench_close_screen();
+
+    free_file_content(bench.content);
+    free_file_tree(&bench.tree);
+}
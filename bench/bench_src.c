@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "../src/editor/editor.h"
+#include "../src/explorer/explorer.h"
+#include "../src/explorer/sort_key.h"
+#include "../src/alloc/alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SORT_ENTRIES 200000
+
+typedef struct SortBench {
+    SortItem *source;
+    SortItem *scratch;
+} SortBench;
+
+static void run_open_editor(void *ctx) {
+    BenchInputs *inputs = ctx;
+    Editor editor = { .path = inputs->text_path };
+    open_editor(&editor);
+    alloc_free(editor.buffer.buffer);
+}
+
+static void run_populate_explorer(void *ctx) {
+    BenchInputs *inputs = ctx;
+    Explorer tree;
+    if (init_explorer(&tree, inputs->tree_path, 0) != 0) {
+        return;
+    }
+    populate_explorer(&tree, 1);
+    free_explorer(&tree);
+}
+
+static void run_sort_directory(void *ctx) {
+    SortBench *bench = ctx;
+    memcpy(bench->scratch, bench->source, SORT_ENTRIES * sizeof(SortItem));
+    sort_items(bench->scratch, SORT_ENTRIES);
+}
+
+void bench_src(BenchInputs *inputs) {
+    bench_run("open_editor", run_open_editor, inputs, 50);
+    bench_run("populate_explorer", run_populate_explorer, inputs, 20);
+
+    // Keys are built once per directory load, only the sort itself is timed
+    SortBench sort = {
+        .source = malloc(SORT_ENTRIES * sizeof(SortItem)),
+        .scratch = malloc(SORT_ENTRIES * sizeof(SortItem))
+    };
+    for (int i = 0; i < SORT_ENTRIES; i++) {
+        char name[64];
+        int is_directory = bench_rand() % 8 == 0;
+        snprintf(name, sizeof(name), "%s_%llu.c", is_directory ? "Module" : "file",
+                 (unsigned long long)(bench_rand() % 1000000));
+        sort.source[i].name = strdup(name);
+        sort.source[i].key = make_sort_key(name, is_directory);
+        sort.source[i].item = NULL;
+    }
+    bench_run("sort_directory_200k", run_sort_directory, &sort, 10);
+    for (int i = 0; i < SORT_ENTRIES; i++) {
+        free((char *)sort.source[i].name);
+        alloc_free((char *)sort.source[i].key);
+    }
+    free(sort.source);
+    free(sort.scratch);
+}
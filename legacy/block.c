@@ -0,0 +1,197 @@
+#include "block.h"
+#include "editor.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include <string.h>
+
+static void *allocate(size_t size)
+{
+    return alloc_malloc(ALLOC_TEXT, size ? size : 1);
+}
+
+// Clips the rectangle to lines that exist
+static SelectionRect blockRect(Buffer *buffer, const Selection *selection)
+{
+    SelectionRect rect = selection_rect(selection);
+    if (rect.bottom >= lineCount(buffer))
+    {
+        rect.bottom = lineCount(buffer) - 1;
+    }
+    return rect;
+}
+
+// Rows are joined with newlines into one owned clip
+Clip *copyBlock(Buffer *buffer, const Selection *selection)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    SelectionRect rect = blockRect(buffer, selection);
+    int rows = rect.bottom - rect.top + 1;
+    int *spans = allocate(rows * 2 * sizeof(int));
+    if (spans == NULL)
+    {
+        return NULL;
+    }
+    int length = rows - 1;
+    for (int i = 0; i < rows; i++)
+    {
+        selection_row_span(&buffer->lines, buffer->content, buffer->size, rect.top + i, rect.left, rect.right,
+                           &spans[i * 2], &spans[i * 2 + 1]);
+        length += spans[i * 2 + 1] - spans[i * 2];
+    }
+
+    char *text = allocate(length + 1);
+    if (text == NULL)
+    {
+        alloc_free(spans);
+        return NULL;
+    }
+    char *out = text;
+    for (int i = 0; i < rows; i++)
+    {
+        if (i > 0)
+        {
+            *out++ = '\n';
+        }
+        memcpy(out, buffer->content + spans[i * 2], spans[i * 2 + 1] - spans[i * 2]);
+        out += spans[i * 2 + 1] - spans[i * 2];
+    }
+    *out = '\0';
+    alloc_free(spans);
+    return clipText(text, length, rows);
+}
+
+int deleteBlock(Buffer *buffer, const Selection *selection)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    SelectionRect rect = blockRect(buffer, selection);
+    int rows = rect.bottom - rect.top + 1;
+    BufferSplice *splices = allocate(rows * sizeof(BufferSplice));
+    if (splices == NULL)
+    {
+        return -1;
+    }
+    int count = 0;
+    for (int line = rect.top; line <= rect.bottom; line++)
+    {
+        int start, end;
+        selection_row_span(&buffer->lines, buffer->content, buffer->size, line, rect.left, rect.right, &start, &end);
+        if (end > start)
+        {
+            splices[count++] = (BufferSplice){start, end - start, NULL, 0};
+        }
+    }
+    int status = applySplices(buffer, splices, count);
+    alloc_free(splices);
+    return status;
+}
+
+int insertBlock(Buffer *buffer, const Selection *selection, const char *text, int length)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    SelectionRect rect = blockRect(buffer, selection);
+    int rows = rect.bottom - rect.top + 1;
+    BufferSplice *splices = allocate(rows * sizeof(BufferSplice));
+    if (splices == NULL)
+    {
+        return -1;
+    }
+
+    // Lines short of the column are padded with spaces; the padding for the
+    // shortest line, followed by the text, serves every row from one string
+    int padding = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        padding = MAX(padding, rect.left - lineLength(buffer, rect.top + i));
+    }
+    char *inserted = allocate(padding + length);
+    if (inserted == NULL)
+    {
+        alloc_free(splices);
+        return -1;
+    }
+    memset(inserted, ' ', padding);
+    memcpy(inserted + padding, text, length);
+
+    for (int i = 0; i < rows; i++)
+    {
+        int line_length = lineLength(buffer, rect.top + i);
+        int pad = MAX(0, rect.left - line_length);
+        int pos = lineStart(buffer, rect.top + i) + MIN(rect.left, line_length);
+        splices[i] = (BufferSplice){pos, 0, inserted + padding - pad, pad + length};
+    }
+    int status = applySplices(buffer, splices, rows);
+    alloc_free(inserted);
+    alloc_free(splices);
+    return status;
+}
+
+int pasteBlock(Buffer *buffer, int line, int column, const Clip *clip)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    const char *text = clip->data;
+    int length = clip->length;
+    int rows = clip->rows;
+
+    // Rows past the last line are appended together as one splice
+    int lines = lineCount(buffer);
+    int extra = MAX(0, line + rows - lines);
+    int padding = column;
+    for (int i = 0; i < rows - extra; i++)
+    {
+        padding = MAX(padding, column - lineLength(buffer, line + i));
+    }
+    char *spaces = allocate(padding);
+    char *tail = allocate(length + extra * (column + 1) + 1);
+    BufferSplice *splices = allocate((rows - extra + 1) * 2 * sizeof(BufferSplice));
+    if (spaces == NULL || tail == NULL || splices == NULL)
+    {
+        alloc_free(splices);
+        alloc_free(tail);
+        alloc_free(spaces);
+        return -1;
+    }
+    memset(spaces, ' ', padding);
+
+    int tailLength = 0;
+    int count = 0;
+    const char *row = text;
+    for (int i = 0; i < rows; i++)
+    {
+        const char *newline = memchr(row, '\n', text + length - row);
+        int rowLength = newline ? (int)(newline - row) : (int)(text + length - row);
+        if (line + i < lines)
+        {
+            int line_length = lineLength(buffer, line + i);
+            int pad = MAX(0, column - line_length);
+            int pos = lineStart(buffer, line + i) + MIN(column, line_length);
+            if (pad > 0)
+            {
+                splices[count++] = (BufferSplice){pos, 0, spaces, pad};
+            }
+            splices[count++] = (BufferSplice){pos, 0, row, rowLength};
+        }
+        else
+        {
+            tail[tailLength++] = '\n';
+            memset(tail + tailLength, ' ', column);
+            tailLength += column;
+            memcpy(tail + tailLength, row, rowLength);
+            tailLength += rowLength;
+        }
+        row += rowLength + 1;
+    }
+    if (tailLength > 0)
+    {
+        splices[count++] = (BufferSplice){buffer->size, 0, tail, tailLength};
+    }
+
+    int status = applySplices(buffer, splices, count);
+    alloc_free(splices);
+    alloc_free(tail);
+    alloc_free(spaces);
+    return status;
+}
@@ -0,0 +1,19 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "buffer.h"
+#include "clipboard.h"
+#include "../src/editor/selection.h"
+
+// Rectangular edits over a block selection. Columns are bytes from the line
+// start, as everywhere in the editor, and each operation is applied as one
+// batch of splices however many lines it spans. Without the memory for it
+// an edit returns -1 and leaves the buffer alone, and a copy returns NULL.
+Clip *copyBlock(Buffer *buffer, const Selection *selection);
+int deleteBlock(Buffer *buffer, const Selection *selection);
+// Inserts text at the left edge of every selected line, padding short ones
+int insertBlock(Buffer *buffer, const Selection *selection, const char *text, int length);
+// Pastes a block copy with its top-left corner at line and column
+int pasteBlock(Buffer *buffer, int line, int column, const Clip *clip);
+
+#endif // BLOCK_H
@@ -1,79 +1,432 @@
 #include "buffer.h"
+#include "journal.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include "../src/io/io.h"
+#include "../src/editor/scan.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <ncurses.h>
 
-void initBuffer(Buffer *buffer)
+// Over the index budget the line hashes and bracket index go; both are
+// rebuilt from the text when next asked for. The minimap stays, since the
+// edit marks in it can't be rebuilt. An index that owns the block being
+// grown is left whole.
+static void dropIndexes(void *context, const void *resizing)
 {
-    buffer->content = malloc(INITIAL_BUFFER_SIZE);
-    if (buffer->content == NULL)
+    Buffer *buffer = context;
+    if (resizing == NULL || resizing != buffer->hashes.hashes)
     {
-        endwin();
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
+        line_hashes_free(&buffer->hashes);
+        line_hashes_init(&buffer->hashes);
+    }
+    if (resizing == NULL || (resizing != buffer->brackets.chunks && resizing != buffer->brackets.tree))
+    {
+        bracket_index_free(&buffer->brackets);
+        bracket_index_init(&buffer->brackets);
+    }
+}
+
+int initBuffer(Buffer *buffer)
+{
+    buffer->content = alloc_malloc(ALLOC_TEXT, INITIAL_BUFFER_SIZE);
+    if (buffer->content == NULL || line_index_init(&buffer->lines) != 0)
+    {
+        alloc_free(buffer->content);
+        return -1;
     }
     buffer->content[0] = '\0';
     buffer->size = 0;
     buffer->capacity = INITIAL_BUFFER_SIZE;
+    buffer->journal = NULL;
+    buffer->modified = 0;
+    buffer->original = NULL;
+    edit_span_clear(&buffer->edits);
+    line_hashes_init(&buffer->hashes);
+    bracket_index_init(&buffer->brackets);
+    minimap_init(&buffer->minimap);
+    alloc_register_reclaim(ALLOC_TEXT_INDEX, dropIndexes, buffer);
+    return 0;
+}
+
+void freeBuffer(Buffer *buffer)
+{
+    alloc_unregister_reclaim(dropIndexes, buffer);
+    alloc_free(buffer->content);
+    line_index_free(&buffer->lines);
+    line_hashes_free(&buffer->hashes);
+    bracket_index_free(&buffer->brackets);
+    minimap_free(&buffer->minimap);
+    releaseMapping(buffer->original);
+    buffer->original = NULL;
 }
 
 void loadFile(Buffer *buffer, const char *filename)
 {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL)
+    // Read the whole file in one batch of parallel chunk reads
+    long long size = 0;
+    char *content = io_read_file(io_default_queue(), ALLOC_TEXT, filename, &size);
+    if (content == NULL)
     {
         endwin();
-        fprintf(stderr, "Error: Could not open file '%s'\n", filename);
+        fprintf(stderr, "Error: Could not open file '%s': %s\n", filename, strerror(errno));
         exit(1);
     }
 
-    // Read file content into buffer
-    int ch;
-    while ((ch = fgetc(file)) != EOF)
+    alloc_free(buffer->content);
+    buffer->content = content;
+    buffer->size = size;
+    buffer->capacity = size + 1;
+    reserveBuffer(buffer, INITIAL_BUFFER_SIZE);
+    line_index_build(&buffer->lines, buffer->content, buffer->size);
+    line_hashes_reset(&buffer->hashes);
+    bracket_index_reset(&buffer->brackets);
+    minimap_reset(&buffer->minimap);
+    buffer->modified = 0;
+    resetOriginal(buffer, filename);
+}
+
+// Writes a temporary file next to the target and renames it over, so a crash
+// mid-save never leaves a half-written file
+int saveBuffer(Buffer *buffer, const char *filename)
+{
+    char target[PATH_MAX];
+    if (realpath(filename, target) == NULL)
     {
-        if (buffer->size + 1 >= buffer->capacity)
+        snprintf(target, sizeof(target), "%s", filename);
+    }
+    char temp[PATH_MAX + 8];
+    snprintf(temp, sizeof(temp), "%s.qtmp", target);
+
+    struct stat st;
+    mode_t mode = stat(target, &st) == 0 ? st.st_mode & 07777 : 0644;
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    const char *p = buffer->content;
+    int remaining = buffer->size;
+    while (remaining > 0)
+    {
+        ssize_t n = write(fd, p, remaining);
+        if (n <= 0)
         {
-            buffer->capacity *= 2;
-            char *new_content = realloc(buffer->content, buffer->capacity);
-            if (new_content == NULL)
-            {
-                endwin();
-                fprintf(stderr, "Memory reallocation failed\n");
-                fclose(file);
-                exit(1);
-            }
-            buffer->content = new_content;
+            close(fd);
+            unlink(temp);
+            return -1;
         }
-        buffer->content[buffer->size++] = ch;
+        p += n;
+        remaining -= n;
+    }
+    int status = fsync(fd);
+    if (close(fd) != 0)
+    {
+        status = -1;
     }
+    if (status != 0 || rename(temp, target) != 0)
+    {
+        unlink(temp);
+        return -1;
+    }
+    buffer->modified = 0;
+    minimap_clear_marks(&buffer->minimap);
+    resetOriginal(buffer, target);
+    return 0;
+}
 
-    fclose(file);
+static long long mtimeOf(const struct stat *st)
+{
+    return (long long)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
 }
 
-void insertChar(Buffer *buffer, int pos, char ch)
+// Maps filename as the buffer's original once it is known to hold exactly
+// the buffer's content; a file that doesn't match leaves no original
+void resetOriginal(Buffer *buffer, const char *filename)
 {
-    if (buffer->size + 1 >= buffer->capacity)
+    releaseMapping(buffer->original);
+    buffer->original = NULL;
+    edit_span_clear(&buffer->edits);
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0)
     {
-        buffer->capacity *= 2;
-        buffer->content = realloc(buffer->content, buffer->capacity);
-        if (buffer->content == NULL)
-        {
-            endwin();
-            fprintf(stderr, "Memory reallocation failed\n");
-            exit(1);
-        }
+        return;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size != buffer->size || st.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return;
+    }
+    FileMapping *mapping = alloc_malloc(ALLOC_TEXT, sizeof(FileMapping));
+    if (mapping == NULL)
+    {
+        munmap(data, st.st_size);
+        close(fd);
+        return;
+    }
+    *mapping = (FileMapping){1, fd, data, st.st_size, mtimeOf(&st)};
+    buffer->original = mapping;
+}
+
+// Where [start, end) of the content still lies untouched in the original:
+// before the edits at the same offsets, after them shifted back by delta
+const char *originalBytes(Buffer *buffer, int start, int end, FileMapping **mapping)
+{
+    const EditSpan *edits = &buffer->edits;
+    if (buffer->original == NULL || (edits->active && end > edits->start && start < edits->end))
+    {
+        return NULL;
+    }
+    long long offset = edits->active && start >= edits->end ? start - edits->delta : start;
+    if (offset < 0 || offset + (end - start) > buffer->original->size)
+    {
+        return NULL;
+    }
+    *mapping = buffer->original;
+    return buffer->original->data + offset;
+}
+
+void retainMapping(FileMapping *mapping)
+{
+    mapping->refs++;
+}
+
+void releaseMapping(FileMapping *mapping)
+{
+    if (mapping != NULL && --mapping->refs == 0)
+    {
+        munmap((void *)mapping->data, mapping->size);
+        close(mapping->fd);
+        alloc_free(mapping);
+    }
+}
+
+// Another program rewriting the file in place shows through the mapping, so
+// readers check it still has the size and mtime it was mapped with
+int mappingUnchanged(const FileMapping *mapping)
+{
+    struct stat st;
+    return fstat(mapping->fd, &st) == 0 && st.st_size == mapping->size && mtimeOf(&st) == mapping->mtime;
+}
+
+// Whether filename still names the original's file, unchanged since it was
+// mapped, as it does right after our own save
+int originalMatchesFile(Buffer *buffer, const char *filename)
+{
+    struct stat named, mapped;
+    return buffer->original != NULL && mappingUnchanged(buffer->original) && stat(filename, &named) == 0 &&
+           fstat(buffer->original->fd, &mapped) == 0 && named.st_dev == mapped.st_dev && named.st_ino == mapped.st_ino;
+}
+
+// Leaves the buffer as it was and returns -1 when the memory isn't there
+int reserveBuffer(Buffer *buffer, int capacity)
+{
+    if (capacity <= buffer->capacity)
+    {
+        return 0;
+    }
+    int grown = buffer->capacity;
+    while (grown < capacity)
+    {
+        grown *= 2;
+    }
+    char *content = alloc_realloc(ALLOC_TEXT, buffer->content, grown);
+    if (content == NULL)
+    {
+        return -1;
+    }
+    buffer->content = content;
+    buffer->capacity = grown;
+    return 0;
+}
+
+// Commits length bytes already written past the end of the content,
+// indexing only the new lines
+void appendBytes(Buffer *buffer, int length)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    int old_size = buffer->size;
+    buffer->size += length;
+    buffer->content[buffer->size] = '\0';
+    line_index_append(&buffer->lines, buffer->content, old_size, buffer->size);
+    line_hashes_edit(&buffer->hashes, old_size, 0, length);
+    bracket_index_reset(&buffer->brackets);
+    minimap_edit(&buffer->minimap, buffer->content, buffer->size, old_size, 0, length, 0);
+    edit_span_add(&buffer->edits, old_size, 0, length);
+}
+
+// Lines past the indexed prefix are found from the minimap's line counts
+// instead of extending the index up to them, so a jump far into a file whose
+// index was cut back by an edit costs a chunk scan, not a scan to the target
+int lineStart(Buffer *buffer, int line)
+{
+    LineIndex *lines = &buffer->lines;
+    int start = -1;
+    if (line >= lines->valid && line < lines->count)
+    {
+        start = minimap_line_start(&buffer->minimap, buffer->content, buffer->size, line);
+    }
+    return start >= 0 ? start : line_index_start(lines, buffer->content, buffer->size, line);
+}
+
+int lineOf(Buffer *buffer, int pos)
+{
+    LineIndex *lines = &buffer->lines;
+    int line = -1;
+    if (lines->valid < lines->count && pos >= lines->starts[lines->valid - 1])
+    {
+        line = minimap_line_of(&buffer->minimap, buffer->content, buffer->size, pos);
+    }
+    return line >= 0 ? line : line_index_line_of(lines, buffer->content, buffer->size, pos);
+}
+
+// Line length without its newline
+int lineLength(Buffer *buffer, int line)
+{
+    int start = lineStart(buffer, line);
+    if (line + 1 < lineCount(buffer))
+    {
+        return lineStart(buffer, line + 1) - start - 1;
+    }
+    return buffer->size - start;
+}
+
+int lineCount(Buffer *buffer)
+{
+    return buffer->lines.count;
+}
+
+int insertChar(Buffer *buffer, int pos, char ch)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    if (reserveBuffer(buffer, buffer->size + 2) != 0)
+    {
+        return -1;
     }
 
     memmove(&buffer->content[pos + 1], &buffer->content[pos], buffer->size - pos + 1);
     buffer->content[pos] = ch;
     buffer->size++;
+    line_index_insert(&buffer->lines, pos, ch);
+    line_hashes_edit(&buffer->hashes, pos, 0, 1);
+    bracket_index_insert(&buffer->brackets, buffer->content, buffer->size, pos, ch);
+    minimap_edit(&buffer->minimap, buffer->content, buffer->size, pos, 0, 1, 1);
+    edit_span_add(&buffer->edits, pos, 0, 1);
+    journalInsert(buffer->journal, pos, ch);
+    buffer->modified = 1;
+    return 0;
 }
 
 void deleteChar(Buffer *buffer, int pos)
 {
+    PROF_SCOPE(PROF_BUFFER);
+
     if (pos < buffer->size)
     {
+        char ch = buffer->content[pos];
         memmove(&buffer->content[pos], &buffer->content[pos + 1], buffer->size - pos);
         buffer->size--;
+        line_index_delete(&buffer->lines, pos, ch);
+        line_hashes_edit(&buffer->hashes, pos, 1, 0);
+        bracket_index_delete(&buffer->brackets, buffer->content, buffer->size, pos, ch);
+        minimap_edit(&buffer->minimap, buffer->content, buffer->size, pos, 1, 0, 1);
+        edit_span_add(&buffer->edits, pos, 1, 0);
+        journalDelete(buffer->journal, pos, ch);
+        buffer->modified = 1;
+    }
+}
+// Applies splices sorted by pos, none overlapping, in one pass over the text:
+// a block edit across a million lines moves the text after the first splice
+// once instead of a memmove per byte, and the line index is only cut back to
+// the first splice. Nothing changes when the new text doesn't fit.
+int applySplices(Buffer *buffer, const BufferSplice *splices, int count)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    if (count == 0)
+    {
+        return 0;
+    }
+    int size = buffer->size;
+    for (int i = 0; i < count; i++)
+    {
+        size += splices[i].length - splices[i].removed;
+    }
+    if (reserveBuffer(buffer, size + 1) != 0)
+    {
+        return -1;
+    }
+    journalSplices(buffer->journal, splices, count);
+
+    // Newlines are counted before the removed bytes are overwritten
+    char *content = buffer->content;
+    int removed_lines = 0;
+    int inserted_lines = 0;
+    for (int i = 0; i < count; i++)
+    {
+        removed_lines += scan_count_newlines(content + splices[i].pos, splices[i].removed);
+        inserted_lines += scan_count_newlines(splices[i].text, splices[i].length);
+    }
+
+    // The text after splice i moves by what splices 0..i added. Text moving
+    // left goes first, front to back, then text moving right, back to front,
+    // so none is overwritten before it moved; the new bytes go in last.
+    int shift = 0;
+    for (int i = 0; i < count; i++)
+    {
+        shift += splices[i].length - splices[i].removed;
+        int from = splices[i].pos + splices[i].removed;
+        int end = i + 1 < count ? splices[i + 1].pos : buffer->size + 1;
+        if (shift < 0)
+        {
+            memmove(content + from + shift, content + from, end - from);
+        }
     }
-}
\ No newline at end of file
+    for (int i = count - 1; i >= 0; i--)
+    {
+        int from = splices[i].pos + splices[i].removed;
+        int end = i + 1 < count ? splices[i + 1].pos : buffer->size + 1;
+        if (shift > 0)
+        {
+            memmove(content + from + shift, content + from, end - from);
+        }
+        shift -= splices[i].length - splices[i].removed;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(content + splices[i].pos + shift, splices[i].text, splices[i].length);
+        shift += splices[i].length - splices[i].removed;
+    }
+
+    // Everything between the first and last splice counts as edited
+    const BufferSplice *last = &splices[count - 1];
+    int first = splices[0].pos;
+    int old_end = last->pos + last->removed;
+    int new_end = old_end + size - buffer->size;
+
+    buffer->size = size;
+    line_index_splice(&buffer->lines, first, removed_lines, inserted_lines);
+    line_hashes_edit(&buffer->hashes, first, old_end - first, new_end - first);
+    bracket_index_reset(&buffer->brackets);
+    minimap_edit(&buffer->minimap, buffer->content, buffer->size, first, old_end - first, new_end - first, 1);
+    edit_span_add(&buffer->edits, first, old_end - first, new_end - first);
+    buffer->modified = 1;
+    return 0;
+}
@@ -2,19 +2,69 @@
 #define BUFFER_H
 
 #include <stdio.h>
+#include "../src/editor/line_index.h"
+#include "../src/editor/line_hash.h"
+#include "../src/editor/edit_span.h"
+#include "../src/editor/bracket_index.h"
+#include "../src/editor/minimap.h"
+#include <sys/types.h>
 
 #define INITIAL_BUFFER_SIZE 1000
 
+// Read-only mapping of the file as it was loaded or saved, shared by
+// reference with anything still pointing into it
+typedef struct
+{
+    int refs;
+    int fd;
+    const char *data;
+    long long size;
+    long long mtime;
+} FileMapping;
+
 typedef struct
 {
     char *content;
     int size;
     int capacity;
+    LineIndex lines;
+    LineHashes hashes;
+    BracketIndex brackets;
+    MinimapIndex minimap;
+    int modified;            // edited since the last load or save
+    FileMapping *original;   // the file content came from, when it still matches
+    EditSpan edits;          // everything edited since original was taken
+    struct Journal *journal; // edits are logged here when set
 } Buffer;
 
-void initBuffer(Buffer *buffer);
+// Replaces removed bytes at pos with length bytes of text; pos is an offset
+// in the text before the whole batch
+typedef struct
+{
+    int pos;
+    int removed;
+    const char *text;
+    int length;
+} BufferSplice;
+
+int initBuffer(Buffer *buffer);
 void loadFile(Buffer *buffer, const char *filename);
-void insertChar(Buffer *buffer, int pos, char ch);
+int saveBuffer(Buffer *buffer, const char *filename);
+int insertChar(Buffer *buffer, int pos, char ch);
 void deleteChar(Buffer *buffer, int pos);
+int applySplices(Buffer *buffer, const BufferSplice *splices, int count);
+int reserveBuffer(Buffer *buffer, int capacity);
+void appendBytes(Buffer *buffer, int length);
+void resetOriginal(Buffer *buffer, const char *filename);
+const char *originalBytes(Buffer *buffer, int start, int end, FileMapping **mapping);
+void retainMapping(FileMapping *mapping);
+void releaseMapping(FileMapping *mapping);
+int mappingUnchanged(const FileMapping *mapping);
+int originalMatchesFile(Buffer *buffer, const char *filename);
+int lineStart(Buffer *buffer, int line);
+int lineOf(Buffer *buffer, int pos);
+int lineLength(Buffer *buffer, int line);
+int lineCount(Buffer *buffer);
+void freeBuffer(Buffer *buffer);
 
 #endif // BUFFER_H
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "clipboard.h"
+#include "editor.h"
+#include "block.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include <string.h>
+#include <unistd.h>
+
+#define CLIP_RING_SIZE 16
+
+// Terminals cap OSC 52 payloads, and a huge one would stall the screen;
+// the base64 text goes out a chunk at a time so it is never built whole
+#define CLIP_EXPORT_MAX (1 << 20)
+#define CLIP_EXPORT_CHUNK 3072
+
+static Clip *ring[CLIP_RING_SIZE];
+static int ringCount = 0;
+static int ringSelected = 0; // offset back from the newest copy
+
+static Clip *newClip(const char *data, long long length, int rows, FileMapping *mapping)
+{
+    Clip *clip = alloc_malloc(ALLOC_TEXT, sizeof(Clip));
+    if (clip == NULL)
+    {
+        return NULL;
+    }
+    *clip = (Clip){1, data, length, rows, mapping};
+    return clip;
+}
+
+// Unedited text is referenced in the mapped file; text with edits in it is
+// copied, since the buffer moves bytes around under any pointer into it
+Clip *clipRange(Buffer *buffer, int start, int end)
+{
+    FileMapping *mapping = NULL;
+    const char *original = originalBytes(buffer, start, end, &mapping);
+    if (original != NULL)
+    {
+        retainMapping(mapping);
+        return newClip(original, end - start, 0, mapping);
+    }
+
+    char *text = alloc_malloc(ALLOC_TEXT, end - start + 1);
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    memcpy(text, buffer->content + start, end - start);
+    text[end - start] = '\0';
+    Clip *clip = newClip(text, end - start, 0, NULL);
+    if (clip == NULL)
+    {
+        alloc_free(text);
+    }
+    return clip;
+}
+
+// Takes ownership of text
+Clip *clipText(char *text, long long length, int rows)
+{
+    Clip *clip = newClip(text, length, rows, NULL);
+    if (clip == NULL)
+    {
+        alloc_free(text);
+    }
+    return clip;
+}
+
+// A clip of the mapped file is only good while nobody rewrote it in place
+int clipReadable(const Clip *clip)
+{
+    return clip->mapping == NULL || mappingUnchanged(clip->mapping);
+}
+
+void releaseClip(Clip *clip)
+{
+    if (clip == NULL || --clip->refs > 0)
+    {
+        return;
+    }
+    if (clip->mapping != NULL)
+    {
+        releaseMapping(clip->mapping);
+    }
+    else
+    {
+        alloc_free((char *)clip->data);
+    }
+    alloc_free(clip);
+}
+
+// Byte range of a linear selection, clamping columns to their lines
+static void linearRange(Buffer *buffer, const Selection *selection, int *start, int *end)
+{
+    Cursor first = selection->start;
+    Cursor last = selection->end;
+    if (first.y > last.y || (first.y == last.y && first.x > last.x))
+    {
+        first = selection->end;
+        last = selection->start;
+    }
+    selection_row_span(&buffer->lines, buffer->content, buffer->size, first.y, first.x, first.x, start, start);
+    selection_row_span(&buffer->lines, buffer->content, buffer->size, last.y, last.x, last.x, end, end);
+}
+
+Clip *copySelection(Buffer *buffer, const Selection *selection)
+{
+    if (selection->mode == SELECTION_BLOCK)
+    {
+        return copyBlock(buffer, selection);
+    }
+    int start, end;
+    linearRange(buffer, selection, &start, &end);
+    return clipRange(buffer, start, end);
+}
+
+// The cursor lands where the selection started
+int deleteSelection(Buffer *buffer, const Selection *selection, int *cursor_x, int *cursor_y)
+{
+    SelectionRect rect = selection_rect(selection);
+    if (selection->mode == SELECTION_BLOCK)
+    {
+        if (deleteBlock(buffer, selection) != 0)
+        {
+            return -1;
+        }
+        *cursor_y = MIN(rect.top, lineCount(buffer) - 1);
+        *cursor_x = MIN(rect.left, lineLength(buffer, *cursor_y));
+        return 0;
+    }
+    int start, end;
+    linearRange(buffer, selection, &start, &end);
+    BufferSplice splice = {start, end - start, NULL, 0};
+    if (applySplices(buffer, &splice, 1) != 0)
+    {
+        return -1;
+    }
+    *cursor_y = lineOf(buffer, start);
+    *cursor_x = start - lineStart(buffer, *cursor_y);
+    return 0;
+}
+
+int pasteClip(Buffer *buffer, const Clip *clip, int *cursor_x, int *cursor_y)
+{
+    if (!clipReadable(clip))
+    {
+        return -1;
+    }
+    if (clip->rows > 0)
+    {
+        return pasteBlock(buffer, *cursor_y, *cursor_x, clip) != 0 ? -2 : 0;
+    }
+    int pos = lineStart(buffer, *cursor_y) + *cursor_x;
+    BufferSplice splice = {pos, 0, clip->data, clip->length};
+    if (applySplices(buffer, &splice, 1) != 0)
+    {
+        return -2;
+    }
+    pos += clip->length;
+    *cursor_y = lineOf(buffer, pos);
+    *cursor_x = pos - lineStart(buffer, *cursor_y);
+    return 0;
+}
+
+void pushClip(Clip *clip)
+{
+    if (clip == NULL)
+    {
+        return;
+    }
+    if (ringCount == CLIP_RING_SIZE)
+    {
+        releaseClip(ring[--ringCount]);
+    }
+    memmove(ring + 1, ring, ringCount * sizeof(Clip *));
+    ring[0] = clip;
+    ringCount++;
+    ringSelected = 0;
+}
+
+// The copy the next paste uses, or NULL when nothing was copied
+Clip *currentClip(void)
+{
+    return ringCount > 0 ? ring[ringSelected] : NULL;
+}
+
+// Steps the paste back to an older copy, wrapping to the newest; returns
+// its position in the ring
+int cycleClips(int *count)
+{
+    *count = ringCount;
+    if (ringCount > 0)
+    {
+        ringSelected = (ringSelected + 1) % ringCount;
+    }
+    return ringSelected;
+}
+
+void clearClips(void)
+{
+    while (ringCount > 0)
+    {
+        releaseClip(ring[--ringCount]);
+    }
+    ringSelected = 0;
+}
+
+static int writeAll(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, data, length);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int exportClip(const Clip *clip)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (clip->length > CLIP_EXPORT_MAX || !clipReadable(clip))
+    {
+        return -1;
+    }
+
+    char out[CLIP_EXPORT_CHUNK / 3 * 4];
+    const unsigned char *data = (const unsigned char *)clip->data;
+    int status = writeAll("\033]52;c;", 7);
+    for (long long offset = 0; offset < clip->length && status == 0; offset += CLIP_EXPORT_CHUNK)
+    {
+        long long end = MIN(offset + CLIP_EXPORT_CHUNK, clip->length);
+        int length = 0;
+        for (long long i = offset; i < end; i += 3)
+        {
+            unsigned value = data[i] << 16;
+            if (i + 1 < end)
+            {
+                value |= data[i + 1] << 8;
+            }
+            if (i + 2 < end)
+            {
+                value |= data[i + 2];
+            }
+            out[length++] = alphabet[value >> 18 & 63];
+            out[length++] = alphabet[value >> 12 & 63];
+            out[length++] = i + 1 < end ? alphabet[value >> 6 & 63] : '=';
+            out[length++] = i + 2 < end ? alphabet[value & 63] : '=';
+        }
+        status = writeAll(out, length);
+    }
+    if (status == 0)
+    {
+        status = writeAll("\a", 1);
+    }
+    return status;
+}
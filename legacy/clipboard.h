@@ -0,0 +1,42 @@
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+#include "buffer.h"
+#include "../src/editor/selection.h"
+
+// A copied piece of text. Copies of unedited text point into the mapped
+// file instead of duplicating it; anything else owns its bytes. Clips are
+// immutable and shared by reference count.
+typedef struct
+{
+    int refs;
+    const char *data;
+    long long length;
+    int rows;             // lines of a block copy, 0 for a linear one
+    FileMapping *mapping; // holds data when set, otherwise data is owned
+} Clip;
+
+Clip *clipRange(Buffer *buffer, int start, int end);
+Clip *clipText(char *text, long long length, int rows);
+int clipReadable(const Clip *clip);
+void releaseClip(Clip *clip);
+
+// Copy, cut and paste for either kind of selection. Pasting a linear clip
+// leaves the cursor after it; returns -1 when its file changed underneath
+// and -2 when there was no memory for it. A copy is NULL, and a cut returns
+// -1, when short of memory.
+Clip *copySelection(Buffer *buffer, const Selection *selection);
+int deleteSelection(Buffer *buffer, const Selection *selection, int *cursor_x, int *cursor_y);
+int pasteClip(Buffer *buffer, const Clip *clip, int *cursor_x, int *cursor_y);
+
+// Ring of recent copies; the ring holds its own reference to each
+void pushClip(Clip *clip);
+Clip *currentClip(void);
+int cycleClips(int *count);
+void clearClips(void);
+
+// Sends the clip to the terminal's clipboard with OSC 52. Returns -1 when
+// it is too large to send.
+int exportClip(const Clip *clip);
+
+#endif // CLIPBOARD_H
@@ -0,0 +1,356 @@
+#include "diffview.h"
+#include "editor.h"
+#include "../src/editor/diff.h"
+#include "../src/editor/line_index.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DIFF_POLL_MS 50
+#define DIFF_TAB_WIDTH 4
+
+// One side of the comparison: its text and every line start
+typedef struct
+{
+    const char *data;
+    int size;
+    LineIndex lines;
+    uint64_t *hashes;
+} DiffSide;
+
+typedef struct
+{
+    DiffSide saved;
+    DiffSide current;
+    DiffResult result;
+    long long *hunkRows; // screen row where each hunk starts
+    long long rows;
+    int status;
+    int done;
+    int cancel;
+} DiffJob;
+
+// Fails when the line starts or hashes don't fit in memory
+static int hashSide(DiffSide *side)
+{
+    if (line_index_init(&side->lines) != 0)
+    {
+        return -1;
+    }
+    line_index_build(&side->lines, side->data, side->size);
+    int count = side->lines.count;
+    if (side->lines.valid < count)
+    {
+        return -1;
+    }
+    side->hashes = alloc_malloc(ALLOC_DIFF, count * sizeof(uint64_t));
+    if (side->hashes == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int start = side->lines.starts[i];
+        int end = i + 1 < count ? side->lines.starts[i + 1] - 1 : side->size;
+        side->hashes[i] = diff_hash(side->data + start, end - start);
+    }
+    return 0;
+}
+
+// Hunks are as tall as their longer side; equal lines take one row each
+static int layoutRows(DiffJob *job)
+{
+    job->hunkRows = alloc_malloc(ALLOC_DIFF, (job->result.count + 1) * sizeof(long long));
+    if (job->hunkRows == NULL)
+    {
+        return -1;
+    }
+    long long row = 0;
+    int old_line = 0;
+    for (int h = 0; h < job->result.count; h++)
+    {
+        DiffHunk *hunk = &job->result.hunks[h];
+        row += hunk->old_start - old_line;
+        job->hunkRows[h] = row;
+        row += MAX(hunk->old_count, hunk->new_count);
+        old_line = hunk->old_start + hunk->old_count;
+    }
+    job->rows = row + job->saved.lines.count - old_line;
+    return 0;
+}
+
+static void *diffWorker(void *arg)
+{
+    DiffJob *job = arg;
+    job->status = -1;
+    if (hashSide(&job->saved) == 0 && hashSide(&job->current) == 0 &&
+        diff_lines(job->saved.hashes, job->saved.lines.count, job->current.hashes, job->current.lines.count,
+                   &job->cancel, &job->result) == 0 &&
+        layoutRows(job) == 0)
+    {
+        job->status = 0;
+    }
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Which line of each side sits on a row, -1 for the blank filler
+static int rowLines(const DiffJob *job, long long row, int *saved, int *current)
+{
+    int low = 0, high = job->result.count - 1, hunk = -1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (job->hunkRows[mid] <= row)
+        {
+            hunk = mid;
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    if (hunk < 0)
+    {
+        *saved = *current = (int)row;
+        return 0;
+    }
+    const DiffHunk *h = &job->result.hunks[hunk];
+    long long offset = row - job->hunkRows[hunk];
+    if (offset < MAX(h->old_count, h->new_count))
+    {
+        *saved = offset < h->old_count ? h->old_start + (int)offset : -1;
+        *current = offset < h->new_count ? h->new_start + (int)offset : -1;
+        return 1;
+    }
+    offset -= MAX(h->old_count, h->new_count);
+    *saved = h->old_start + h->old_count + (int)offset;
+    *current = h->new_start + h->new_count + (int)offset;
+    return 0;
+}
+
+// Draws one line clipped to width, expanding tabs, without wrapping
+static void drawLine(int y, int x, int width, const DiffSide *side, int line)
+{
+    if (line < 0 || line >= side->lines.count)
+    {
+        return;
+    }
+    int start = side->lines.starts[line];
+    int end = line + 1 < side->lines.count ? side->lines.starts[line + 1] - 1 : side->size;
+    int column = 0;
+    for (int i = start; i < end && column < width; i++)
+    {
+        unsigned char c = side->data[i];
+        if (c == '\t')
+        {
+            do
+            {
+                mvaddch(y, x + column++, ' ');
+            } while (column % DIFF_TAB_WIDTH != 0 && column < width);
+        }
+        else
+        {
+            mvaddch(y, x + column++, c >= 32 && c < 127 ? c : '?');
+        }
+    }
+    prof_count(PROF_BYTES_WRITTEN, column);
+}
+
+static void freeSide(DiffSide *side)
+{
+    line_index_free(&side->lines);
+    alloc_free(side->hashes);
+}
+
+int runDiffView(Buffer *buffer, const char *filename)
+{
+    DiffJob job;
+    memset(&job, 0, sizeof(job));
+
+    // The saved file is mapped; the buffer can't change while the view is up
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    void *mapped = NULL;
+    if (st.st_size > 0)
+    {
+        mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            return 1;
+        }
+    }
+    close(fd);
+    job.saved.data = mapped ? mapped : "";
+    job.saved.size = st.st_size;
+    job.current.data = buffer->content;
+    job.current.size = buffer->size;
+
+    // The editor may be polling a watched file; its input mode comes back at the end
+    int waiting = is_nodelay(stdscr);
+    pthread_t worker;
+    int threaded = pthread_create(&worker, NULL, diffWorker, &job) == 0;
+    if (threaded)
+    {
+        timeout(DIFF_POLL_MS);
+    }
+    else
+    {
+        diffWorker(&job);
+    }
+
+    long long top = 0;
+    int ch = 0;
+    while (1)
+    {
+        int done = __atomic_load_n(&job.done, __ATOMIC_ACQUIRE);
+        int height = LINES - 1;
+        int half = (COLS - 1) / 2;
+        long long max_top = job.rows > height ? job.rows - height : 0;
+        if (top > max_top)
+        {
+            top = max_top;
+        }
+        if (top < 0)
+        {
+            top = 0;
+        }
+
+        ProfScope layout = prof_scope_begin(PROF_LAYOUT);
+        erase();
+        if (done && job.status == 0)
+        {
+            for (int y = 0; y < height && top + y < job.rows; y++)
+            {
+                int saved, current;
+                int changed = rowLines(&job, top + y, &saved, &current);
+                if (changed)
+                {
+                    attron(A_BOLD);
+                    mvaddch(y, 0, saved >= 0 ? '-' : ' ');
+                    mvaddch(y, half + 1, current >= 0 ? '+' : ' ');
+                }
+                drawLine(y, 1, half - 1, &job.saved, saved);
+                drawLine(y, half + 2, COLS - half - 2, &job.current, current);
+                attroff(A_BOLD);
+                mvaddch(y, half, ACS_VLINE);
+            }
+        }
+        attron(A_REVERSE);
+        if (!done)
+        {
+            mvprintw(height, 0, " %s  [diff]  comparing with saved... ", filename);
+        }
+        else if (job.status != 0)
+        {
+            mvprintw(height, 0, " %s  [diff]  comparison failed ", filename);
+        }
+        else
+        {
+            mvprintw(height, 0, " %s  [diff]  saved | buffer  %d hunks  %3lld%%  n/p: next/prev hunk ", filename,
+                     job.result.count, job.rows > 0 ? (top + height >= job.rows ? 100 : (top + height) * 100 / job.rows) : 100);
+        }
+        attroff(A_REVERSE);
+        prof_draw_overlay();
+        prof_scope_end(&layout);
+        refresh();
+        prof_frame_end();
+
+        if (done)
+        {
+            timeout(-1);
+        }
+        ch = getch();
+        prof_frame_begin();
+        if (ch == 17 || ch == 'q' || ch == KEY_F(5))
+        { // Ctrl+Q, q or F5 close the view
+            break;
+        }
+        if (!done)
+        {
+            continue;
+        }
+
+        switch (ch)
+        {
+        case KEY_UP:
+            top--;
+            break;
+        case KEY_DOWN:
+            top++;
+            break;
+        case KEY_PPAGE:
+            top -= height;
+            break;
+        case KEY_NPAGE:
+            top += height;
+            break;
+        case KEY_HOME:
+            top = 0;
+            break;
+        case KEY_END:
+            top = max_top;
+            break;
+        case 'n':
+            for (int h = 0; h < job.result.count; h++)
+            {
+                if (job.hunkRows[h] > top)
+                {
+                    top = job.hunkRows[h];
+                    break;
+                }
+            }
+            break;
+        case 'p':
+            for (int h = job.result.count - 1; h >= 0; h--)
+            {
+                if (job.hunkRows[h] < top)
+                {
+                    top = job.hunkRows[h];
+                    break;
+                }
+            }
+            break;
+        case KEY_F(12):
+            prof_toggle_overlay();
+            break;
+        }
+    }
+
+    // Closing early stops the search at its next cost check
+    __atomic_store_n(&job.cancel, 1, __ATOMIC_RELAXED);
+    if (threaded)
+    {
+        pthread_join(worker, NULL);
+    }
+    timeout(-1);
+    nodelay(stdscr, waiting);
+
+    diff_free(&job.result);
+    alloc_free(job.hunkRows);
+    freeSide(&job.saved);
+    freeSide(&job.current);
+    if (mapped)
+    {
+        munmap(mapped, st.st_size);
+    }
+    return 0;
+}
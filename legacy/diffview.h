@@ -0,0 +1,10 @@
+#ifndef DIFFVIEW_H
+#define DIFFVIEW_H
+
+#include "buffer.h"
+
+// Side-by-side comparison of the buffer with the saved file; the diff runs
+// on a worker thread while the screen stays responsive
+int runDiffView(Buffer *buffer, const char *filename);
+
+#endif // DIFFVIEW_H
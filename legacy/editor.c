@@ -1,9 +1,59 @@
 #include "editor.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
 #include <ncurses.h>
-#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static int scroll_y = 0;
 
+// Text and status line are separate windows, so the status is only sent
+// when the position it shows changes
+static WINDOW *text_window = NULL;
+static WINDOW *status_window = NULL;
+static WINDOW *ruler_window = NULL;
+static WINDOW *windows_screen = NULL;
+static int windows_lines = 0;
+static int windows_cols = 0;
+static char shown_status[32];
+static char message[64];
+static int message_changed = 0;
+static const Selection *selection = NULL;
+
+// What the ruler last showed; it is only summed again when one changes
+static MinimapRow *ruler_rows = NULL;
+static unsigned shown_version = 0;
+static int shown_ruler_scroll = -1;
+
+static void createWindows(void)
+{
+    // Windows of a previous screen went away with it
+    if (windows_screen == stdscr)
+    {
+        delwin(text_window);
+        delwin(status_window);
+        delwin(ruler_window);
+    }
+    text_window = newwin(MAX(1, LINES - 1), MAX(1, COLS - RULER_WIDTH), 0, 0);
+    status_window = newwin(1, COLS, LINES - 1, 0);
+    ruler_window = newwin(MAX(1, LINES - 1), RULER_WIDTH, 0, MAX(0, COLS - RULER_WIDTH));
+    // Without room for its rows the ruler stays blank
+    MinimapRow *rows = alloc_realloc(ALLOC_TEXT_INDEX, ruler_rows, MAX(1, LINES - 1) * sizeof(MinimapRow));
+    if (rows == NULL)
+    {
+        alloc_free(ruler_rows);
+    }
+    ruler_rows = rows;
+    shown_status[0] = '\0';
+    message_changed = 1;
+    shown_ruler_scroll = -1;
+
+    windows_screen = stdscr;
+    windows_lines = LINES;
+    windows_cols = COLS;
+}
+
 void initEditor(void)
 {
     initscr();
@@ -12,16 +62,138 @@ void initEditor(void)
     noecho();
     mousemask(BUTTON1_PRESSED, NULL);
     mouseinterval(0);
+    // Flush stdscr once so getch() never repaints it over the windows
+    refresh();
 }
 
 void cleanupEditor(void)
 {
     endwin();
+    alloc_free(ruler_rows);
+    ruler_rows = NULL;
+}
+
+// Shown at the left of the status line; NULL clears it
+void showMessage(const char *text)
+{
+    snprintf(message, sizeof(message), "%s", text ? text : "");
+    message_changed = 1;
+}
+
+// Highlighted on every redraw until cleared with NULL
+void setSelection(const Selection *shown)
+{
+    selection = shown;
+}
+
+// A full-screen view drew over the windows; send all of them again
+void redrawEditor(void)
+{
+    if (windows_screen == stdscr)
+    {
+        touchwin(text_window);
+        touchwin(status_window);
+        touchwin(ruler_window);
+        shown_ruler_scroll = -1;
+        message_changed = 1;
+    }
+}
+
+// Reads a line of text on the status line; returns its length, or -1 when
+// Esc cancels it
+int promptInput(const char *label, char *text, int size)
+{
+    int length = 0;
+    int waiting = is_nodelay(stdscr);
+    nodelay(stdscr, FALSE);
+    text[0] = '\0';
+    while (1)
+    {
+        werase(status_window);
+        mvwaddstr(status_window, 0, 0, label);
+        waddstr(status_window, text);
+        wrefresh(status_window);
+
+        int ch = getch();
+        if (ch == '\n' || ch == KEY_ENTER)
+        {
+            break;
+        }
+        if (ch == 27)
+        {
+            length = -1;
+            break;
+        }
+        if ((ch == KEY_BACKSPACE || ch == 127) && length > 0)
+        {
+            text[--length] = '\0';
+        }
+        else if (ch >= 32 && ch <= 126 && length < size - 1)
+        {
+            text[length++] = ch;
+            text[length] = '\0';
+        }
+    }
+    nodelay(stdscr, waiting);
+    message_changed = 1;
+    return length;
+}
+
+// Overview of the whole file down the right edge: each row shows how full
+// its lines are, '*' where the search matches and a bold '+' where the text
+// was edited since the last save. The rows in view are reversed.
+static void drawRuler(Buffer *buffer)
+{
+    MinimapIndex *minimap = &buffer->minimap;
+    if (ruler_rows == NULL || (minimap->version == shown_version && scroll_y == shown_ruler_scroll))
+    {
+        return;
+    }
+    static const char shades[] = " .:|#";
+    int height = getmaxy(ruler_window);
+    int width = MAX(1, COLS - RULER_WIDTH);
+    minimap_rows(minimap, buffer->content, buffer->size, lineCount(buffer), ruler_rows, height);
+
+    for (int y = 0; y < height; y++)
+    {
+        const MinimapRow *row = &ruler_rows[y];
+        chtype cell = ' ';
+        if (row->lines > 0)
+        {
+            int fill = row->ink * 4 / (row->lines * width);
+            cell = shades[row->ink > 0 ? MIN(1 + fill, 4) : 0];
+        }
+        if (row->hits > 0)
+        {
+            cell = '*';
+        }
+        if (row->edited)
+        {
+            cell = (row->hits > 0 ? '*' : '+') | A_BOLD;
+        }
+        if (row->lines > 0 && row->first < scroll_y + height && row->first + row->lines > scroll_y)
+        {
+            cell |= A_REVERSE;
+        }
+        mvwaddch(ruler_window, y, 0, cell);
+    }
+    wnoutrefresh(ruler_window);
+    shown_version = minimap->version;
+    shown_ruler_scroll = scroll_y;
 }
 
 void displayBuffer(Buffer *buffer, int cursor_x, int cursor_y)
 {
-    clear();
+    ProfScope layout = prof_scope_begin(PROF_LAYOUT);
+    long bytes_written = 0;
+
+    if (windows_screen != stdscr || windows_lines != LINES || windows_cols != COLS)
+    {
+        createWindows();
+    }
+
+    // werase() rather than wclear() lets curses send only the cells that changed
+    werase(text_window);
 
     // Adjust scroll position to keep cursor in view
     if (cursor_y < scroll_y + SCROLL_MARGIN)
@@ -33,47 +205,109 @@ void displayBuffer(Buffer *buffer, int cursor_x, int cursor_y)
         scroll_y = cursor_y - LINES + SCROLL_MARGIN + 2;
     }
 
-    // Display buffer content
+    // Display buffer content, starting at the first visible line
     int screen_y = 0;
-    int file_y = 0;
     int x = 0;
 
-    for (int i = 0; i < buffer->size && screen_y < LINES - 1; i++)
+    for (int i = lineStart(buffer, scroll_y); i < buffer->size && screen_y < LINES - 1; i++)
     {
-        if (file_y >= scroll_y)
+        if (buffer->content[i] == '\n')
         {
-            if (buffer->content[i] == '\n')
-            {
-                screen_y++;
-                x = 0;
-            }
-            else
-            {
-                mvaddch(screen_y, x, buffer->content[i]);
-                x++;
-            }
+            screen_y++;
+            x = 0;
         }
-        if (buffer->content[i] == '\n')
+        else
         {
-            file_y++;
-            if (file_y < scroll_y)
-            {
-                x = 0;
-            }
+            chtype attributes = selection && selection_contains(selection, scroll_y + screen_y, x) ? A_REVERSE : 0;
+            mvwaddch(text_window, screen_y, x, (unsigned char)buffer->content[i] | attributes);
+            bytes_written++;
+            x++;
         }
     }
 
-    // Status line
-    int pos_str_length = 11 + (int)log10(cursor_y + 1) + (int)log10(cursor_x + 1);
-    mvprintw(LINES - 1, COLS - pos_str_length, "Ln %d, Col %d", cursor_y + 1, cursor_x + 1);
+    drawRuler(buffer);
 
-    // Move cursor to correct screen position
-    move(cursor_y - scroll_y, cursor_x);
-    refresh();
+    // Status line, right-aligned by the length snprintf reports
+    char status[sizeof(shown_status)];
+    int status_length = snprintf(status, sizeof(status), "Ln %d, Col %d", cursor_y + 1, cursor_x + 1);
+    if (strcmp(status, shown_status) != 0 || message_changed)
+    {
+        werase(status_window);
+        mvwaddstr(status_window, 0, 0, message);
+        mvwaddstr(status_window, 0, MAX(0, COLS - status_length), status);
+        wnoutrefresh(status_window);
+        strcpy(shown_status, status);
+        message_changed = 0;
+        bytes_written += status_length;
+    }
+
+    prof_count(PROF_BYTES_WRITTEN, bytes_written);
+    prof_draw_overlay_window(text_window);
+    alloc_draw_panel_window(text_window);
+    prof_scope_end(&layout);
+
+    // Move cursor to correct screen position; the text window goes out last
+    // so the terminal cursor is left there
+    wmove(text_window, cursor_y - scroll_y, cursor_x);
+    wnoutrefresh(text_window);
+    PROF_SCOPE(PROF_OUTPUT);
+    doupdate();
+}
+
+// Puts the cursor on byte pos; a negative pos leaves it where it is
+static void moveCursorTo(Buffer *buffer, int pos, int *cursor_x, int *cursor_y)
+{
+    if (pos < 0)
+    {
+        return;
+    }
+    *cursor_y = lineOf(buffer, pos);
+    *cursor_x = pos - lineStart(buffer, *cursor_y);
+}
+
+// Moves the cursor to the next match of the search after it, wrapping at
+// the end; returns 0 when there is none
+int findNext(Buffer *buffer, int *cursor_x, int *cursor_y)
+{
+    int from = lineStart(buffer, *cursor_y) + *cursor_x + 1;
+    int match = minimap_find(&buffer->minimap, buffer->content, buffer->size, from);
+    moveCursorTo(buffer, match, cursor_x, cursor_y);
+    return match >= 0;
+}
+
+// Jumps to a line number, a percentage of the file ("40%") or a byte offset
+// ("@1024"); returns -1 when target is none of them
+int goToTarget(Buffer *buffer, const char *target, int *cursor_x, int *cursor_y)
+{
+    int byte = target[0] == '@';
+    char *end;
+    long long value = strtoll(target + byte, &end, 10);
+    int percent = !byte && *end == '%';
+    if (end == target + byte || value < 0 || end[percent] != '\0')
+    {
+        return -1;
+    }
+
+    if (byte)
+    {
+        moveCursorTo(buffer, MIN(value, buffer->size), cursor_x, cursor_y);
+    }
+    else if (percent)
+    {
+        moveCursorTo(buffer, buffer->size * MIN(value, 100) / 100, cursor_x, cursor_y);
+        *cursor_x = 0;
+    }
+    else
+    {
+        *cursor_y = MAX(1, MIN(value, lineCount(buffer))) - 1;
+        *cursor_x = 0;
+    }
+    return 0;
 }
 
 void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
 {
+    PROF_SCOPE(PROF_INPUT);
     MEVENT event;
 
     if (ch == KEY_MOUSE)
@@ -122,19 +356,7 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
         }
     }
 
-    int current_pos = 0;
-    for (int i = 0; i < *cursor_y; i++)
-    {
-        while (current_pos < buffer->size && buffer->content[current_pos] != '\n')
-        {
-            current_pos++;
-        }
-        if (current_pos < buffer->size)
-        {
-            current_pos++; // Skip the newline
-        }
-    }
-    current_pos += *cursor_x;
+    int current_pos = lineStart(buffer, *cursor_y) + *cursor_x;
 
     if (ch == 17)
     { // Ctrl+Q
@@ -142,11 +364,16 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
     }
     else if (ch == '\t')
     { // Tab key
-        for (int i = 0; i < 4; i++)
+        int inserted = 0;
+        while (inserted < 4 && insertChar(buffer, current_pos + inserted, ' ') == 0)
         { // 4 spaces for a tab
-            insertChar(buffer, current_pos + i, ' ');
+            inserted++;
+        }
+        *cursor_x += inserted;
+        if (inserted < 4)
+        {
+            showMessage("Out of memory");
         }
-        *cursor_x += 4;
     }
     else if (ch == KEY_HOME)
     { // Home key
@@ -170,26 +397,28 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
     else if (ch == 530)
     { // Ctrl+End (may vary by terminal)
         // Find last line and its length
-        int total_lines = 0;
-        int last_line_length = 0;
-        for (int i = 0; i < buffer->size; i++)
+        int total_lines = lineCount(buffer) - 1;
+        *cursor_y = total_lines;
+        *cursor_x = lineLength(buffer, total_lines);
+    }
+    else if (ch == 29)
+    { // Ctrl+] jumps to the partner of the bracket under or just before the cursor
+        int match = bracket_match(&buffer->brackets, buffer->content, buffer->size, current_pos);
+        if (match < 0 && current_pos > 0)
         {
-            if (buffer->content[i] == '\n')
-            {
-                total_lines++;
-                last_line_length = 0;
-            }
-            else if (i == buffer->size - 1)
-            {
-                last_line_length++;
-            }
-            else
-            {
-                last_line_length++;
-            }
+            match = bracket_match(&buffer->brackets, buffer->content, buffer->size, current_pos - 1);
         }
-        *cursor_y = total_lines;
-        *cursor_x = last_line_length;
+        moveCursorTo(buffer, match, cursor_x, cursor_y);
+    }
+    else if (ch == KEY_F(9))
+    { // F9 goes to the start of the enclosing block, again to the one around it
+        moveCursorTo(buffer, bracket_block_start(&buffer->brackets, buffer->content, buffer->size, current_pos),
+                     cursor_x, cursor_y);
+    }
+    else if (ch == KEY_F(10))
+    { // F10 goes to the end of the enclosing block
+        moveCursorTo(buffer, bracket_block_end(&buffer->brackets, buffer->content, buffer->size, current_pos),
+                     cursor_x, cursor_y);
     }
     else if (ch == KEY_UP)
     {
@@ -216,14 +445,7 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
     }
     else if (ch == KEY_DOWN)
     {
-        int count_newlines = 0;
-        for (int i = 0; i < buffer->size; i++)
-        {
-            if (buffer->content[i] == '\n')
-            {
-                count_newlines++;
-            }
-        }
+        int count_newlines = lineCount(buffer) - 1;
         if (*cursor_y < count_newlines)
         {
             (*cursor_y)++;
@@ -314,13 +536,21 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
     }
     else if (ch == '\n' || ch == KEY_ENTER)
     {
-        insertChar(buffer, current_pos, '\n');
+        if (insertChar(buffer, current_pos, '\n') != 0)
+        {
+            showMessage("Out of memory");
+            return;
+        }
         (*cursor_y)++;
         *cursor_x = 0;
     }
     else if (ch >= 32 && ch <= 126)
     { // Printable ASCII
-        insertChar(buffer, current_pos, ch);
+        if (insertChar(buffer, current_pos, ch) != 0)
+        {
+            showMessage("Out of memory");
+            return;
+        }
         (*cursor_x)++;
     }
     else if (ch == KEY_PPAGE)
@@ -350,14 +580,7 @@ void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y)
     else if (ch == KEY_NPAGE)
     { // Page Down
         int page_size = LINES - 2;
-        int count_newlines = 0;
-        for (int i = 0; i < buffer->size; i++)
-        {
-            if (buffer->content[i] == '\n')
-            {
-                count_newlines++;
-            }
-        }
+        int count_newlines = lineCount(buffer) - 1;
         for (int i = 0; i < page_size && *cursor_y < count_newlines; i++)
         {
             (*cursor_y)++;
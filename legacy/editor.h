@@ -2,13 +2,21 @@
 #define EDITOR_H
 
 #include "buffer.h"
+#include "../src/editor/selection.h"
 
 #define SCROLL_MARGIN 5
+#define RULER_WIDTH 1
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 void displayBuffer(Buffer *buffer, int cursor_x, int cursor_y);
 void handleInput(Buffer *buffer, int ch, int *cursor_x, int *cursor_y);
+void showMessage(const char *message);
+int promptInput(const char *label, char *text, int size);
+int findNext(Buffer *buffer, int *cursor_x, int *cursor_y);
+int goToTarget(Buffer *buffer, const char *target, int *cursor_x, int *cursor_y);
+void setSelection(const Selection *selection);
+void redrawEditor(void);
 void initEditor(void);
 void cleanupEditor(void);
 
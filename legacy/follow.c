@@ -0,0 +1,169 @@
+#include "follow.h"
+#include "../src/profiler/profiler.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FOLLOW_READ_SIZE (1 << 20)
+
+// State of the followed file: an open fd read from offset, plus watches on
+// the file itself and on its directory to notice rotation
+static int notify_fd = -1;
+static int file_watch = -1;
+static int dir_watch = -1;
+static int file_fd = -1;
+static off_t offset = 0;
+static char file_path[PATH_MAX];
+static char file_name[NAME_MAX + 1];
+
+static void watchFile(void)
+{
+    if (file_watch >= 0)
+    {
+        inotify_rm_watch(notify_fd, file_watch);
+    }
+    file_watch = inotify_add_watch(notify_fd, file_path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+
+// Reads everything from offset to the current end straight into the buffer;
+// short of memory the rest waits for the next change
+static int readAppended(Buffer *buffer)
+{
+    int total = 0;
+    while (reserveBuffer(buffer, buffer->size + FOLLOW_READ_SIZE + 1) == 0)
+    {
+        ssize_t n = pread(file_fd, buffer->content + buffer->size, FOLLOW_READ_SIZE, offset);
+        if (n <= 0)
+        {
+            break;
+        }
+        offset += n;
+        total += n;
+        appendBytes(buffer, n);
+    }
+    return total;
+}
+
+static void reload(Buffer *buffer)
+{
+    buffer->size = 0;
+    buffer->content[0] = '\0';
+    line_index_build(&buffer->lines, buffer->content, 0);
+    line_hashes_reset(&buffer->hashes);
+    bracket_index_reset(&buffer->brackets);
+    minimap_reset(&buffer->minimap);
+    offset = 0;
+    readAppended(buffer);
+}
+
+static int reopen(void)
+{
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    if (file_fd >= 0)
+    {
+        close(file_fd);
+    }
+    file_fd = fd;
+    watchFile();
+    return 1;
+}
+
+int startFollow(Buffer *buffer, const char *filename)
+{
+    if (realpath(filename, file_path) == NULL)
+    {
+        return -1;
+    }
+    // dirname and basename may modify their argument
+    char dir_path[PATH_MAX];
+    char name_path[PATH_MAX];
+    strcpy(dir_path, file_path);
+    strcpy(name_path, file_path);
+    snprintf(file_name, sizeof(file_name), "%s", basename(name_path));
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0)
+    {
+        return -1;
+    }
+    dir_watch = inotify_add_watch(notify_fd, dirname(dir_path), IN_CREATE | IN_MOVED_TO);
+    if (!reopen())
+    {
+        return -1;
+    }
+
+    // The buffer already holds what loadFile read
+    offset = buffer->size;
+    readAppended(buffer);
+    return 0;
+}
+
+int followFd(void)
+{
+    return notify_fd;
+}
+
+// Drains pending events and applies them; returns the number of bytes
+// appended, or FOLLOW_RELOADED after a truncation or rotation
+int pollFollow(Buffer *buffer)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int rotated = 0;
+    ssize_t length;
+    while ((length = read(notify_fd, events, sizeof(events))) > 0)
+    {
+        for (char *p = events; p < events + length;)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->wd == file_watch && (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)))
+            {
+                rotated = 1;
+            }
+            if (event->wd == dir_watch && event->len > 0 && strcmp(event->name, file_name) == 0)
+            {
+                rotated = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    // A rotated log is reopened by name once the new file exists
+    if (rotated && reopen())
+    {
+        reload(buffer);
+        return FOLLOW_RELOADED;
+    }
+
+    struct stat st;
+    if (fstat(file_fd, &st) == 0 && st.st_size < offset)
+    {
+        reload(buffer);
+        return FOLLOW_RELOADED;
+    }
+    return readAppended(buffer);
+}
+
+void stopFollow(void)
+{
+    if (file_fd >= 0)
+    {
+        close(file_fd);
+    }
+    if (notify_fd >= 0)
+    {
+        close(notify_fd);
+    }
+    file_fd = -1;
+    notify_fd = -1;
+    file_watch = -1;
+    dir_watch = -1;
+}
@@ -0,0 +1,13 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include "buffer.h"
+
+#define FOLLOW_RELOADED -1
+
+int startFollow(Buffer *buffer, const char *filename);
+int followFd(void);
+int pollFollow(Buffer *buffer);
+void stopFollow(void);
+
+#endif // FOLLOW_H
@@ -0,0 +1,90 @@
+#include "hexview.h"
+#include "../src/editor/sniff.h"
+#include "../src/editor/hex_view.h"
+#include "../src/profiler/profiler.h"
+#include <ncurses.h>
+
+int isBinaryFile(const char *filename)
+{
+    return sniff_file(filename) == FILE_KIND_BINARY;
+}
+
+// Read-only viewer for binaries; only the rows on screen are ever touched
+int runHexView(const char *filename)
+{
+    HexView view;
+    if (hex_view_open(&view, filename) != 0)
+    {
+        return 1;
+    }
+
+    long long rows = hex_view_rows(&view);
+    long long top = 0;
+    char line[HEX_ROW_WIDTH + 1];
+
+    while (1)
+    {
+        int height = LINES - 1;
+        long long max_top = rows > height ? rows - height : 0;
+        if (top > max_top)
+        {
+            top = max_top;
+        }
+        if (top < 0)
+        {
+            top = 0;
+        }
+
+        ProfScope layout = prof_scope_begin(PROF_LAYOUT);
+        erase();
+        for (int y = 0; y < height && top + y < rows; y++)
+        {
+            int length = hex_view_format_row(&view, top + y, line, sizeof(line));
+            mvaddnstr(y, 0, line, length);
+            prof_count(PROF_BYTES_WRITTEN, length);
+        }
+        attron(A_REVERSE);
+        mvprintw(height, 0, " %s  [hex]  %lld bytes  %3lld%% ", filename, view.size,
+                 rows > 0 ? (top + height >= rows ? 100 : (top + height) * 100 / rows) : 100);
+        attroff(A_REVERSE);
+        prof_draw_overlay();
+        prof_scope_end(&layout);
+        refresh();
+        prof_frame_end();
+
+        int ch = getch();
+        prof_frame_begin();
+        if (ch == 17)
+        { // Ctrl+Q
+            break;
+        }
+
+        switch (ch)
+        {
+        case KEY_UP:
+            top--;
+            break;
+        case KEY_DOWN:
+            top++;
+            break;
+        case KEY_PPAGE:
+            top -= height;
+            break;
+        case KEY_NPAGE:
+            top += height;
+            break;
+        case KEY_HOME:
+            top = 0;
+            break;
+        case KEY_END:
+            top = max_top;
+            break;
+        case KEY_F(12):
+            prof_toggle_overlay();
+            break;
+        }
+    }
+
+    hex_view_close(&view);
+    return 0;
+}
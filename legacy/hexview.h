@@ -0,0 +1,7 @@
+#ifndef HEXVIEW_H
+#define HEXVIEW_H
+
+int isBinaryFile(const char *filename);
+int runHexView(const char *filename);
+
+#endif // HEXVIEW_H
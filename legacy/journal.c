@@ -0,0 +1,647 @@
+#include "journal.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC 0x4e524a51 // "QJRN"
+#define JOURNAL_VERSION 2
+#define JOURNAL_INSERT 1
+#define JOURNAL_DELETE 2
+#define JOURNAL_BATCH 3  // pos holds how many splices make up the batch
+#define JOURNAL_SPLICE 4 // followed by a JournalSpliceSize and the inserted bytes
+
+// How long the writer lets records gather after the first one arrives
+#define JOURNAL_COMMIT_DELAY_US 5000
+
+// Identifies the on-disk file the records apply to
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t size;
+    int64_t mtime;
+} JournalHeader;
+
+typedef struct
+{
+    uint32_t pos;
+    uint8_t op;
+    uint8_t ch;
+    uint16_t check; // catches a torn or garbage tail after a crash
+} JournalRecord;
+
+// Second record of a splice; the inserted bytes follow, padded to whole records
+typedef struct
+{
+    uint32_t removed;
+    uint32_t length;
+} JournalSpliceSize;
+
+struct Journal
+{
+    int fd;
+    char path[PATH_MAX];
+    char filename[PATH_MAX];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    int stopping;
+
+    // Records queued by the editor, swapped with the writer's batch
+    JournalRecord *pending;
+    int pendingCount;
+    int pendingCapacity;
+    JournalRecord *batch;
+    int batchCapacity;
+    int writing;
+    int failed; // a record didn't fit or a write failed; logging stops until the next save
+};
+
+static void journalPath(const char *filename, char *path, size_t size)
+{
+    const char *slash = strrchr(filename, '/');
+    if (slash == NULL)
+    {
+        snprintf(path, size, ".%s.qswp", filename);
+    }
+    else
+    {
+        snprintf(path, size, "%.*s/.%s.qswp", (int)(slash - filename), filename, slash + 1);
+    }
+}
+
+static uint16_t recordCheck(uint32_t pos, uint8_t op, uint8_t ch)
+{
+    uint32_t hash = (pos * 2654435761u) ^ ((uint32_t)op << 8 | ch) ^ 0xa5a5;
+    return (uint16_t)(hash ^ hash >> 16);
+}
+
+static uint16_t spliceCheck(uint32_t pos, uint32_t removed, uint32_t length)
+{
+    return recordCheck(pos ^ removed * 2246822519u ^ length * 3266489917u, JOURNAL_SPLICE, 0);
+}
+
+// Records taking up a splice, its payload included
+static long long spliceRecords(long long length)
+{
+    return 2 + (length + sizeof(JournalRecord) - 1) / sizeof(JournalRecord);
+}
+
+static int fileIdentity(const char *filename, JournalHeader *header)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+    {
+        return -1;
+    }
+    header->magic = JOURNAL_MAGIC;
+    header->version = JOURNAL_VERSION;
+    header->size = st.st_size;
+    header->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int writeAll(int fd, const void *data, size_t length)
+{
+    const char *p = data;
+    while (length > 0)
+    {
+        ssize_t n = write(fd, p, length);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int writeHeader(Journal *journal)
+{
+    JournalHeader header;
+    if (fileIdentity(journal->filename, &header) != 0 || ftruncate(journal->fd, 0) != 0)
+    {
+        return -1;
+    }
+    if (writeAll(journal->fd, &header, sizeof(header)) != 0)
+    {
+        return -1;
+    }
+    return fdatasync(journal->fd);
+}
+
+// Group commit: the writer wakes on the first record, lets a burst of
+// typing gather, then sends the lot with one write and one fdatasync
+static void *journalWriter(void *arg)
+{
+    Journal *journal = arg;
+    pthread_mutex_lock(&journal->lock);
+    while (1)
+    {
+        while (journal->pendingCount == 0 && !journal->stopping)
+        {
+            pthread_cond_wait(&journal->wake, &journal->lock);
+        }
+        if (journal->pendingCount == 0)
+        {
+            break;
+        }
+        if (!journal->stopping)
+        {
+            pthread_mutex_unlock(&journal->lock);
+            usleep(JOURNAL_COMMIT_DELAY_US);
+            pthread_mutex_lock(&journal->lock);
+            if (journal->pendingCount == 0)
+            {
+                continue;
+            }
+        }
+
+        JournalRecord *records = journal->pending;
+        int count = journal->pendingCount;
+        int capacity = journal->pendingCapacity;
+        journal->pending = journal->batch;
+        journal->pendingCapacity = journal->batchCapacity;
+        journal->pendingCount = 0;
+        journal->batch = records;
+        journal->batchCapacity = capacity;
+        journal->writing = 1;
+        pthread_mutex_unlock(&journal->lock);
+
+        // A batch that didn't reach the disk stops the journal, as running
+        // out of memory does; the records before it still replay
+        int status = journal->failed ? -1 : writeAll(journal->fd, records, count * sizeof(JournalRecord));
+        if (status == 0)
+        {
+            status = fdatasync(journal->fd);
+        }
+
+        pthread_mutex_lock(&journal->lock);
+        if (status != 0)
+        {
+            journal->failed = 1;
+        }
+        journal->writing = 0;
+        pthread_cond_broadcast(&journal->idle);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+// Short of memory the journal stops: what it holds is still a valid prefix
+// of the session, which is better than one with an edit missing
+static int reservePending(Journal *journal, long long count)
+{
+    if (journal->failed)
+    {
+        return -1;
+    }
+    if (journal->pendingCount + count <= journal->pendingCapacity)
+    {
+        return 0;
+    }
+    if (journal->pendingCount + count > INT_MAX / 2)
+    {
+        journal->failed = 1;
+        return -1;
+    }
+    int capacity = journal->pendingCapacity;
+    while (journal->pendingCount + count > capacity)
+    {
+        capacity = capacity ? capacity * 2 : 256;
+    }
+    JournalRecord *pending = alloc_realloc(ALLOC_TEXT, journal->pending, capacity * sizeof(JournalRecord));
+    if (pending == NULL)
+    {
+        journal->failed = 1;
+        return -1;
+    }
+    journal->pending = pending;
+    journal->pendingCapacity = capacity;
+    return 0;
+}
+
+static void appendRecord(Journal *journal, uint8_t op, int pos, char ch)
+{
+    JournalRecord record = {(uint32_t)pos, op, (uint8_t)ch, recordCheck((uint32_t)pos, op, (uint8_t)ch)};
+    journal->pending[journal->pendingCount++] = record;
+}
+
+static void queueRecord(Journal *journal, uint8_t op, int pos, char ch)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    if (reservePending(journal, 1) != 0)
+    {
+        pthread_mutex_unlock(&journal->lock);
+        return;
+    }
+    appendRecord(journal, op, pos, ch);
+    if (journal->pendingCount == 1)
+    {
+        pthread_cond_signal(&journal->wake);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+void journalInsert(Journal *journal, int pos, char ch)
+{
+    queueRecord(journal, JOURNAL_INSERT, pos, ch);
+}
+
+void journalDelete(Journal *journal, int pos, char ch)
+{
+    queueRecord(journal, JOURNAL_DELETE, pos, ch);
+}
+
+// A batch is logged as a count record followed by one splice record per
+// splice, each carrying the bytes it inserts. Offsets are those of the text
+// before the batch, and removed bytes need no copy since replay starts from
+// the original file.
+void journalSplices(Journal *journal, const BufferSplice *splices, int count)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+
+    long long records = 1;
+    for (int i = 0; i < count; i++)
+    {
+        records += spliceRecords(splices[i].length);
+    }
+    pthread_mutex_lock(&journal->lock);
+    if (reservePending(journal, records) != 0)
+    {
+        pthread_mutex_unlock(&journal->lock);
+        return;
+    }
+    int wake = journal->pendingCount == 0;
+    appendRecord(journal, JOURNAL_BATCH, count, 0);
+    for (int i = 0; i < count; i++)
+    {
+        const BufferSplice *splice = &splices[i];
+        JournalRecord *record = &journal->pending[journal->pendingCount];
+        long long used = spliceRecords(splice->length);
+        JournalSpliceSize size = {(uint32_t)splice->removed, (uint32_t)splice->length};
+        *record = (JournalRecord){(uint32_t)splice->pos, JOURNAL_SPLICE, 0,
+                                  spliceCheck(splice->pos, splice->removed, splice->length)};
+        memcpy(record + 1, &size, sizeof(size));
+
+        // The padding is zeroed so no stale memory ends up on disk
+        if (used > 2)
+        {
+            memset(record + used - 1, 0, sizeof(JournalRecord));
+        }
+        memcpy(record + 2, splice->text, splice->length);
+        journal->pendingCount += used;
+    }
+    if (wake)
+    {
+        pthread_cond_signal(&journal->wake);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+static int validRecord(const JournalRecord *record, uint8_t op)
+{
+    return record->op == op && record->check == recordCheck(record->pos, record->op, record->ch);
+}
+
+// Rebuilds the text through a whole batch of splices in one pass and
+// returns the records it took up. A batch cut short by a crash, or one that
+// doesn't fit the text, is not applied at all.
+static long long replayBatch(Buffer *buffer, const JournalRecord *records, long long available, int splices)
+{
+    long long size = buffer->size;
+    long long used = 0;
+    long long from = 0;
+    for (int i = 0; i < splices; i++)
+    {
+        const JournalRecord *record = &records[used];
+        JournalSpliceSize splice;
+        if (available - used < 2)
+        {
+            return -1;
+        }
+        memcpy(&splice, record + 1, sizeof(splice));
+        if (record->op != JOURNAL_SPLICE || record->check != spliceCheck(record->pos, splice.removed, splice.length) ||
+            record->pos < from || record->pos + (long long)splice.removed > buffer->size ||
+            spliceRecords(splice.length) > available - used)
+        {
+            return -1;
+        }
+        from = record->pos + (long long)splice.removed;
+        size += (long long)splice.length - splice.removed;
+        used += spliceRecords(splice.length);
+    }
+    if (size >= INT_MAX)
+    {
+        return -1;
+    }
+
+    int capacity = size + 1 > INITIAL_BUFFER_SIZE ? size + 1 : INITIAL_BUFFER_SIZE;
+    char *content = alloc_malloc(ALLOC_TEXT, capacity);
+    if (content == NULL)
+    {
+        return -1;
+    }
+    char *out = content;
+    const JournalRecord *record = records;
+    from = 0;
+    for (int i = 0; i < splices; i++)
+    {
+        JournalSpliceSize splice;
+        memcpy(&splice, record + 1, sizeof(splice));
+        memcpy(out, buffer->content + from, record->pos - from);
+        out += record->pos - from;
+        memcpy(out, record + 2, splice.length);
+        out += splice.length;
+        from = record->pos + (long long)splice.removed;
+        record += spliceRecords(splice.length);
+    }
+    memcpy(out, buffer->content + from, buffer->size - from + 1);
+
+    alloc_free(buffer->content);
+    buffer->content = content;
+    buffer->capacity = capacity;
+    buffer->size = size;
+    return used;
+}
+
+// Applies the records straight to the content. Typed text and backspace or
+// delete runs each become a single memmove; stops at the first record that
+// is damaged or doesn't fit, which is where a crash cut the journal off.
+// Returns the records applied and counts the edits they made.
+static int replayRecords(Buffer *buffer, const JournalRecord *records, int count, int *edits)
+{
+    int applied = 0;
+    *edits = 0;
+    while (applied < count)
+    {
+        const JournalRecord *first = &records[applied];
+        int pos = first->pos;
+        int run = 1;
+        if (validRecord(first, JOURNAL_BATCH))
+        {
+            long long used = replayBatch(buffer, first + 1, count - applied - 1, pos);
+            if (used < 0)
+            {
+                break;
+            }
+            run += used;
+            *edits += 1;
+            applied += run;
+            continue;
+        }
+        else if (validRecord(first, JOURNAL_INSERT) && pos <= buffer->size)
+        {
+            while (applied + run < count && validRecord(&records[applied + run], JOURNAL_INSERT) &&
+                   (int)records[applied + run].pos == pos + run)
+            {
+                run++;
+            }
+            if (reserveBuffer(buffer, buffer->size + run + 1) != 0)
+            {
+                break;
+            }
+            memmove(buffer->content + pos + run, buffer->content + pos, buffer->size - pos + 1);
+            for (int i = 0; i < run; i++)
+            {
+                buffer->content[pos + i] = records[applied + i].ch;
+            }
+            buffer->size += run;
+        }
+        else if (validRecord(first, JOURNAL_DELETE) && pos < buffer->size)
+        {
+            // Forward deletes repeat one position, backspaces step down
+            int step = 0;
+            if (applied + 1 < count && (int)records[applied + 1].pos == pos - 1)
+            {
+                step = -1;
+            }
+            while (applied + run < count && validRecord(&records[applied + run], JOURNAL_DELETE) &&
+                   (int)records[applied + run].pos == pos + step * run && pos + step * run >= 0 &&
+                   (step != 0 || pos + run < buffer->size))
+            {
+                run++;
+            }
+            int low = step == 0 ? pos : pos - run + 1;
+            memmove(buffer->content + low, buffer->content + low + run, buffer->size - low - run + 1);
+            buffer->size -= run;
+        }
+        else
+        {
+            break;
+        }
+        applied += run;
+        *edits += run;
+    }
+    return applied;
+}
+
+int recoverJournal(Buffer *buffer, const char *filename, int *kept)
+{
+    *kept = 0;
+    char path[PATH_MAX];
+    journalPath(filename, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    // A journal still locked belongs to a running instance
+    JournalHeader header;
+    JournalHeader current;
+    struct stat st;
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0 || fstat(fd, &st) != 0 ||
+        read(fd, &header, sizeof(header)) != sizeof(header) || header.magic != JOURNAL_MAGIC)
+    {
+        close(fd);
+        return 0;
+    }
+    // A journal for other contents, or from another version, can't be
+    // replayed, but it is the only copy of those edits, so it is moved
+    // aside rather than overwritten
+    if (header.version != JOURNAL_VERSION || fileIdentity(filename, &current) != 0 ||
+        current.size != header.size || current.mtime != header.mtime)
+    {
+        close(fd);
+        char stale[PATH_MAX + 2];
+        snprintf(stale, sizeof(stale), "%s.1", path);
+        return rename(path, stale) == 0 ? -1 : -2;
+    }
+
+    int count = (st.st_size - sizeof(header)) / sizeof(JournalRecord);
+    if (count == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    JournalRecord *records = alloc_malloc(ALLOC_TEXT, count * sizeof(JournalRecord));
+    if (records == NULL || read(fd, records, count * sizeof(JournalRecord)) != (ssize_t)(count * sizeof(JournalRecord)))
+    {
+        alloc_free(records);
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    // The original is mapped, copied once and the records replayed over it
+    int file_fd = open(filename, O_RDONLY);
+    if (file_fd < 0 || reserveBuffer(buffer, header.size + 1) != 0)
+    {
+        if (file_fd >= 0)
+        {
+            close(file_fd);
+        }
+        alloc_free(records);
+        return 0;
+    }
+    if (header.size > 0)
+    {
+        void *original = mmap(NULL, header.size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+        if (original == MAP_FAILED)
+        {
+            close(file_fd);
+            alloc_free(records);
+            return 0;
+        }
+        memcpy(buffer->content, original, header.size);
+        munmap(original, header.size);
+    }
+    close(file_fd);
+    buffer->size = header.size;
+    buffer->content[buffer->size] = '\0';
+
+    int edits;
+    *kept = replayRecords(buffer, records, count, &edits);
+    alloc_free(records);
+    line_index_build(&buffer->lines, buffer->content, buffer->size);
+    line_hashes_reset(&buffer->hashes);
+    bracket_index_reset(&buffer->brackets);
+    minimap_reset(&buffer->minimap);
+    buffer->modified = edits > 0;
+    return edits;
+}
+
+Journal *openJournal(const char *filename, int keep)
+{
+    Journal *journal = alloc_calloc(ALLOC_TEXT, 1, sizeof(Journal));
+    if (journal == NULL)
+    {
+        return NULL;
+    }
+    snprintf(journal->filename, sizeof(journal->filename), "%s", filename);
+    journalPath(filename, journal->path, sizeof(journal->path));
+
+    journal->fd = open(journal->path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (journal->fd < 0 || flock(journal->fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        if (journal->fd >= 0)
+        {
+            close(journal->fd);
+        }
+        alloc_free(journal);
+        return NULL;
+    }
+
+    // A recovered journal keeps its records, minus any torn tail
+    int status = keep > 0 ? ftruncate(journal->fd, sizeof(JournalHeader) + keep * sizeof(JournalRecord))
+                          : writeHeader(journal);
+    if (status != 0)
+    {
+        close(journal->fd);
+        unlink(journal->path);
+        alloc_free(journal);
+        return NULL;
+    }
+
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->wake, NULL);
+    pthread_cond_init(&journal->idle, NULL);
+    if (pthread_create(&journal->thread, NULL, journalWriter, journal) != 0)
+    {
+        close(journal->fd);
+        unlink(journal->path);
+        alloc_free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+void resetJournal(Journal *journal)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+
+    // Let a batch in flight land before truncating under it
+    pthread_mutex_lock(&journal->lock);
+    journal->pendingCount = 0;
+    journal->failed = 0;
+    while (journal->writing)
+    {
+        pthread_cond_wait(&journal->idle, &journal->lock);
+    }
+    if (writeHeader(journal) != 0)
+    {
+        journal->failed = 1;
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+int journalFailed(Journal *journal)
+{
+    if (journal == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&journal->lock);
+    int failed = journal->failed;
+    pthread_mutex_unlock(&journal->lock);
+    return failed;
+}
+
+void closeJournal(Journal *journal, int keep)
+{
+    if (journal == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    journal->stopping = 1;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->thread, NULL);
+
+    if (!keep)
+    {
+        unlink(journal->path);
+    }
+    close(journal->fd);
+    pthread_mutex_destroy(&journal->lock);
+    pthread_cond_destroy(&journal->wake);
+    pthread_cond_destroy(&journal->idle);
+    alloc_free(journal->pending);
+    alloc_free(journal->batch);
+    alloc_free(journal);
+}
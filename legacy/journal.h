@@ -0,0 +1,39 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "buffer.h"
+
+// Crash-recovery journal kept next to the file as .<name>.qswp. Every edit
+// is appended as a small record by a background writer that syncs whole
+// batches at once, so a keystroke only queues a record in memory.
+typedef struct Journal Journal;
+
+// Rebuilds the buffer from the file on disk plus a journal left behind by a
+// previous session, setting kept to the records to continue after. Returns
+// the number of edits replayed, a batch counting once, 0 when there is
+// no journal to recover and -1 when the file changed since it was written
+// or the journal is from another version; that journal is then moved aside
+// to .<name>.qswp.1, or left in place with -2 when it can't be.
+int recoverJournal(Buffer *buffer, const char *filename, int *kept);
+
+// Starts journaling edits of filename; keep is the count of records from a
+// recovered journal to continue after, 0 starts a fresh one. Returns NULL
+// when the journal can't be created or another instance holds it.
+Journal *openJournal(const char *filename, int keep);
+void journalInsert(Journal *journal, int pos, char ch);
+void journalDelete(Journal *journal, int pos, char ch);
+// Logs a batch of splices before it is applied, to be replayed whole or not
+// at all; only the inserted bytes are copied
+void journalSplices(Journal *journal, const BufferSplice *splices, int count);
+
+// Drops every record once the buffer has been saved
+void resetJournal(Journal *journal);
+
+// Whether edits since the last save may be missing from the journal, after a
+// failed write or running out of memory
+int journalFailed(Journal *journal);
+
+// Flushes and stops the writer; the file is removed unless keep is set
+void closeJournal(Journal *journal, int keep);
+
+#endif // JOURNAL_H
@@ -1,39 +1,380 @@
 #include "buffer.h"
 #include "editor.h"
+#include "replay.h"
+#include "hexview.h"
+#include "follow.h"
+#include "journal.h"
+#include "diffview.h"
+#include "reload.h"
+#include "block.h"
+#include "clipboard.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include "../src/io/io.h"
 #include <stdlib.h>
 #include <ncurses.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    const char *script_path = NULL;
+    int follow = 0;
+    if (argc == 4 && strcmp(argv[1], "--replay") == 0)
     {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+        script_path = argv[2];
+    }
+    else if (argc == 3 && strcmp(argv[1], "--follow") == 0)
+    {
+        follow = 1;
+    }
+    else if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s [--replay <script> | --follow] <filename>\n", argv[0]);
         return 1;
     }
 
+    // QUARK_MEM_BUDGET=text=512M,text_index=64M caps what each part of the
+    // editor may hold; QUARK_MEM_DUMP=<file> gets the memory stats on exit
+    alloc_init(getenv("QUARK_MEM_BUDGET"), getenv("QUARK_MEM_DUMP"));
+
+    // Binaries open in a read-only hex view instead of being loaded
+    if (script_path == NULL && isBinaryFile(argv[argc - 1]))
+    {
+        prof_init(getenv("QUARK_TRACE"));
+        initEditor();
+        int status = runHexView(argv[argc - 1]);
+        cleanupEditor();
+        prof_shutdown();
+        alloc_shutdown();
+        return status;
+    }
+
+    const char *filename = argv[argc - 1];
     Buffer buffer;
-    initBuffer(&buffer);
-    loadFile(&buffer, argv[1]);
+    if (initBuffer(&buffer) != 0)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    // Edits left in a journal by a session that died are replayed over the
+    // file; follow mode and replays never journal
+    int recovered = 0;
+    int kept = 0;
+    if (script_path == NULL && !follow)
+    {
+        recovered = recoverJournal(&buffer, filename, &kept);
+    }
+    if (recovered <= 0)
+    {
+        loadFile(&buffer, filename);
+    }
 
     int ch;
     int cursor_x = 0, cursor_y = 0;
+    Selection selection;
+    int selecting = 0;
+
+    // QUARK_TRACE=<file> dumps a Chrome trace on exit
+    prof_init(getenv("QUARK_TRACE"));
+
+    // Headless: drive the editor from a keystroke script and report latencies
+    if (script_path != NULL)
+    {
+        int status = replaySession(&buffer, script_path);
+        io_shutdown();
+        prof_shutdown();
+        freeBuffer(&buffer);
+        alloc_shutdown();
+        return status;
+    }
+
+    // QUARK_RECORD=<file> captures the session as a replay script
+    startRecording(getenv("QUARK_RECORD"));
+
+    // Follow mode starts pinned to the end of the file, like tail -f
+    if (follow && startFollow(&buffer, argv[2]) != 0)
+    {
+        fprintf(stderr, "Error: Cannot follow '%s'\n", argv[2]);
+        freeBuffer(&buffer);
+        return 1;
+    }
+    if (follow)
+    {
+        cursor_y = lineCount(&buffer) - 1;
+    }
+
+    // A journal that no longer matches the file is kept, never overwritten
+    if (!follow && recovered != -2)
+    {
+        buffer.journal = openJournal(filename, recovered > 0 ? kept : 0);
+    }
+    if (recovered > 0)
+    {
+        char message[64];
+        snprintf(message, sizeof(message), "Recovered %d unsaved edits", recovered);
+        showMessage(message);
+    }
+    else if (recovered == -1)
+    {
+        showMessage("Journal doesn't match the file, its edits were kept in .qswp.1");
+    }
+    else if (recovered == -2)
+    {
+        showMessage("Journal doesn't match the file, left as is and edits unprotected");
+    }
+    int journal_warned = 0;
+
+    // Other programs writing the file are picked up while editing
+    int watching = !follow && startWatch(filename) == 0;
 
     initEditor();
+    if (follow || watching)
+    {
+        nodelay(stdscr, TRUE);
+    }
 
     while (1)
     {
         displayBuffer(&buffer, cursor_x, cursor_y);
+        prof_frame_end();
 
         ch = getch();
+        if (follow && ch == ERR)
+        {
+            // Sleep until a key arrives or the file changes
+            struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { followFd(), POLLIN, 0 } };
+            poll(fds, 2, -1);
+            prof_frame_begin();
+            if (fds[1].revents & POLLIN)
+            {
+                int last_line = lineCount(&buffer) - 1;
+                int pinned = cursor_y >= last_line;
+                int appended = pollFollow(&buffer);
+                last_line = lineCount(&buffer) - 1;
+
+                // Autoscroll only when pinned; a reload just keeps the cursor valid
+                if (pinned)
+                {
+                    cursor_y = last_line;
+                    cursor_x = 0;
+                }
+                else if (appended == FOLLOW_RELOADED && cursor_y > last_line)
+                {
+                    cursor_y = last_line;
+                    cursor_x = 0;
+                }
+            }
+            continue;
+        }
+        if (watching && ch == ERR)
+        {
+            struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { watchFd(), POLLIN, 0 } };
+            poll(fds, 2, -1);
+            prof_frame_begin();
+            // Our own save renaming onto the file is still the original
+            if ((fds[1].revents & POLLIN) && pollWatch() && !originalMatchesFile(&buffer, filename))
+            {
+                // Unsaved edits win; a clean buffer takes the new contents
+                if (buffer.modified)
+                {
+                    showMessage("File changed on disk");
+                }
+                else
+                {
+                    int changed = reloadBuffer(&buffer, filename, &cursor_x, &cursor_y);
+                    if (changed > 0)
+                    {
+                        char message[64];
+                        snprintf(message, sizeof(message), "Reloaded, %d lines changed", changed);
+                        showMessage(message);
+                    }
+                }
+            }
+            continue;
+        }
+        prof_frame_begin();
+        recordKey(ch);
+        showMessage(NULL);
+        if (!journal_warned && journalFailed(buffer.journal))
+        {
+            journal_warned = 1;
+            showMessage("Journal write failed, edits are unprotected until saved");
+        }
         if (ch == 17)
         { // Ctrl+Q
             break;
         }
+        if (ch == 19 && !follow)
+        { // Ctrl+S saves; the journal starts over from the saved file
+            if (saveBuffer(&buffer, filename) == 0)
+            {
+                resetJournal(buffer.journal);
+                journal_warned = 0;
+                showMessage("Saved");
+            }
+            else
+            {
+                showMessage("Save failed");
+            }
+            continue;
+        }
+        if (ch == KEY_F(5) && !follow)
+        { // F5 compares the buffer with the saved file
+            runDiffView(&buffer, filename);
+            redrawEditor();
+            continue;
+        }
+        if ((ch == KEY_F(6) || ch == KEY_F(7)) && !follow)
+        { // F6 anchors a selection at the cursor, F7 a block one; again drops it
+            selecting = !selecting;
+            SelectionMode mode = ch == KEY_F(7) ? SELECTION_BLOCK : SELECTION_LINEAR;
+            selection = (Selection){{cursor_x, cursor_y}, {cursor_x, cursor_y}, mode};
+            setSelection(selecting ? &selection : NULL);
+            continue;
+        }
+        if (selecting && (ch == 3 || ch == 24))
+        { // Ctrl+C copies the selection, Ctrl+X cuts it; both also go to the
+          // terminal's clipboard
+            Clip *clip = copySelection(&buffer, &selection);
+            if (clip == NULL)
+            {
+                showMessage("Out of memory");
+                continue;
+            }
+            char message[64];
+            int exported = exportClip(clip);
+            snprintf(message, sizeof(message), "%s %lld bytes%s", ch == 3 ? "Copied" : "Cut", clip->length,
+                     exported == 0 ? "" : ", too large for the system clipboard");
+            showMessage(message);
+            pushClip(clip);
+            if (ch == 24 && deleteSelection(&buffer, &selection, &cursor_x, &cursor_y) != 0)
+            {
+                showMessage("Out of memory");
+            }
+            else if (ch == 24)
+            {
+                selecting = 0;
+                setSelection(NULL);
+            }
+            continue;
+        }
+        if (ch == 22 && !follow && currentClip() != NULL)
+        { // Ctrl+V pastes the selected copy at the cursor
+            int status = pasteClip(&buffer, currentClip(), &cursor_x, &cursor_y);
+            if (status != 0)
+            {
+                showMessage(status == -1 ? "Copied text changed on disk" : "Out of memory");
+            }
+            continue;
+        }
+        if (ch == 16 && !follow)
+        { // Ctrl+P steps Ctrl+V back through earlier copies
+            char message[64];
+            int count;
+            int index = cycleClips(&count);
+            snprintf(message, sizeof(message), "Clipboard %d/%d", count > 0 ? index + 1 : 0, count);
+            showMessage(message);
+            continue;
+        }
+        if (ch == 6)
+        { // Ctrl+F searches; the ruler marks every match and F3 goes to the
+          // next one. An empty search clears them.
+            char pattern[64];
+            int length = promptInput("Find: ", pattern, sizeof(pattern));
+            if (length >= 0)
+            {
+                minimap_set_pattern(&buffer.minimap, buffer.content, buffer.size, pattern, length);
+            }
+            if (length > 0)
+            {
+                char message[64];
+                int hits = minimap_hits(&buffer.minimap, buffer.content, buffer.size);
+                snprintf(message, sizeof(message), "%d matches", hits);
+                showMessage(findNext(&buffer, &cursor_x, &cursor_y) ? message : "Not found");
+            }
+            continue;
+        }
+        if (ch == 7)
+        { // Ctrl+G goes to a line, a percentage of the file or a byte offset
+            char target[32];
+            if (promptInput("Go to line, N% or @byte: ", target, sizeof(target)) > 0 &&
+                goToTarget(&buffer, target, &cursor_x, &cursor_y) != 0)
+            {
+                showMessage("Not a line, percentage or @offset");
+            }
+            continue;
+        }
+        if (ch == KEY_F(3))
+        {
+            if (!findNext(&buffer, &cursor_x, &cursor_y))
+            {
+                showMessage("Not found");
+            }
+            continue;
+        }
+        if (selecting && selection.mode == SELECTION_BLOCK && ch >= 32 && ch <= 126)
+        { // Typing into a block inserts the character on every line of it
+            char text = ch;
+            if (insertBlock(&buffer, &selection, &text, 1) != 0)
+            {
+                showMessage("Out of memory");
+                continue;
+            }
+            selection.start.x++;
+            selection.end.x++;
+            cursor_x = MIN(selection.end.x, lineLength(&buffer, cursor_y));
+            continue;
+        }
+        if (selecting && ch == 27)
+        { // Esc drops the selection
+            selecting = 0;
+            setSelection(NULL);
+            continue;
+        }
+        if (ch == KEY_F(12))
+        { // F12 toggles the profiler overlay
+            prof_toggle_overlay();
+            continue;
+        }
+        if (ch == KEY_F(11))
+        { // F11 toggles the memory panel
+            alloc_toggle_panel();
+            continue;
+        }
+        if (ch == KEY_F(8))
+        { // F8 dumps the memory stats to QUARK_MEM_DUMP, or to stderr on exit
+            int dumped = alloc_dump_now();
+            if (dumped < 0)
+            {
+                showMessage("Couldn't write memory stats");
+            }
+            else
+            {
+                showMessage(dumped > 0 ? "Memory stats written" : "Memory stats will be printed on exit");
+            }
+            continue;
+        }
 
         handleInput(&buffer, ch, &cursor_x, &cursor_y);
+        if (selecting)
+        {
+            selection.end = (Cursor){cursor_x, cursor_y};
+        }
     }
 
     cleanupEditor();
-    free(buffer.content);
+    closeJournal(buffer.journal, 0);
+    stopFollow();
+    stopWatch();
+    clearClips();
+    stopRecording();
+    io_shutdown();
+    prof_shutdown();
+    freeBuffer(&buffer);
+    alloc_shutdown();
     return 0;
 }
\ No newline at end of file
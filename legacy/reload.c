@@ -0,0 +1,229 @@
+#include "reload.h"
+#include "editor.h"
+#include "journal.h"
+#include "../src/editor/diff.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include "../src/io/io.h"
+#include <sys/inotify.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Past this many hunks one copy of the new text beats a memmove per hunk
+#define RELOAD_PATCH_HUNKS 32
+
+static int notify_fd = -1;
+static int dir_watch = -1;
+static char file_name[NAME_MAX + 1];
+
+// Watching the directory catches both writers that rewrite the file in
+// place and ones that rename a temporary over it, the way saveBuffer does
+int startWatch(const char *filename)
+{
+    char path[PATH_MAX];
+    if (realpath(filename, path) == NULL)
+    {
+        return -1;
+    }
+    char name_path[PATH_MAX];
+    strcpy(name_path, path);
+    snprintf(file_name, sizeof(file_name), "%s", basename(name_path));
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0)
+    {
+        return -1;
+    }
+    dir_watch = inotify_add_watch(notify_fd, dirname(path), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (dir_watch < 0)
+    {
+        stopWatch();
+        return -1;
+    }
+    return 0;
+}
+
+int watchFd(void)
+{
+    return notify_fd;
+}
+
+int pollWatch(void)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t length;
+    while ((length = read(notify_fd, events, sizeof(events))) > 0)
+    {
+        for (char *p = events; p < events + length;)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, file_name) == 0)
+            {
+                changed = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+void stopWatch(void)
+{
+    if (notify_fd >= 0)
+    {
+        close(notify_fd);
+    }
+    notify_fd = -1;
+    dir_watch = -1;
+}
+
+// Lines before a hunk keep their number, lines after it shift by its size,
+// and a line inside one lands on the matching line of the replacement
+static int mapLine(const DiffResult *diff, int line)
+{
+    int shift = 0;
+    for (int h = 0; h < diff->count; h++)
+    {
+        const DiffHunk *hunk = &diff->hunks[h];
+        if (line < hunk->old_start)
+        {
+            break;
+        }
+        if (line < hunk->old_start + hunk->old_count)
+        {
+            return hunk->new_start + MIN(line - hunk->old_start, MAX(hunk->new_count - 1, 0));
+        }
+        shift = hunk->new_start + hunk->new_count - hunk->old_start - hunk->old_count;
+    }
+    return line + shift;
+}
+
+// Replaces each hunk's bytes from the back, so earlier offsets stay put.
+// The room for the largest text is reserved first, so once started the
+// patch can't run out of memory part way.
+static int patchHunks(Buffer *buffer, const DiffResult *diff, const char *content, long long size, LineIndex *lines)
+{
+    int *ranges = alloc_malloc(ALLOC_TEXT, diff->count * 2 * sizeof(int));
+    if (ranges == NULL)
+    {
+        return -1;
+    }
+    for (int h = 0; h < diff->count; h++)
+    {
+        const DiffHunk *hunk = &diff->hunks[h];
+        ranges[h * 2] = lineStart(buffer, hunk->old_start);
+        ranges[h * 2 + 1] = lineStart(buffer, hunk->old_start + hunk->old_count);
+    }
+
+    int largest = buffer->size;
+    for (int h = 0; h < diff->count; h++)
+    {
+        const DiffHunk *hunk = &diff->hunks[h];
+        int new_length = line_index_start(lines, content, size, hunk->new_start + hunk->new_count) -
+                         line_index_start(lines, content, size, hunk->new_start);
+        largest += MAX(0, new_length - (ranges[h * 2 + 1] - ranges[h * 2]));
+    }
+    if (reserveBuffer(buffer, MAX(largest, (int)size) + 1) != 0)
+    {
+        alloc_free(ranges);
+        return -1;
+    }
+    for (int h = diff->count - 1; h >= 0; h--)
+    {
+        const DiffHunk *hunk = &diff->hunks[h];
+        int old_start = ranges[h * 2];
+        int old_end = ranges[h * 2 + 1];
+        int new_start = line_index_start(lines, content, size, hunk->new_start);
+        int new_end = line_index_start(lines, content, size, hunk->new_start + hunk->new_count);
+        int grow = (new_end - new_start) - (old_end - old_start);
+        memmove(buffer->content + old_end + grow, buffer->content + old_end, buffer->size - old_end + 1);
+        memcpy(buffer->content + old_start, content + new_start, new_end - new_start);
+        buffer->size += grow;
+    }
+    alloc_free(ranges);
+    return 0;
+}
+
+int reloadBuffer(Buffer *buffer, const char *filename, int *cursor_x, int *cursor_y)
+{
+    PROF_SCOPE(PROF_BUFFER);
+
+    long long size = 0;
+    char *content = io_read_file(io_default_queue(), ALLOC_TEXT, filename, &size);
+    if (content == NULL)
+    {
+        return -1;
+    }
+    LineIndex lines;
+    if (line_index_init(&lines) != 0)
+    {
+        alloc_free(content);
+        return -1;
+    }
+    line_index_build(&lines, content, size);
+    uint64_t *hashes = alloc_malloc(ALLOC_TEXT_INDEX, lines.count * sizeof(uint64_t));
+    for (int i = 0; hashes != NULL && i < lines.count; i++)
+    {
+        hashes[i] = line_hash_at(&lines, content, size, i);
+    }
+
+    // Only lines edited since the last comparison are rehashed on our side.
+    // Short of memory anywhere the buffer is left as it was.
+    int first;
+    DiffResult diff = { 0 };
+    int changed = -1;
+    if (hashes != NULL && line_hashes_sync(&buffer->hashes, &buffer->lines, buffer->content, buffer->size, &first) >= 0 &&
+        diff_lines(buffer->hashes.hashes, buffer->hashes.count, hashes, lines.count, NULL, &diff) == 0)
+    {
+        int patched = 0;
+        if (diff.count > 0 && diff.count <= RELOAD_PATCH_HUNKS)
+        {
+            patched = patchHunks(buffer, &diff, content, size, &lines);
+        }
+        else if (diff.count > 0 && (patched = reserveBuffer(buffer, size + 1)) == 0)
+        {
+            memcpy(buffer->content, content, size + 1);
+            buffer->size = size;
+        }
+        if (patched == 0)
+        {
+            changed = 0;
+            for (int h = 0; h < diff.count; h++)
+            {
+                changed += MAX(diff.hunks[h].old_count, diff.hunks[h].new_count);
+            }
+        }
+        if (diff.count > 0 && patched == 0)
+        {
+            *cursor_y = mapLine(&diff, *cursor_y);
+
+            // The new text's index and hashes are already exact
+            line_index_free(&buffer->lines);
+            buffer->lines = lines;
+            line_index_init(&lines);
+            line_hashes_assign(&buffer->hashes, hashes, buffer->lines.count);
+            bracket_index_reset(&buffer->brackets);
+            minimap_reset(&buffer->minimap);
+        }
+    }
+    diff_free(&diff);
+    line_index_free(&lines);
+    alloc_free(hashes);
+    alloc_free(content);
+
+    if (changed >= 0)
+    {
+        *cursor_y = MIN(*cursor_y, lineCount(buffer) - 1);
+        int length = lineLength(buffer, *cursor_y);
+        *cursor_x = MIN(*cursor_x, length);
+        buffer->modified = 0;
+        resetOriginal(buffer, filename);
+        // The journal describes edits to the old text
+        resetJournal(buffer->journal);
+    }
+    return changed;
+}
@@ -0,0 +1,18 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "buffer.h"
+
+// Watches the directory of the edited file for writes and renames onto it
+int startWatch(const char *filename);
+int watchFd(void);
+// Drains pending events; returns 1 when the file was rewritten or replaced
+int pollWatch(void);
+void stopWatch(void);
+
+// Re-reads the file and patches only the lines that differ from the buffer,
+// moving the cursor along with its line. Returns the number of changed
+// lines, or -1 when the file can't be read.
+int reloadBuffer(Buffer *buffer, const char *filename, int *cursor_x, int *cursor_y);
+
+#endif // RELOAD_H
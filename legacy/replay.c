@@ -0,0 +1,245 @@
+#include "replay.h"
+#include "editor.h"
+#include "../src/profiler/profiler.h"
+#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_SCRIPT_LINE 256
+#define KEY_KINDS 16
+#define OTHER_KIND (KEY_KINDS - 1)
+
+typedef struct
+{
+    const char *name;
+    int code;
+} KeyName;
+
+static const KeyName key_names[] = {
+    {"KEY_UP", KEY_UP},
+    {"KEY_DOWN", KEY_DOWN},
+    {"KEY_LEFT", KEY_LEFT},
+    {"KEY_RIGHT", KEY_RIGHT},
+    {"KEY_HOME", KEY_HOME},
+    {"KEY_END", KEY_END},
+    {"KEY_PPAGE", KEY_PPAGE},
+    {"KEY_NPAGE", KEY_NPAGE},
+    {"KEY_BACKSPACE", KEY_BACKSPACE},
+    {"KEY_DC", KEY_DC},
+    {"KEY_ENTER", KEY_ENTER},
+    {"KEY_F12", KEY_F(12)},
+    {"CTRL_HOME", 535},
+    {"CTRL_END", 530},
+    {"ENTER", '\n'},
+    {"TAB", '\t'},
+    {"SPACE", ' '},
+    {"CTRL_Q", 17},
+};
+
+static FILE *record_file = NULL;
+
+static const char *keyName(int ch)
+{
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++)
+    {
+        if (key_names[i].code == ch)
+        {
+            return key_names[i].name;
+        }
+    }
+    return NULL;
+}
+
+// Parses "KEY_DOWN", "a", "#27" or "KEY_DOWN*100"; returns the repeat count
+static int parseEvent(char *line, int *ch)
+{
+    int repeat = 1;
+    char *star = strrchr(line, '*');
+    if (star != NULL && star != line && isdigit((unsigned char)star[1]))
+    {
+        *star = '\0';
+        repeat = atoi(star + 1);
+    }
+
+    if (line[0] == '#' && isdigit((unsigned char)line[1]))
+    {
+        *ch = atoi(line + 1);
+        return repeat;
+    }
+    if (line[0] != '\0' && line[1] == '\0')
+    {
+        *ch = (unsigned char)line[0];
+        return repeat;
+    }
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(key_names[0]); i++)
+    {
+        if (strcmp(line, key_names[i].name) == 0)
+        {
+            *ch = key_names[i].code;
+            return repeat;
+        }
+    }
+    return 0;
+}
+
+void startRecording(const char *record_path)
+{
+    if (record_path != NULL && record_path[0] != '\0')
+    {
+        record_file = fopen(record_path, "w");
+    }
+}
+
+void recordKey(int ch)
+{
+    if (record_file == NULL)
+    {
+        return;
+    }
+
+    const char *name = keyName(ch);
+    if (name != NULL)
+    {
+        fprintf(record_file, "%s\n", name);
+    }
+    else if (ch > ' ' && ch <= '~' && ch != '#')
+    {
+        fprintf(record_file, "%c\n", ch);
+    }
+    else
+    {
+        fprintf(record_file, "#%d\n", ch);
+    }
+}
+
+void stopRecording(void)
+{
+    if (record_file != NULL)
+    {
+        fclose(record_file);
+        record_file = NULL;
+    }
+}
+
+int replaySession(Buffer *buffer, const char *script_path)
+{
+    FILE *script = fopen(script_path, "r");
+    if (script == NULL)
+    {
+        fprintf(stderr, "Error: Could not open script '%s'\n", script_path);
+        return 1;
+    }
+
+    // Virtual terminal with no tty; size comes from LINES/COLUMNS or terminfo
+    FILE *screen_out = fopen("/dev/null", "w");
+    FILE *screen_in = fopen("/dev/null", "r");
+    SCREEN *screen = newterm(getenv("TERM") ? getenv("TERM") : "xterm", screen_out, screen_in);
+    if (screen == NULL)
+    {
+        screen = newterm("xterm", screen_out, screen_in);
+    }
+    if (screen == NULL)
+    {
+        fprintf(stderr, "Error: Could not create virtual terminal\n");
+        fclose(script);
+        return 1;
+    }
+    set_term(screen);
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+
+    ProfHistogram all = {0};
+    ProfHistogram kinds[KEY_KINDS];
+    memset(kinds, 0, sizeof(kinds));
+    const char *kind_names[KEY_KINDS] = {0};
+    int kind_count = 0;
+
+    int cursor_x = 0, cursor_y = 0;
+    int done = 0;
+    displayBuffer(buffer, cursor_x, cursor_y);
+
+    char line[MAX_SCRIPT_LINE];
+    while (!done && fgets(line, sizeof(line), script))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || (line[0] == '#' && !isdigit((unsigned char)line[1])))
+        {
+            continue;
+        }
+
+        int ch = 0;
+        int repeat = parseEvent(line, &ch);
+        if (repeat == 0)
+        {
+            fprintf(stderr, "Warning: Unknown event '%s'\n", line);
+            continue;
+        }
+
+        // Events are grouped by key name, printable keys share one bucket.
+        // The last bucket is kept for unnamed keys and whatever doesn't fit.
+        const char *kind = keyName(ch);
+        if (kind == NULL && ch >= 32 && ch <= 126)
+        {
+            kind = "printable";
+        }
+        int k = 0;
+        while (kind != NULL && k < kind_count && strcmp(kind_names[k], kind) != 0)
+        {
+            k++;
+        }
+        if (kind == NULL || k == OTHER_KIND)
+        {
+            k = OTHER_KIND;
+        }
+        else if (k == kind_count)
+        {
+            kind_names[kind_count++] = kind;
+        }
+
+        for (int i = 0; i < repeat; i++)
+        {
+            if (ch == 17)
+            {
+                done = 1;
+                break;
+            }
+
+            uint64_t start = prof_now_ns();
+            prof_frame_begin();
+            if (ch == KEY_F(12))
+            {
+                prof_toggle_overlay();
+            }
+            else
+            {
+                handleInput(buffer, ch, &cursor_x, &cursor_y);
+            }
+            displayBuffer(buffer, cursor_x, cursor_y);
+            prof_frame_end();
+
+            uint64_t elapsed = prof_now_ns() - start;
+            prof_histogram_add(&all, elapsed);
+            prof_histogram_add(&kinds[k], elapsed);
+        }
+    }
+    fclose(script);
+
+    endwin();
+    delscreen(screen);
+    fclose(screen_out);
+    fclose(screen_in);
+
+    printf("replay: %s\n", script_path);
+    prof_histogram_print(stdout, "all", &all);
+    for (int k = 0; k < kind_count; k++)
+    {
+        prof_histogram_print(stdout, kind_names[k], &kinds[k]);
+    }
+    if (kinds[OTHER_KIND].count > 0)
+    {
+        prof_histogram_print(stdout, "other", &kinds[OTHER_KIND]);
+    }
+    return 0;
+}
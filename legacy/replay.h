@@ -0,0 +1,11 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "buffer.h"
+
+int replaySession(Buffer *buffer, const char *script_path);
+void startRecording(const char *record_path);
+void recordKey(int ch);
+void stopRecording(void);
+
+#endif // REPLAY_H
@@ -0,0 +1,186 @@
+#include "playground.h"
+#include "prefetch.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <libgen.h>
+#include <term.h>
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <path>\n", argv[0]);
+        return 1;
+    }
+
+    char *abs_path = realpath(argv[1], NULL);
+    if (!abs_path) {
+        fprintf(stderr, "Error: Cannot resolve path '%s'\n", argv[1]);
+        return 1;
+    }
+
+    // QUARK_MEM_BUDGET=playground=64M caps memory per subsystem;
+    // QUARK_MEM_DUMP=<file> gets the memory stats on exit
+    alloc_init(getenv("QUARK_MEM_BUDGET"), getenv("QUARK_MEM_DUMP"));
+
+    struct stat st;
+    if (stat(abs_path, &st) != 0) {
+        fprintf(stderr, "Error: Cannot access '%s'\n", abs_path);
+        free(abs_path);
+        return 1;
+    }
+
+    // Initialize content and tree
+    FileContent *content = NULL;
+    FileTree tree = {0};
+
+    // Handle directory vs file
+    if (S_ISDIR(st.st_mode)) {
+        tree_rows_init(&tree, abs_path);
+    } else {
+        content = load_file(abs_path);
+        // dirname works in place, so it gets a copy
+        char *copy = alloc_strdup(ALLOC_PLAYGROUND, abs_path);
+        if (copy) {
+            char *dir_path = dirname(copy);
+            tree_rows_init(&tree, dir_path);
+            alloc_free(copy);
+        }
+    }
+
+    free(abs_path);
+
+    // QUARK_TRACE=<file> dumps a Chrome trace on exit
+    prof_init(getenv("QUARK_TRACE"));
+
+    // Initialize screen
+    init_screen();
+    mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);
+    mouseinterval(0);
+
+    // Motion tracking lets hovering over the tree start the prefetch early.
+    // mousemask only asks xterm for clicks, so the mode goes out through
+    // terminfo and is flushed before curses draws anything.
+    putp("\033[?1003h");
+    fflush(stdout);
+    Prefetcher *prefetcher = prefetch_start();
+    int hovered = -1;
+    
+    // Initial draw
+    draw_layout(content, &tree);
+    
+    // Main event loop
+    MEVENT event;
+    int ch;
+    while ((ch = getch()) != 'q') {
+        prof_frame_begin();
+        ProfScope input = prof_scope_begin(PROF_INPUT);
+
+        if (ch == KEY_F(12)) {
+            // F12 toggles the profiler overlay
+            prof_toggle_overlay();
+            layout_invalidate(PANE_EDITOR);
+        } else if (ch == KEY_F(11)) {
+            // F11 toggles the memory panel
+            alloc_toggle_panel();
+            layout_invalidate(PANE_EDITOR);
+        } else if (ch == KEY_F(8)) {
+            // F8 dumps the memory stats to QUARK_MEM_DUMP, or to stderr on exit
+            alloc_dump_now();
+        } else if (ch == KEY_MOUSE && getmouse(&event) == OK) {
+            if (event.bstate & REPORT_MOUSE_POSITION) {
+                // Plain motion: warm the hovered file once per row change
+                int row;
+                if (event.x < FILETREE_WIDTH && tree_row_at(&tree, event.y, &row) != NODE_NONE && row != hovered) {
+                    hovered = row;
+                    prefetch_hover(prefetcher, &tree, row);
+                }
+            } else if (event.x < FILETREE_WIDTH && (event.bstate & (BUTTON4_PRESSED | BUTTON5_PRESSED))) {
+                // Scroll the tree with the mouse wheel
+                tree_scroll(&tree, (event.bstate & BUTTON4_PRESSED) ? -3 : 3, LINES);
+            } else if (event.x < FILETREE_WIDTH) {
+                // Find clicked node
+                int row;
+                int clicked = tree_row_at(&tree, event.y, &row);
+                
+                if (clicked != NODE_NONE) {
+                    if (NODE(&tree.nodes, clicked, is_directory)) {
+                        // Toggle directory expansion
+                        if (NODE(&tree.nodes, clicked, is_expanded)) {
+                            tree_collapse(&tree, row);
+                        } else {
+                            tree_expand(&tree, row);
+                        }
+                        hovered = -1;
+                    } else {
+                        // Load file content
+                        char *file_path = get_node_path(&tree, clicked);
+                        if (file_path) {
+                            if (content) {
+                                free_file_content(content);
+                            }
+                            content = load_file(file_path);
+                            alloc_free(file_path);
+                            // The new content can reuse the old one's address
+                            layout_invalidate(PANE_EDITOR);
+                            layout_invalidate(PANE_SCROLLBAR);
+                            tree.selected_index = row;
+                            prefetch_opened(prefetcher, &tree, row);
+                        }
+                    }
+                }
+            }
+        } else {
+            // Handle keyboard navigation
+            switch (ch) {
+                case KEY_UP:
+                    if (content && content->scroll_position > 0) {
+                        content->scroll_position--;
+                    }
+                    break;
+                case KEY_DOWN:
+                    if (content && content->scroll_position < content->line_count - 1) {
+                        content->scroll_position++;
+                    }
+                    break;
+                case KEY_PPAGE: // Page Up
+                    if (content) {
+                        content->scroll_position -= LINES;
+                        if (content->scroll_position < 0) {
+                            content->scroll_position = 0;
+                        }
+                    }
+                    break;
+                case KEY_NPAGE: // Page Down
+                    if (content) {
+                        content->scroll_position += LINES;
+                        if (content->scroll_position > content->line_count - 1) {
+                            content->scroll_position = content->line_count - 1;
+                        }
+                    }
+                    break;
+            }
+        }
+        
+        prof_scope_end(&input);
+
+        // Redraw screen
+        draw_layout(content, &tree);
+        prof_frame_end();
+    }
+
+    // Cleanup
+    if (content) {
+        free_file_content(content);
+    }
+    prefetch_stop(prefetcher);
+    free_file_tree(&tree);
+    putp("\033[?1003l");
+    fflush(stdout);
+    endwin();
+    prof_shutdown();
+    alloc_shutdown();
+    return 0;
+}
\ No newline at end of file
@@ -1,10 +1,11 @@
 #include "playground.h"
+#include "../src/alloc/alloc.h"
+#include "../src/profiler/profiler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
-#include <libgen.h>
 
 FileContent* load_file(const char *filename) {
     FILE *file = fopen(filename, "r");
@@ -14,8 +15,16 @@ FileContent* load_file(const char *filename) {
         exit(1);
     }
 
-    FileContent *content = malloc(sizeof(FileContent));
-    content->lines = malloc(MAX_LINES * sizeof(char*));
+    // Out of memory nothing is shown, or only the lines read so far
+    FileContent *content = alloc_malloc(ALLOC_PLAYGROUND, sizeof(FileContent));
+    char **lines = alloc_malloc(ALLOC_PLAYGROUND, MAX_LINES * sizeof(char*));
+    if (!content || !lines) {
+        alloc_free(content);
+        alloc_free(lines);
+        fclose(file);
+        return NULL;
+    }
+    content->lines = lines;
     content->line_count = 0;
     content->scroll_position = 0;
 
@@ -27,7 +36,8 @@ FileContent* load_file(const char *filename) {
             line[len-1] = '\0';
         }
 
-        content->lines[content->line_count] = strdup(line);
+        content->lines[content->line_count] = alloc_strdup(ALLOC_PLAYGROUND, line);
+        if (!content->lines[content->line_count]) break;
         content->line_count++;
     }
 
@@ -35,83 +45,156 @@ FileContent* load_file(const char *filename) {
     return content;
 }
 
+// Each region of the screen is its own window and is only redrawn when
+// something it shows changed; draw_layout flushes them with one doupdate
+typedef struct {
+    WINDOW *win;
+    int dirty;
+} Pane;
+
+static Pane panes[PANE_COUNT];
+static WINDOW *panes_screen = NULL;  // stdscr the windows were made for
+static int panes_lines = 0;
+static int panes_cols = 0;
+
+// What the editor and scrollbar panes last showed
+static FileContent *shown_content = NULL;
+static int shown_scroll = -1;
+
+void layout_invalidate(PaneId pane) {
+    panes[pane].dirty = 1;
+}
+
+static void create_panes(void) {
+    // Windows of a previous screen went away with it
+    if (panes_screen == stdscr) {
+        for (int i = 0; i < PANE_COUNT; i++) {
+            if (panes[i].win) delwin(panes[i].win);
+        }
+    }
+
+    int editor_x = FILETREE_WIDTH + 1;
+    int editor_width = MAX(1, COLS - editor_x - SCROLLBAR_WIDTH);
+    panes[PANE_TREE].win = newwin(LINES, FILETREE_WIDTH, 0, 0);
+    panes[PANE_SEPARATOR].win = newwin(LINES, 1, 0, FILETREE_WIDTH);
+    panes[PANE_EDITOR].win = newwin(LINES, editor_width, 0, editor_x);
+    panes[PANE_SCROLLBAR].win = newwin(LINES, SCROLLBAR_WIDTH, 0, editor_x + editor_width);
+    for (int i = 0; i < PANE_COUNT; i++) {
+        panes[i].dirty = 1;
+    }
+
+    panes_screen = stdscr;
+    panes_lines = LINES;
+    panes_cols = COLS;
+}
+
 void draw_scrollbar(int total_lines, int visible_lines, int scroll_position) {
-    int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
+    WINDOW *win = panes[PANE_SCROLLBAR].win;
+    int height = getmaxy(win);
     
     // Calculate scrollbar dimensions
-    int scrollbar_height = (visible_lines * max_y) / total_lines;
+    int scrollbar_height = total_lines > 0 ? (visible_lines * height) / total_lines : height;
     if (scrollbar_height < 1) scrollbar_height = 1;
+    if (scrollbar_height > height) scrollbar_height = height;
     
     // Calculate scrollbar position
-    int scrollbar_pos = (scroll_position * (max_y - scrollbar_height)) / (total_lines - visible_lines);
-    if (scrollbar_pos < 0) scrollbar_pos = 0;
-    
-    // Draw scrollbar track
-    attron(COLOR_PAIR(1));
-    for (int y = 0; y < max_y; y++) {
-        mvaddch(y, max_x - SCROLLBAR_WIDTH, ACS_VLINE);
+    int scrollbar_pos = 0;
+    if (total_lines > visible_lines) {
+        scrollbar_pos = (scroll_position * (height - scrollbar_height)) / (total_lines - visible_lines);
     }
+    if (scrollbar_pos < 0) scrollbar_pos = 0;
     
-    // Draw scrollbar thumb
-    attron(A_REVERSE);
-    for (int y = scrollbar_pos; y < scrollbar_pos + scrollbar_height && y < max_y; y++) {
-        mvaddch(y, max_x - SCROLLBAR_WIDTH, ' ');
-    }
-    attroff(A_REVERSE);
-    attroff(COLOR_PAIR(1));
+    // Track and thumb are one vertical run each
+    wattron(win, COLOR_PAIR(1));
+    mvwvline(win, 0, 0, ACS_VLINE, height);
+    mvwvline(win, scrollbar_pos, 0, ' ' | A_REVERSE, MIN(scrollbar_height, height - scrollbar_pos));
+    wattroff(win, COLOR_PAIR(1));
 }
 
 void display_file_content(FileContent *content) {
+    WINDOW *win = panes[PANE_EDITOR].win;
     int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
+    getmaxyx(win, max_y, max_x);
     
-    int editor_width = max_x - FILETREE_WIDTH - SCROLLBAR_WIDTH - 1;
     int display_start = content->scroll_position;
     int display_end = MIN(content->scroll_position + max_y, content->line_count);
 
-    // Clear editor area
-    for (int y = 0; y < max_y; y++) {
-        for (int x = FILETREE_WIDTH + 1; x < max_x - SCROLLBAR_WIDTH; x++) {
-            mvaddch(y, x, ' ');
-        }
-    }
+    werase(win);
 
     // Display file content
+    long bytes_written = 0;
     for (int i = display_start; i < display_end; i++) {
-        mvprintw(i - display_start, FILETREE_WIDTH + 1, "%.*s", 
-                 editor_width, content->lines[i]);
+        mvwaddnstr(win, i - display_start, 0, content->lines[i], max_x);
+        bytes_written += MIN((int)strlen(content->lines[i]), max_x);
     }
-
-    // Update scrollbar
-    draw_scrollbar(content->line_count, max_y, content->scroll_position);
+    prof_count(PROF_BYTES_WRITTEN, bytes_written);
 }
 
 void draw_layout(FileContent *content, FileTree *tree) {
-    int max_y, max_x;
-    getmaxyx(stdscr, max_y, max_x);
+    ProfScope layout = prof_scope_begin(PROF_LAYOUT);
+    if (panes_screen != stdscr || panes_lines != LINES || panes_cols != COLS) {
+        create_panes();
+    }
 
-    // Draw vertical line separator
-    attron(COLOR_PAIR(1));
-    for (int y = 0; y < max_y; y++) {
-        mvaddch(y, FILETREE_WIDTH, ACS_VLINE);
+    // Scrolling only touches the editor and scrollbar; loading a file invalidates them
+    int scroll = content ? content->scroll_position : -1;
+    if (content != shown_content || scroll != shown_scroll) {
+        panes[PANE_EDITOR].dirty = 1;
+        panes[PANE_SCROLLBAR].dirty = 1;
+        shown_content = content;
+        shown_scroll = scroll;
+    }
+    // The overlay changes every frame while it's up
+    if (prof_overlay_visible()) {
+        panes[PANE_EDITOR].dirty = 1;
     }
-    attroff(COLOR_PAIR(1));
 
-    // Draw file tree
-    if (tree && tree->root) {
-        int current_y = 0;
-        draw_tree_node(tree->root, 1, 0, &current_y, 0);
+    if (panes[PANE_SEPARATOR].dirty) {
+        WINDOW *win = panes[PANE_SEPARATOR].win;
+        wattron(win, COLOR_PAIR(1));
+        mvwvline(win, 0, 0, ACS_VLINE, getmaxy(win));
+        wattroff(win, COLOR_PAIR(1));
     }
 
-    // Display file content
-    if (content != NULL) {
-        display_file_content(content);
-    } else {
-        mvprintw(1, FILETREE_WIDTH + 2, "No file opened");
+    if (panes[PANE_TREE].dirty) {
+        werase(panes[PANE_TREE].win);
+        if (tree && tree->row_count > 0) {
+            draw_tree_rows(tree, getmaxy(panes[PANE_TREE].win));
+        }
     }
 
-    refresh();
+    if (alloc_panel_visible()) {
+        panes[PANE_EDITOR].dirty = 1;
+    }
+
+    if (panes[PANE_EDITOR].dirty) {
+        if (content != NULL) {
+            display_file_content(content);
+        } else {
+            werase(panes[PANE_EDITOR].win);
+            mvwprintw(panes[PANE_EDITOR].win, 1, 1, "No file opened");
+        }
+        prof_draw_overlay_window(panes[PANE_EDITOR].win);
+        alloc_draw_panel_window(panes[PANE_EDITOR].win);
+    }
+
+    if (panes[PANE_SCROLLBAR].dirty) {
+        werase(panes[PANE_SCROLLBAR].win);
+        if (content != NULL) {
+            draw_scrollbar(content->line_count, LINES, content->scroll_position);
+        }
+    }
+
+    for (int i = 0; i < PANE_COUNT; i++) {
+        if (panes[i].dirty) {
+            wnoutrefresh(panes[i].win);
+            panes[i].dirty = 0;
+        }
+    }
+    prof_scope_end(&layout);
+
+    PROF_SCOPE(PROF_OUTPUT);
+    doupdate();
 }
 
 void init_screen() {
@@ -121,41 +204,24 @@ void init_screen() {
     noecho();
     keypad(stdscr, TRUE);
     init_pair(1, COLOR_WHITE, COLOR_BLACK);
+    // Flush stdscr once so getch() never repaints it over the panes
+    refresh();
 }
 
-TreeNode* create_node(const char *name, int is_directory) {
-    TreeNode *node = malloc(sizeof(TreeNode));
-    node->name = strdup(name);
-    node->is_directory = is_directory;
-    node->is_expanded = 0;
-    node->children = NULL;
-    node->child_count = 0;
-    node->child_capacity = 0;
-    node->parent = NULL;  // Add this line
-    return node;
-}
-
-void add_child(TreeNode *parent, TreeNode *child) {
-    if (parent->child_count >= parent->child_capacity) {
-        int new_capacity = parent->child_capacity == 0 ? 4 : parent->child_capacity * 2;
-        parent->children = realloc(parent->children, new_capacity * sizeof(TreeNode*));
-        parent->child_capacity = new_capacity;
-    }
-    parent->children[parent->child_count++] = child;
-    child->parent = parent;  // Add this line
-}
-
-TreeNode* build_tree(const char *path) {
+// Walks the whole tree below path, for when everything is wanted up front
+int build_tree(NodeTable *nodes, int parent, const char *path) {
     struct stat st;
+    prof_count(PROF_STAT_CALLS, 1);
     if (stat(path, &st) != 0) {
-        return NULL;
+        return NODE_NONE;
     }
 
-    char *name = strrchr(path, '/');
-    name = name ? name + 1 : (char*)path;
-    TreeNode *node = create_node(name, S_ISDIR(st.st_mode));
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    int node = node_add(nodes, parent, name, S_ISDIR(st.st_mode));
+    if (node == NODE_NONE) return NODE_NONE;
 
-    if (node->is_directory) {
+    if (NODE(nodes, node, is_directory)) {
         DIR *dir = opendir(path);
         if (dir) {
             struct dirent *entry;
@@ -164,34 +230,171 @@ TreeNode* build_tree(const char *path) {
                     continue;
                 }
                 char full_path[PATH_MAX];
-                snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-                TreeNode *child = build_tree(full_path);
-                if (child) {
-                    add_child(node, child);
+                if (snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name) >= (int)sizeof(full_path)) {
+                    continue;
                 }
+                build_tree(nodes, node, full_path);
             }
             closedir(dir);
         }
+        node_sort_children(nodes, node);
     }
     return node;
 }
 
-void draw_tree_node(TreeNode *node, int x, int y, int *current_y, int depth) {
-    if (*current_y >= LINES) return;
+static int ensure_row_capacity(FileTree *tree, int needed) {
+    if (needed <= tree->row_capacity) return 0;
 
-    // Draw the node
-    mvprintw(*current_y, x + depth * 2, "%s %s", 
-             node->is_directory ? (node->is_expanded ? "[-]" : "[+]") : "   ",
-             node->name);
-    
-    (*current_y)++;
+    int new_capacity = tree->row_capacity == 0 ? 64 : tree->row_capacity;
+    while (new_capacity < needed) new_capacity *= 2;
+    int *rows = alloc_realloc(ALLOC_PLAYGROUND, tree->rows, new_capacity * sizeof(int));
+    if (!rows) return -1;
+    tree->rows = rows;
+    tree->row_capacity = new_capacity;
+    return 0;
+}
+
+// Appends the visible descendants of node to out, returns the new count
+static int collect_visible(NodeTable *nodes, int node, int *out, int count) {
+    for (int child = NODE(nodes, node, first_child); child != NODE_NONE; child = NODE(nodes, child, next_sibling)) {
+        out[count++] = child;
+        if (NODE(nodes, child, is_directory) && NODE(nodes, child, is_expanded)) {
+            count = collect_visible(nodes, child, out, count);
+        }
+    }
+    return count;
+}
 
-    // Draw children if expanded
-    if (node->is_directory && node->is_expanded) {
-        for (int i = 0; i < node->child_count; i++) {
-            draw_tree_node(node->children[i], x, y, current_y, depth + 1);
+static int count_visible(NodeTable *nodes, int node) {
+    int count = NODE(nodes, node, child_count);
+    for (int child = NODE(nodes, node, first_child); child != NODE_NONE; child = NODE(nodes, child, next_sibling)) {
+        if (NODE(nodes, child, is_directory) && NODE(nodes, child, is_expanded)) {
+            count += count_visible(nodes, child);
         }
     }
+    return count;
+}
+
+void tree_rows_init(FileTree *tree, const char *root_path) {
+    node_table_init(&tree->nodes, ALLOC_PLAYGROUND);
+    tree->root_path = alloc_strdup(ALLOC_PLAYGROUND, root_path);
+    tree->row_count = 0;
+    tree->scroll = 0;
+
+    // The root is shown as "." and is always open
+    tree->root = node_add(&tree->nodes, NODE_NONE, ".", 1);
+    if (tree->root == NODE_NONE || build_tree_contents(&tree->nodes, tree->root, root_path, NULL) != 0) {
+        tree->root = NODE_NONE;
+        return;
+    }
+    NODE(&tree->nodes, tree->root, is_expanded) = 1;
+
+    int visible = 1 + count_visible(&tree->nodes, tree->root);
+    if (ensure_row_capacity(tree, visible) != 0) return;
+    tree->rows[0] = tree->root;
+    tree->row_count = collect_visible(&tree->nodes, tree->root, tree->rows, 1);
+    layout_invalidate(PANE_TREE);
+}
+
+void load_children(FileTree *tree, int node) {
+    // Rules of the ancestors apply too, outermost first
+    NodeTable *nodes = &tree->nodes;
+    int depth = NODE(nodes, node, depth);
+    IgnoreStack parents = {0};
+    for (int level = depth; level > 0; level--) {
+        int p = node;
+        for (int i = 0; i < level; i++) p = NODE(nodes, p, parent);
+        ignore_push(&parents, NODE(nodes, p, ignore));
+    }
+
+    char *full_path = get_node_path(tree, node);
+    if (full_path) {
+        build_tree_contents(nodes, node, full_path, &parents);
+    }
+    alloc_free(full_path);
+    free_ignore_stack(&parents);
+}
+
+void tree_expand(FileTree *tree, int row) {
+    NodeTable *nodes = &tree->nodes;
+    int node = tree->rows[row];
+    if (!NODE(nodes, node, is_directory) || NODE(nodes, node, is_expanded)) return;
+
+    if (NODE(nodes, node, child_count) == 0) {
+        load_children(tree, node);
+    }
+    NODE(nodes, node, is_expanded) = 1;
+
+    // Splice the newly visible rows in after the expanded node; without room
+    // for them the directory stays collapsed
+    int inserted = count_visible(nodes, node);
+    if (ensure_row_capacity(tree, tree->row_count + inserted) != 0) {
+        NODE(nodes, node, is_expanded) = 0;
+        return;
+    }
+    memmove(&tree->rows[row + 1 + inserted], &tree->rows[row + 1],
+            (tree->row_count - row - 1) * sizeof(int));
+    collect_visible(nodes, node, tree->rows, row + 1);
+    tree->row_count += inserted;
+    layout_invalidate(PANE_TREE);
+}
+
+void tree_collapse(FileTree *tree, int row) {
+    NodeTable *nodes = &tree->nodes;
+    int node = tree->rows[row];
+    if (!NODE(nodes, node, is_directory) || !NODE(nodes, node, is_expanded)) return;
+
+    // Visible descendants are exactly the following rows that are deeper
+    int end = row + 1;
+    while (end < tree->row_count && NODE(nodes, tree->rows[end], depth) > NODE(nodes, node, depth)) {
+        end++;
+    }
+    memmove(&tree->rows[row + 1], &tree->rows[end], (tree->row_count - end) * sizeof(int));
+    tree->row_count -= end - row - 1;
+    NODE(nodes, node, is_expanded) = 0;
+
+    if (tree->scroll > tree->row_count - 1) {
+        tree->scroll = MAX(0, tree->row_count - 1);
+    }
+    layout_invalidate(PANE_TREE);
+}
+
+void tree_scroll(FileTree *tree, int delta, int height) {
+    int scroll = tree->scroll;
+    tree->scroll += delta;
+    if (tree->scroll > tree->row_count - height) tree->scroll = tree->row_count - height;
+    if (tree->scroll < 0) tree->scroll = 0;
+    if (tree->scroll != scroll) layout_invalidate(PANE_TREE);
+}
+
+void draw_tree_rows(FileTree *tree, int height) {
+    WINDOW *win = panes[PANE_TREE].win;
+    NodeTable *nodes = &tree->nodes;
+    int width = FILETREE_WIDTH - 1;
+
+    // Only the rows inside the viewport are touched
+    for (int y = 0; y < height; y++) {
+        int row = tree->scroll + y;
+        if (row >= tree->row_count) {
+            mvwprintw(win, y, 0, "%*s", FILETREE_WIDTH, "");
+            continue;
+        }
+
+        int node = tree->rows[row];
+        char line[PATH_MAX];
+        snprintf(line, sizeof(line), "%*s%s %s", NODE(nodes, node, depth) * 2, "",
+                 NODE(nodes, node, is_directory) ? (NODE(nodes, node, is_expanded) ? "[-]" : "[+]") : "   ",
+                 NODE(nodes, node, name));
+        mvwprintw(win, y, 0, " %-*.*s", width, width, line);
+        prof_count(PROF_BYTES_WRITTEN, FILETREE_WIDTH);
+    }
+}
+
+int tree_row_at(FileTree *tree, int y, int *row) {
+    int index = tree->scroll + y;
+    if (y < 0 || index >= tree->row_count) return NODE_NONE;
+    if (row) *row = index;
+    return tree->rows[index];
 }
 
 char* get_absolute_path(const char *path) {
@@ -203,15 +406,19 @@ char* get_absolute_path(const char *path) {
     return abs_path;
 }
 
-TreeNode* build_tree_contents(const char *path) {
+int build_tree_contents(NodeTable *nodes, int node, const char *path, const IgnoreStack *parents) {
     DIR *dir = opendir(path);
     if (!dir) {
-        return NULL;
+        return -1;
     }
 
-    // Create a dummy root node to hold contents
-    TreeNode *root = create_node(".", 1);
-    root->is_expanded = 1;  // Always show contents
+    // Ignored entries are dropped here, so their subtrees are never opened
+    NODE(nodes, node, ignore) = load_ignore_rules(path);
+    IgnoreStack ignore = {0};
+    for (int i = 0; parents && i < parents->count; i++) {
+        ignore_push(&ignore, parents->levels[i]);
+    }
+    ignore_push(&ignore, NODE(nodes, node, ignore));
 
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
@@ -220,56 +427,44 @@ TreeNode* build_tree_contents(const char *path) {
             continue;
         }
 
-        char full_path[PATH_MAX];   
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        struct stat st;
-        if (stat(full_path, &st) == 0) {
-            TreeNode *node = create_node(entry->d_name, S_ISDIR(st.st_mode));
-            if (node->is_directory) {
-                // For directories, we'll load their contents when expanded
-                node->is_expanded = 0;
-            }
-            add_child(root, node);
+        char full_path[PATH_MAX];
+        if (snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name) >= (int)sizeof(full_path)) {
+            continue;
         }
-    }
-    closedir(dir);
-    return root;
-}
-
-TreeNode* find_node_at_y(TreeNode *root, int target_y, int *current_y, int depth) {
-    if (!root || *current_y >= LINES) return NULL;
 
-    // Check if current node is at target_y
-    if (*current_y == target_y) {
-        return root;
-    }
-    (*current_y)++;
-
-    // Check children if directory is expanded
-    if (root->is_directory && root->is_expanded) {
-        for (int i = 0; i < root->child_count; i++) {
-            TreeNode *found = find_node_at_y(root->children[i], target_y, current_y, depth + 1);
-            if (found) return found;
+        // Directories load their own contents when expanded; out of memory
+        // the listing stops at what fit
+        struct stat st;
+        prof_count(PROF_STAT_CALLS, 1);
+        if (stat(full_path, &st) == 0 && !is_ignored(&ignore, full_path, entry->d_name, S_ISDIR(st.st_mode))
+            && node_add(nodes, node, entry->d_name, S_ISDIR(st.st_mode)) == NODE_NONE) {
+            break;
         }
     }
-    return NULL;
+    closedir(dir);
+    free_ignore_stack(&ignore);
+    node_sort_children(nodes, node);
+    return 0;
 }
 
-char* get_node_path(TreeNode *node) {
+char* get_node_path(FileTree *tree, int node) {
     // Allocate space for path
-    char *path = malloc(PATH_MAX);
+    char *path = alloc_malloc(ALLOC_PLAYGROUND, PATH_MAX);
+    if (!path) return NULL;
     path[0] = '\0';
 
-    // Build path from root to node
-    TreeNode *current = node;
-    while (current) {
+    // Build path from node up to (but excluding) the root
+    int current = node;
+    while (current != NODE_NONE && NODE(&tree->nodes, current, parent) != NODE_NONE) {
         char temp[PATH_MAX];
-        snprintf(temp, sizeof(temp), "/%s%s", current->name, path);
+        snprintf(temp, sizeof(temp), "/%s%s", NODE(&tree->nodes, current, name), path);
         strcpy(path, temp);
-        current = current->parent;  // Note: You'll need to add parent pointer to TreeNode
+        current = NODE(&tree->nodes, current, parent);
     }
 
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s%s", tree->root_path, path);
+    strcpy(path, temp);
     return path;
 }
 
@@ -277,156 +472,22 @@ void free_file_content(FileContent *content) {
     if (!content) return;
     
     for (int i = 0; i < content->line_count; i++) {
-        free(content->lines[i]);
+        alloc_free(content->lines[i]);
     }
-    free(content->lines);
-    free(content);
-}
-
-void free_file_tree(FileTree *tree) {
-    if (!tree) return;
-    free_tree_node(tree->root);
+    alloc_free(content->lines);
+    alloc_free(content);
 }
 
-void free_tree_node(TreeNode *node) {
-    if (!node) return;
-
-    for (int i = 0; i < node->child_count; i++) {
-        free_tree_node(node->children[i]);
+void free_tree_nodes(NodeTable *nodes) {
+    for (int node = 0; node < nodes->count; node++) {
+        free_ignore_rules(NODE(nodes, node, ignore));
     }
-
-    free(node->name);
-    free(node->children);
-    free(node);
+    node_table_free(nodes);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <path>\n", argv[0]);
-        return 1;
-    }
-
-    char *abs_path = realpath(argv[1], NULL);
-    if (!abs_path) {
-        fprintf(stderr, "Error: Cannot resolve path '%s'\n", argv[1]);
-        return 1;
-    }
-
-    struct stat st;
-    if (stat(abs_path, &st) != 0) {
-        fprintf(stderr, "Error: Cannot access '%s'\n", abs_path);
-        free(abs_path);
-        return 1;
-    }
-
-    // Initialize content and tree
-    FileContent *content = NULL;
-    FileTree tree = {0};
-
-    // Handle directory vs file
-    if (S_ISDIR(st.st_mode)) {
-        tree.root = build_tree_contents(abs_path);
-    } else {
-        content = load_file(abs_path);
-        char *dir_path = strdup(abs_path);
-        dir_path = dirname(dir_path);
-        tree.root = build_tree_contents(dir_path);
-        free(dir_path);
-    }
-
-    free(abs_path);
-
-    // Initialize screen
-    init_screen();
-    mousemask(ALL_MOUSE_EVENTS, NULL);
-    mouseinterval(0);
-    
-    // Initial draw
-    draw_layout(content, &tree);
-    
-    // Main event loop
-    MEVENT event;
-    int ch;
-    while ((ch = getch()) != 'q') {
-        if (ch == KEY_MOUSE && getmouse(&event) == OK) {
-            if (event.x < FILETREE_WIDTH) {
-                // Find clicked node
-                int current_y = 0;
-                TreeNode *clicked = find_node_at_y(tree.root, event.y, &current_y, 0);
-                
-                if (clicked) {
-                    if (clicked->is_directory) {
-                        // Toggle directory expansion
-                        clicked->is_expanded = !clicked->is_expanded;
-                        if (clicked->is_expanded && clicked->child_count == 0) {
-                            // Load directory contents when expanded
-                            char *full_path = get_node_path(clicked);
-                            if (full_path) {
-                                TreeNode *contents = build_tree_contents(full_path);
-                                if (contents) {
-                                    clicked->children = contents->children;
-                                    clicked->child_count = contents->child_count;
-                                    clicked->child_capacity = contents->child_capacity;
-                                    free(contents->name);
-                                    free(contents);
-                                }
-                                free(full_path);
-                            }
-                        }
-                    } else {
-                        // Load file content
-                        char *file_path = get_node_path(clicked);
-                        if (file_path) {
-                            if (content) {
-                                free_file_content(content);
-                            }
-                            content = load_file(file_path);
-                            free(file_path);
-                        }
-                    }
-                }
-            }
-        } else {
-            // Handle keyboard navigation
-            switch (ch) {
-                case KEY_UP:
-                    if (content && content->scroll_position > 0) {
-                        content->scroll_position--;
-                    }
-                    break;
-                case KEY_DOWN:
-                    if (content && content->scroll_position < content->line_count - 1) {
-                        content->scroll_position++;
-                    }
-                    break;
-                case KEY_PPAGE: // Page Up
-                    if (content) {
-                        content->scroll_position -= LINES;
-                        if (content->scroll_position < 0) {
-                            content->scroll_position = 0;
-                        }
-                    }
-                    break;
-                case KEY_NPAGE: // Page Down
-                    if (content) {
-                        content->scroll_position += LINES;
-                        if (content->scroll_position > content->line_count - 1) {
-                            content->scroll_position = content->line_count - 1;
-                        }
-                    }
-                    break;
-            }
-        }
-        
-        // Redraw screen
-        draw_layout(content, &tree);
-    }
-
-    // Cleanup
-    if (content) {
-        free_file_content(content);
-    }
-    free_file_tree(&tree);
-    endwin();
-    return 0;
-}
\ No newline at end of file
+void free_file_tree(FileTree *tree) {
+    if (!tree) return;
+    free_tree_nodes(&tree->nodes);
+    alloc_free(tree->rows);
+    alloc_free(tree->root_path);
+}
@@ -2,6 +2,8 @@
 #define PLAYGROUND_H
 
 #include <ncurses.h>
+#include "../src/explorer/ignore.h"
+#include "../src/explorer/node_table.h"
 
 // Constants
 #define FILETREE_WIDTH 20
@@ -20,24 +22,32 @@ typedef struct {
     int scroll_position;
 } FileContent;
 
-typedef struct TreeNode {
-    char *name;
-    int is_directory;
-    int is_expanded;
-    struct TreeNode **children;
-    struct TreeNode *parent;  // Add this line
-    int child_count;
-    int child_capacity;
-} TreeNode;
-
+// Nodes live in a shared node table; rows and links are node numbers
 typedef struct {
-    TreeNode *root;
+    NodeTable nodes;
+    int root;
     int selected_index;
+    char *root_path;
+    // Flattened list of visible nodes, patched on expand/collapse
+    int *rows;
+    int row_count;
+    int row_capacity;
+    int scroll;
 } FileTree;
 
+// Screen regions, each drawn into its own window
+typedef enum {
+    PANE_TREE,
+    PANE_SEPARATOR,
+    PANE_EDITOR,
+    PANE_SCROLLBAR,
+    PANE_COUNT
+} PaneId;
+
 // Function declarations
 // Screen handling
 void init_screen(void);
+void layout_invalidate(PaneId pane);
 void draw_layout(FileContent *content, FileTree *tree);
 void draw_scrollbar(int total_lines, int visible_lines, int scroll_position);
 
@@ -46,18 +56,23 @@ FileContent* load_file(const char *filename);
 void display_file_content(FileContent *content);
 
 // Tree operations
-TreeNode* create_node(const char *name, int is_directory);
-void add_child(TreeNode *parent, TreeNode *child);
-TreeNode* build_tree(const char *path);
-void draw_tree_node(TreeNode *node, int x, int y, int *current_y, int depth);
+int build_tree(NodeTable *nodes, int parent, const char *path);
+// Adds the sorted listing of path under node; -1 when it can't be opened
+int build_tree_contents(NodeTable *nodes, int node, const char *path, const IgnoreStack *parents);
+void load_children(FileTree *tree, int node);
 
-// Helper function declarations to add to playground.h
-TreeNode* find_node_at_y(TreeNode *root, int target_y, int *current_y, int depth);
-char* get_node_path(TreeNode *node);
+// Visible row operations
+void tree_rows_init(FileTree *tree, const char *root_path);
+void tree_expand(FileTree *tree, int row);
+void tree_collapse(FileTree *tree, int row);
+void tree_scroll(FileTree *tree, int delta, int height);
+void draw_tree_rows(FileTree *tree, int height);
+int tree_row_at(FileTree *tree, int y, int *row);
+char* get_node_path(FileTree *tree, int node);
 
 // Memory management functions
 void free_file_content(FileContent *content);
 void free_file_tree(FileTree *tree);
-void free_tree_node(TreeNode *node);  // Add this line
+void free_tree_nodes(NodeTable *nodes);
 
 #endif // PLAYGROUND_H
\ No newline at end of file
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "prefetch.h"
+#include "../src/alloc/alloc.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PREFETCH_QUEUE 16
+#define PREFETCH_RECENT 64
+#define PREFETCH_HISTORY 32
+#define PREFETCH_NEIGHBORS 2
+#define PREFETCH_CHUNK 65536
+
+// load_file never reads more than this much of a file
+#define PREFETCH_LIMIT ((off_t)MAX_LINES * MAX_LINE_LENGTH)
+
+struct Prefetcher {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stopping;
+
+    // Stack of pending paths, newest on top; the oldest is dropped when full
+    char *queue[PREFETCH_QUEUE];
+    int queued;
+
+    // Hashes of paths already warmed, so hovering back and forth is free
+    uint64_t recent[PREFETCH_RECENT];
+    int recent_next;
+
+    // Paths in the order they were opened, for next-file prediction
+    char *history[PREFETCH_HISTORY];
+    int history_count;
+};
+
+static uint64_t hash_path(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Asks for readahead over the part load_file will read, then reads it once
+// so the pages are resident by the time the file is clicked
+static void warm_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_NOATIME);
+    if (fd < 0) {
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, PREFETCH_LIMIT, POSIX_FADV_WILLNEED);
+    readahead(fd, 0, PREFETCH_LIMIT);
+
+    static __thread char scratch[PREFETCH_CHUNK];
+    off_t offset = 0;
+    ssize_t n;
+    while (offset < PREFETCH_LIMIT && (n = pread(fd, scratch, sizeof(scratch), offset)) > 0) {
+        offset += n;
+    }
+    close(fd);
+}
+
+static void* prefetch_worker(void *arg) {
+    Prefetcher *prefetcher = arg;
+    pthread_mutex_lock(&prefetcher->lock);
+    for (;;) {
+        while (prefetcher->queued == 0 && !prefetcher->stopping) {
+            pthread_cond_wait(&prefetcher->wake, &prefetcher->lock);
+        }
+        if (prefetcher->stopping) break;
+
+        char *path = prefetcher->queue[--prefetcher->queued];
+        pthread_mutex_unlock(&prefetcher->lock);
+        warm_file(path);
+        uint64_t hash = hash_path(path);
+        alloc_free(path);
+        pthread_mutex_lock(&prefetcher->lock);
+        // Recorded once warmed, so a path dropped from the queue is asked for again
+        prefetcher->recent[prefetcher->recent_next] = hash;
+        prefetcher->recent_next = (prefetcher->recent_next + 1) % PREFETCH_RECENT;
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+    return NULL;
+}
+
+Prefetcher* prefetch_start(void) {
+    Prefetcher *prefetcher = alloc_calloc(ALLOC_PLAYGROUND, 1, sizeof(Prefetcher));
+    if (!prefetcher) return NULL;
+
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->wake, NULL);
+    if (pthread_create(&prefetcher->thread, NULL, prefetch_worker, prefetcher) != 0) {
+        pthread_mutex_destroy(&prefetcher->lock);
+        pthread_cond_destroy(&prefetcher->wake);
+        alloc_free(prefetcher);
+        return NULL;
+    }
+    return prefetcher;
+}
+
+void prefetch_stop(Prefetcher *prefetcher) {
+    if (!prefetcher) return;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stopping = 1;
+    pthread_cond_signal(&prefetcher->wake);
+    pthread_mutex_unlock(&prefetcher->lock);
+    pthread_join(prefetcher->thread, NULL);
+
+    for (int i = 0; i < prefetcher->queued; i++) {
+        alloc_free(prefetcher->queue[i]);
+    }
+    for (int i = 0; i < prefetcher->history_count; i++) {
+        alloc_free(prefetcher->history[i]);
+    }
+    pthread_mutex_destroy(&prefetcher->lock);
+    pthread_cond_destroy(&prefetcher->wake);
+    alloc_free(prefetcher);
+}
+
+void prefetch_file(Prefetcher *prefetcher, const char *path) {
+    if (!prefetcher || !path) return;
+
+    uint64_t hash = hash_path(path);
+    pthread_mutex_lock(&prefetcher->lock);
+    int known = 0;
+    for (int i = 0; i < PREFETCH_RECENT && !known; i++) {
+        known = prefetcher->recent[i] == hash;
+    }
+    for (int i = 0; i < prefetcher->queued && !known; i++) {
+        known = strcmp(prefetcher->queue[i], path) == 0;
+    }
+    char *copy = known ? NULL : alloc_strdup(ALLOC_PLAYGROUND, path);
+    if (!copy) {
+        pthread_mutex_unlock(&prefetcher->lock);
+        return;
+    }
+    if (prefetcher->queued == PREFETCH_QUEUE) {
+        alloc_free(prefetcher->queue[0]);
+        memmove(&prefetcher->queue[0], &prefetcher->queue[1], (PREFETCH_QUEUE - 1) * sizeof(char*));
+        prefetcher->queued--;
+    }
+    prefetcher->queue[prefetcher->queued++] = copy;
+    pthread_cond_signal(&prefetcher->wake);
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+static void prefetch_row(Prefetcher *prefetcher, FileTree *tree, int row) {
+    if (row < 0 || row >= tree->row_count || NODE(&tree->nodes, tree->rows[row], is_directory)) return;
+
+    char *path = get_node_path(tree, tree->rows[row]);
+    prefetch_file(prefetcher, path);
+    alloc_free(path);
+}
+
+void prefetch_hover(Prefetcher *prefetcher, FileTree *tree, int row) {
+    prefetch_row(prefetcher, tree, row);
+}
+
+void prefetch_opened(Prefetcher *prefetcher, FileTree *tree, int row) {
+    if (!prefetcher || row < 0 || row >= tree->row_count) return;
+
+    // Queued lowest priority first, since the newest request is served first
+    for (int i = PREFETCH_NEIGHBORS; i >= 1; i--) {
+        prefetch_row(prefetcher, tree, row - i);
+        prefetch_row(prefetcher, tree, row + i);
+    }
+
+    // If this file was opened before, the one opened right after it then is
+    // the best guess for what comes next
+    char *path = get_node_path(tree, tree->rows[row]);
+    if (!path) return;
+    for (int i = prefetcher->history_count - 2; i >= 0; i--) {
+        if (strcmp(prefetcher->history[i], path) == 0) {
+            prefetch_file(prefetcher, prefetcher->history[i + 1]);
+            break;
+        }
+    }
+
+    if (prefetcher->history_count == PREFETCH_HISTORY) {
+        alloc_free(prefetcher->history[0]);
+        memmove(&prefetcher->history[0], &prefetcher->history[1], (PREFETCH_HISTORY - 1) * sizeof(char*));
+        prefetcher->history_count--;
+    }
+    prefetcher->history[prefetcher->history_count++] = path;
+}
@@ -0,0 +1,23 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "playground.h"
+
+typedef struct Prefetcher Prefetcher;
+
+// Warms the page cache for files the user is likely to open next on a
+// background thread, so a click finds the data already in memory
+Prefetcher* prefetch_start(void);
+void prefetch_stop(Prefetcher *prefetcher);
+
+// Queues one file; the most recent request is served first
+void prefetch_file(Prefetcher *prefetcher, const char *path);
+
+// Hovering a row prefetches it if it's a file
+void prefetch_hover(Prefetcher *prefetcher, FileTree *tree, int row);
+
+// Called when the file at row is opened: records it and queues the files
+// around it plus whatever was opened after it last time
+void prefetch_opened(Prefetcher *prefetcher, FileTree *tree, int row);
+
+#endif // PREFETCH_H
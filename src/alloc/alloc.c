@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+#include "alloc.h"
+#include "../profiler/profiler.h"
+#include <errno.h>
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ALLOC_MAX_RECLAIMS 16
+#define ALLOC_ALIGN 16
+
+// In front of every general allocation, so free knows what to uncharge
+typedef struct AllocHeader {
+    size_t size;
+    uint32_t subsystem;
+    uint32_t mapped;
+} __attribute__((aligned(ALLOC_ALIGN))) AllocHeader;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+} __attribute__((aligned(ALLOC_ALIGN))) ArenaBlock;
+
+typedef struct Reclaim {
+    AllocSubsystem subsystem;
+    AllocReclaim reclaim;
+    void *context;
+} Reclaim;
+
+static const char *subsystem_names[ALLOC_SUBSYSTEM_COUNT] = {
+    "text", "text_index", "diff", "explorer", "playground", "io"
+};
+
+static AllocStats stats[ALLOC_SUBSYSTEM_COUNT];
+static Reclaim reclaims[ALLOC_MAX_RECLAIMS];
+static int reclaim_count = 0;
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *dump_path = NULL;
+static int dumps_written = 0;
+static FILE *held_dumps = NULL;     // for stderr at shutdown when there's no path
+static char *held_text = NULL;
+static size_t held_size = 0;
+static int panel_visible = 0;
+
+static void charge(AllocSubsystem subsystem, size_t bytes, size_t mapped, int count) {
+    AllocStats *s = &stats[subsystem];
+    size_t now = __atomic_add_fetch(&s->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->mapped, mapped, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->count, count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->total, count, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+    while (now > peak && !__atomic_compare_exchange_n(&s->peak, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    prof_count(PROF_ALLOCS, 1);
+}
+
+static void uncharge(AllocSubsystem subsystem, size_t bytes, size_t mapped, int count) {
+    AllocStats *s = &stats[subsystem];
+    __atomic_sub_fetch(&s->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&s->mapped, mapped, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&s->count, count, __ATOMIC_RELAXED);
+}
+
+static void refuse(AllocSubsystem subsystem) {
+    __atomic_add_fetch(&stats[subsystem].failures, 1, __ATOMIC_RELAXED);
+    errno = ENOMEM;
+}
+
+static int over_budget(AllocSubsystem subsystem, size_t more) {
+    size_t budget = __atomic_load_n(&stats[subsystem].budget, __ATOMIC_RELAXED);
+    return budget != 0 && __atomic_load_n(&stats[subsystem].bytes, __ATOMIC_RELAXED) + more > budget;
+}
+
+// Asks the subsystem's caches to let go until more bytes fit, or all of them
+// when more is 0; returns whether more fits now. resizing is the block being
+// grown, if any, which the callbacks leave alone.
+static int reclaim(AllocSubsystem subsystem, size_t more, const void *resizing) {
+    pthread_mutex_lock(&reclaim_lock);
+    for (int i = 0; i < reclaim_count && (more == 0 || over_budget(subsystem, more)); i++) {
+        if (reclaims[i].subsystem == subsystem) {
+            reclaims[i].reclaim(reclaims[i].context, resizing);
+        }
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+    return !over_budget(subsystem, more);
+}
+
+static int fits(AllocSubsystem subsystem, size_t more, const void *resizing) {
+    return !over_budget(subsystem, more) || reclaim(subsystem, more, resizing);
+}
+
+static void *map_pages(size_t total) {
+    void *pages = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return pages == MAP_FAILED ? NULL : pages;
+}
+
+// malloc, then malloc again once caches are dropped, then a private mapping,
+// which can still succeed when the heap can't grow
+static AllocHeader *obtain(AllocSubsystem subsystem, size_t total, int *mapped) {
+    AllocHeader *header = malloc(total);
+    if (header == NULL) {
+        reclaim(subsystem, 0, NULL);
+        header = malloc(total);
+    }
+    *mapped = 0;
+    if (header == NULL) {
+        header = map_pages(total);
+        *mapped = header != NULL;
+    }
+    return header;
+}
+
+static void *allocate(AllocSubsystem subsystem, size_t size) {
+    size_t total = sizeof(AllocHeader) + size;
+    int mapped;
+    AllocHeader *header = NULL;
+    if (total > size && fits(subsystem, total, NULL)) {
+        header = obtain(subsystem, total, &mapped);
+    }
+    if (header == NULL) {
+        refuse(subsystem);
+        return NULL;
+    }
+    header->size = size;
+    header->subsystem = subsystem;
+    header->mapped = mapped;
+    charge(subsystem, total, mapped ? total : 0, 1);
+    return header + 1;
+}
+
+void *alloc_malloc(AllocSubsystem subsystem, size_t size) {
+    return allocate(subsystem, size);
+}
+
+void *alloc_calloc(AllocSubsystem subsystem, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        refuse(subsystem);
+        return NULL;
+    }
+    void *memory = alloc_malloc(subsystem, count * size);
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+// Stays charged to the subsystem that first allocated it. Growing past the
+// budget reclaims like a new allocation, except that callbacks skip the
+// block being resized.
+void *alloc_realloc(AllocSubsystem subsystem, void *pointer, size_t size) {
+    if (pointer == NULL) {
+        return allocate(subsystem, size);
+    }
+    AllocHeader *header = (AllocHeader *)pointer - 1;
+    AllocSubsystem owner = header->subsystem;
+    size_t old_total = sizeof(AllocHeader) + header->size;
+    size_t total = sizeof(AllocHeader) + size;
+    int was_mapped = header->mapped;
+    if (total < size || (total > old_total && !fits(owner, total - old_total, pointer))) {
+        refuse(owner);
+        return NULL;
+    }
+
+    AllocHeader *moved;
+    if (was_mapped) {
+        moved = mremap(header, old_total, total, MREMAP_MAYMOVE);
+        moved = moved == MAP_FAILED ? NULL : moved;
+    } else {
+        moved = realloc(header, total);
+        if (moved == NULL && (moved = map_pages(total)) != NULL) {
+            memcpy(moved, header, old_total < total ? old_total : total);
+            free(header);
+            moved->mapped = 1;
+        }
+    }
+    if (moved == NULL) {
+        refuse(owner);
+        return NULL;
+    }
+
+    moved->size = size;
+    uncharge(owner, old_total, was_mapped ? old_total : 0, 1);
+    charge(owner, total, moved->mapped ? total : 0, 1);
+    __atomic_sub_fetch(&stats[owner].total, 1, __ATOMIC_RELAXED);
+    return moved + 1;
+}
+
+char *alloc_strdup(AllocSubsystem subsystem, const char *text) {
+    return alloc_strndup(subsystem, text, strlen(text));
+}
+
+char *alloc_strndup(AllocSubsystem subsystem, const char *text, size_t length) {
+    length = strnlen(text, length);
+    char *copy = alloc_malloc(subsystem, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+void alloc_free(void *pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+    AllocHeader *header = (AllocHeader *)pointer - 1;
+    size_t total = sizeof(AllocHeader) + header->size;
+    uncharge(header->subsystem, total, header->mapped ? total : 0, 1);
+    if (header->mapped) {
+        munmap(header, total);
+    } else {
+        free(header);
+    }
+}
+
+void alloc_set_budget(AllocSubsystem subsystem, size_t bytes) {
+    __atomic_store_n(&stats[subsystem].budget, bytes, __ATOMIC_RELAXED);
+}
+
+void alloc_register_reclaim(AllocSubsystem subsystem, AllocReclaim callback, void *context) {
+    pthread_mutex_lock(&reclaim_lock);
+    if (reclaim_count < ALLOC_MAX_RECLAIMS) {
+        reclaims[reclaim_count++] = (Reclaim){ subsystem, callback, context };
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+}
+
+void alloc_unregister_reclaim(AllocReclaim callback, void *context) {
+    pthread_mutex_lock(&reclaim_lock);
+    for (int i = 0; i < reclaim_count; i++) {
+        if (reclaims[i].reclaim == callback && reclaims[i].context == context) {
+            reclaims[i--] = reclaims[--reclaim_count];
+        }
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+}
+
+AllocStats alloc_stats(AllocSubsystem subsystem) {
+    AllocStats copy;
+    const AllocStats *s = &stats[subsystem];
+    copy.bytes = __atomic_load_n(&s->bytes, __ATOMIC_RELAXED);
+    copy.peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+    copy.count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    copy.total = __atomic_load_n(&s->total, __ATOMIC_RELAXED);
+    copy.mapped = __atomic_load_n(&s->mapped, __ATOMIC_RELAXED);
+    copy.failures = __atomic_load_n(&s->failures, __ATOMIC_RELAXED);
+    copy.budget = __atomic_load_n(&s->budget, __ATOMIC_RELAXED);
+    return copy;
+}
+
+const char *alloc_subsystem_name(AllocSubsystem subsystem) {
+    return subsystem_names[subsystem];
+}
+
+// Parses "name=size" pairs separated by commas; sizes take a K, M or G suffix
+static void parse_budgets(const char *budgets) {
+    const char *p = budgets;
+    while (*p != '\0') {
+        size_t length = strcspn(p, "=,");
+        if (p[length] != '=') {
+            p += length + (p[length] == ',');
+            continue;
+        }
+        char *end;
+        unsigned long long bytes = strtoull(p + length + 1, &end, 10);
+        switch (*end) {
+        case 'G': case 'g': bytes <<= 10; /* fall through */
+        case 'M': case 'm': bytes <<= 10; /* fall through */
+        case 'K': case 'k': bytes <<= 10; end++; break;
+        }
+        for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+            if (strlen(subsystem_names[i]) == length && strncmp(subsystem_names[i], p, length) == 0) {
+                alloc_set_budget(i, bytes);
+            }
+        }
+        p = end + strcspn(end, ",");
+        p += *p == ',';
+    }
+}
+
+void alloc_init(const char *budgets, const char *path) {
+    if (budgets != NULL) {
+        parse_budgets(budgets);
+    }
+    if (path != NULL && path[0] != '\0') {
+        dump_path = strdup(path);
+    }
+}
+
+// The first dump of a run replaces the file, later ones are appended
+static int write_dump(void) {
+    FILE *file = fopen(dump_path, dumps_written ? "a" : "w");
+    if (file == NULL) {
+        return -1;
+    }
+    if (dumps_written++ > 0) {
+        fputc('\n', file);
+    }
+    alloc_dump(file);
+    return fclose(file);
+}
+
+void alloc_shutdown(void) {
+    if (dump_path != NULL) {
+        write_dump();
+        free(dump_path);
+        dump_path = NULL;
+    }
+    if (held_dumps != NULL) {
+        fclose(held_dumps);
+        fputs(held_text, stderr);
+        free(held_text);
+        held_dumps = NULL;
+        held_text = NULL;
+    }
+}
+
+int alloc_dump_now(void) {
+    if (dump_path != NULL) {
+        return write_dump() == 0 ? 1 : -1;
+    }
+    if (held_dumps == NULL && (held_dumps = open_memstream(&held_text, &held_size)) == NULL) {
+        return -1;
+    }
+    if (ftell(held_dumps) > 0) {
+        fputc('\n', held_dumps);
+    }
+    alloc_dump(held_dumps);
+    return 0;
+}
+
+static void format_bytes(size_t bytes, char *out, size_t size) {
+    const char *units[] = { "B", "K", "M", "G", "T" };
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(out, size, unit == 0 ? "%.0f%s" : "%.1f%s", value, units[unit]);
+}
+
+void alloc_dump(FILE *file) {
+    fprintf(file, "%-12s %9s %9s %9s %10s %9s %7s %9s\n",
+            "subsystem", "live", "peak", "count", "total", "mapped", "failed", "budget");
+    for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+        AllocStats s = alloc_stats(i);
+        char live[16], peak[16], mapped[16], budget[16];
+        format_bytes(s.bytes, live, sizeof(live));
+        format_bytes(s.peak, peak, sizeof(peak));
+        format_bytes(s.mapped, mapped, sizeof(mapped));
+        if (s.budget != 0) {
+            format_bytes(s.budget, budget, sizeof(budget));
+        } else {
+            snprintf(budget, sizeof(budget), "-");
+        }
+        fprintf(file, "%-12s %9s %9s %9zu %10zu %9s %7zu %9s\n",
+                subsystem_names[i], live, peak, s.count, s.total, mapped, s.failures, budget);
+    }
+}
+
+void alloc_toggle_panel(void) {
+    panel_visible = !panel_visible;
+}
+
+int alloc_panel_visible(void) {
+    return panel_visible;
+}
+
+void alloc_draw_panel_window(void *window) {
+    if (!panel_visible) return;
+
+    WINDOW *win = window;
+    int y = 0;
+    wattron(win, A_REVERSE);
+    mvwprintw(win, y++, 0, " %-10s %8s %8s %8s %8s ", "memory", "live", "peak", "count", "budget");
+    for (int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++) {
+        AllocStats s = alloc_stats(i);
+        char live[16], peak[16], budget[16];
+        format_bytes(s.bytes, live, sizeof(live));
+        format_bytes(s.peak, peak, sizeof(peak));
+        if (s.budget != 0) {
+            format_bytes(s.budget, budget, sizeof(budget));
+        } else {
+            snprintf(budget, sizeof(budget), "-");
+        }
+        mvwprintw(win, y++, 0, " %-10s %8s %8s %8zu %8s ", subsystem_names[i], live, peak, s.count, budget);
+    }
+    wattroff(win, A_REVERSE);
+}
+
+void alloc_arena_init(AllocArena *arena, AllocSubsystem subsystem, size_t block_size) {
+    arena->subsystem = subsystem;
+    arena->block_size = block_size;
+    arena->blocks = NULL;
+}
+
+void *alloc_arena_push(AllocArena *arena, size_t size) {
+    size = (size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > arena->block_size ? size : arena->block_size;
+        block = alloc_malloc(arena->subsystem, sizeof(ArenaBlock) + capacity);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->blocks = block;
+    }
+    void *memory = (char *)(block + 1) + block->used;
+    block->used += size;
+    return memory;
+}
+
+char *alloc_arena_strdup(AllocArena *arena, const char *text) {
+    size_t length = strlen(text);
+    char *copy = alloc_arena_push(arena, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length + 1);
+    }
+    return copy;
+}
+
+void alloc_arena_free(AllocArena *arena) {
+    while (arena->blocks != NULL) {
+        ArenaBlock *next = arena->blocks->next;
+        alloc_free(arena->blocks);
+        arena->blocks = next;
+    }
+}
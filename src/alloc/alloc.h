@@ -0,0 +1,80 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Who an allocation is charged to
+typedef enum AllocSubsystem {
+    ALLOC_TEXT,         // text being edited, its journal and copies of it
+    ALLOC_TEXT_INDEX,   // line, hash, bracket and minimap indexes over the text
+    ALLOC_DIFF,
+    ALLOC_EXPLORER,
+    ALLOC_PLAYGROUND,
+    ALLOC_IO,
+    ALLOC_SUBSYSTEM_COUNT
+} AllocSubsystem;
+
+typedef struct AllocStats {
+    size_t bytes;       // live, headers included
+    size_t peak;
+    size_t count;       // live allocations
+    size_t total;       // allocations ever made
+    size_t mapped;      // live bytes that had to come from mmap
+    size_t failures;    // requests refused after reclaiming
+    size_t budget;      // 0 for none
+} AllocStats;
+
+// Frees what it can of a cache that can be rebuilt later. It runs inside
+// the allocation that went over budget, on that thread, so it only frees
+// what no caller can be holding across an allocation of the same subsystem,
+// and never allocates. resizing is the block being grown, or NULL; the
+// cache that owns it is left whole.
+typedef void (*AllocReclaim)(void *context, const void *resizing);
+
+// budgets is "text=512M,explorer=64M" and the like; dump_path, when set,
+// gets the stats at alloc_shutdown
+void alloc_init(const char *budgets, const char *dump_path);
+void alloc_shutdown(void);
+// Writes the stats now to the dump path and returns 1. Without a path they
+// are kept and printed to stderr at alloc_shutdown, once the screen is gone,
+// and 0 is returned; -1 means they couldn't be written.
+int alloc_dump_now(void);
+
+// General allocation. An allocation or growth over the subsystem's budget,
+// or a new one malloc can't satisfy, first asks its reclaim callbacks to
+// drop caches. Whatever malloc still can't satisfy is tried once more with mmap.
+// NULL means all of it failed and the caller degrades.
+void *alloc_malloc(AllocSubsystem subsystem, size_t size);
+void *alloc_calloc(AllocSubsystem subsystem, size_t count, size_t size);
+void *alloc_realloc(AllocSubsystem subsystem, void *pointer, size_t size);
+char *alloc_strdup(AllocSubsystem subsystem, const char *text);
+char *alloc_strndup(AllocSubsystem subsystem, const char *text, size_t length);
+void alloc_free(void *pointer);
+
+void alloc_set_budget(AllocSubsystem subsystem, size_t bytes);
+void alloc_register_reclaim(AllocSubsystem subsystem, AllocReclaim reclaim, void *context);
+void alloc_unregister_reclaim(AllocReclaim reclaim, void *context);
+
+AllocStats alloc_stats(AllocSubsystem subsystem);
+const char *alloc_subsystem_name(AllocSubsystem subsystem);
+void alloc_dump(FILE *file);
+
+void alloc_toggle_panel(void);
+int alloc_panel_visible(void);
+// Per-subsystem table at the top-left corner of an ncurses WINDOW
+void alloc_draw_panel_window(void *window);
+
+// Bump allocation from chained blocks, all released together
+typedef struct AllocArena {
+    AllocSubsystem subsystem;
+    size_t block_size;
+    struct ArenaBlock *blocks;  // newest first
+} AllocArena;
+
+void alloc_arena_init(AllocArena *arena, AllocSubsystem subsystem, size_t block_size);
+void *alloc_arena_push(AllocArena *arena, size_t size);
+char *alloc_arena_strdup(AllocArena *arena, const char *text);
+void alloc_arena_free(AllocArena *arena);
+
+#endif
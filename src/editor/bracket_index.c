@@ -0,0 +1,378 @@
+#include "bracket_index.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include <limits.h>
+#include <string.h>
+
+#define BRACKET_CHUNK 4096
+#define BRACKET_NONE (INT_MAX / 2) // min of a chunk without bytes
+
+static const BracketSummary empty = { 0, 0, BRACKET_NONE, -BRACKET_NONE };
+
+static const signed char changes[256] = {
+    ['('] = 1, ['['] = 1, ['{'] = 1,
+    [')'] = -1, [']'] = -1, ['}'] = -1,
+};
+
+static inline int depth_change(char c) {
+    return changes[(unsigned char)c];
+}
+
+// Every byte is counted, brackets or not: another byte repeats the depth
+// before it, which only matters for a leading one and is exactly right then
+static BracketSummary summarize(const char *data, int length) {
+    BracketSummary summary = { length, 0, BRACKET_NONE, -BRACKET_NONE };
+    int depth = 0;
+    int min = BRACKET_NONE;
+    int max = -BRACKET_NONE;
+    for (int i = 0; i < length; i++) {
+        depth += depth_change(data[i]);
+        min = depth < min ? depth : min;
+        max = depth > max ? depth : max;
+    }
+    summary.delta = depth;
+    summary.min = min;
+    summary.max = max;
+    return summary;
+}
+
+static BracketSummary combine(BracketSummary a, BracketSummary b) {
+    BracketSummary summary;
+    summary.length = a.length + b.length;
+    summary.delta = a.delta + b.delta;
+    summary.min = a.min < a.delta + b.min ? a.min : a.delta + b.min;
+    summary.max = a.max > a.delta + b.max ? a.max : a.delta + b.max;
+    return summary;
+}
+
+static int rebuild_tree(BracketIndex *index) {
+    int leaves = 1;
+    while (leaves < index->count) {
+        leaves *= 2;
+    }
+    if (leaves != index->leaves) {
+        BracketSummary *tree = alloc_realloc(ALLOC_TEXT_INDEX, index->tree, 2 * leaves * sizeof(BracketSummary));
+        if (tree == NULL) {
+            return -1;
+        }
+        index->tree = tree;
+        index->leaves = leaves;
+    }
+    for (int i = 0; i < leaves; i++) {
+        index->tree[leaves + i] = i < index->count ? index->chunks[i] : empty;
+    }
+    for (int i = leaves - 1; i >= 1; i--) {
+        index->tree[i] = combine(index->tree[2 * i], index->tree[2 * i + 1]);
+    }
+    return 0;
+}
+
+static int reserve(BracketIndex *index, int count) {
+    if (count <= index->capacity) {
+        return 0;
+    }
+    int capacity = index->capacity ? index->capacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    BracketSummary *chunks = alloc_realloc(ALLOC_TEXT_INDEX, index->chunks, capacity * sizeof(BracketSummary));
+    if (chunks == NULL) {
+        return -1;
+    }
+    index->chunks = chunks;
+    index->capacity = capacity;
+    return 0;
+}
+
+// Fails when short of memory; the index stays stale and queries find nothing
+static int build(BracketIndex *index, const char *data, int size) {
+    PROF_SCOPE(PROF_BUFFER);
+    int count = size > 0 ? (size + BRACKET_CHUNK - 1) / BRACKET_CHUNK : 1;
+    if (reserve(index, count) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int start = i * BRACKET_CHUNK;
+        int length = size - start < BRACKET_CHUNK ? size - start : BRACKET_CHUNK;
+        index->chunks[i] = summarize(data + start, length);
+    }
+    index->count = count;
+    // A first tree allocation may reclaim the chunks just summarized
+    if (rebuild_tree(index) != 0 || index->chunks == NULL) {
+        return -1;
+    }
+    index->stale = 0;
+    return 0;
+}
+
+void bracket_index_init(BracketIndex *index) {
+    memset(index, 0, sizeof(*index));
+    index->stale = 1;
+}
+
+void bracket_index_free(BracketIndex *index) {
+    alloc_free(index->chunks);
+    alloc_free(index->tree);
+    memset(index, 0, sizeof(*index));
+}
+
+// Bulk changes drop the index; it is rebuilt when next asked
+void bracket_index_reset(BracketIndex *index) {
+    index->stale = 1;
+}
+
+// Chunk holding pos, with its start offset and the depth before it. An
+// offset at the very end belongs to the last chunk.
+static int locate(const BracketIndex *index, int pos, int *start, int *depth) {
+    const BracketSummary *root = &index->tree[1];
+    if (pos >= root->length) {
+        int last = index->count - 1;
+        *start = root->length - index->chunks[last].length;
+        *depth = root->delta - index->chunks[last].delta;
+        return last;
+    }
+    int node = 1;
+    *start = 0;
+    *depth = 0;
+    while (node < index->leaves) {
+        const BracketSummary *left = &index->tree[2 * node];
+        if (pos < left->length) {
+            node = 2 * node;
+        } else {
+            pos -= left->length;
+            *start += left->length;
+            *depth += left->delta;
+            node = 2 * node + 1;
+        }
+    }
+    return node - index->leaves;
+}
+
+static void update_leaf(BracketIndex *index, int chunk) {
+    int node = index->leaves + chunk;
+    index->tree[node] = index->chunks[chunk];
+    for (node /= 2; node >= 1; node /= 2) {
+        index->tree[node] = combine(index->tree[2 * node], index->tree[2 * node + 1]);
+    }
+}
+
+// A chunk that grew to twice the usual size is cut in half; the chunk list
+// shifts and the tree is rebuilt, which costs one pass over the summaries.
+// Without the memory for it the index goes stale instead.
+static void split(BracketIndex *index, const char *data, int chunk, int start) {
+    int length = index->chunks[chunk].length;
+    if (reserve(index, index->count + 1) != 0) {
+        index->stale = 1;
+        return;
+    }
+    memmove(index->chunks + chunk + 2, index->chunks + chunk + 1, (index->count - chunk - 1) * sizeof(BracketSummary));
+    index->chunks[chunk] = summarize(data + start, length / 2);
+    index->chunks[chunk + 1] = summarize(data + start + length / 2, length - length / 2);
+    index->count++;
+    if (rebuild_tree(index) != 0) {
+        index->stale = 1;
+    }
+}
+
+// Only a bracket, or a byte at the chunk start, can move its low or high point
+static void edited(BracketIndex *index, const char *data, int chunk, int start, int pos, char ch) {
+    if (depth_change(ch) != 0 || pos == start) {
+        index->chunks[chunk] = summarize(data + start, index->chunks[chunk].length);
+    }
+    if (index->chunks[chunk].length > 2 * BRACKET_CHUNK) {
+        split(index, data, chunk, start);
+    } else {
+        update_leaf(index, chunk);
+    }
+}
+
+void bracket_index_insert(BracketIndex *index, const char *data, int size, int pos, char ch) {
+    (void)size;
+    if (index->stale) {
+        return;
+    }
+    int start, depth;
+    int chunk = locate(index, pos, &start, &depth);
+    index->chunks[chunk].length++;
+    edited(index, data, chunk, start, pos, ch);
+}
+
+void bracket_index_delete(BracketIndex *index, const char *data, int size, int pos, char ch) {
+    (void)size;
+    if (index->stale) {
+        return;
+    }
+    int start, depth;
+    int chunk = locate(index, pos, &start, &depth);
+    index->chunks[chunk].length--;
+    edited(index, data, chunk, start, pos, ch);
+}
+
+static int depth_at(BracketIndex *index, const char *data, int pos) {
+    int start, depth;
+    locate(index, pos, &start, &depth);
+    for (int i = start; i < pos; i++) {
+        depth += depth_change(data[i]);
+    }
+    return depth;
+}
+
+// First byte at or after from that leaves the depth below target, or -1.
+// The rest of from's chunk is scanned, the tree finds the first later chunk
+// whose low point drops below target, and that chunk is scanned.
+static int search_forward(BracketIndex *index, const char *data, int from, int target) {
+    int start, depth;
+    int chunk = locate(index, from, &start, &depth);
+    int end = start + index->chunks[chunk].length;
+    for (int i = start; i < end; i++) {
+        depth += depth_change(data[i]);
+        if (i >= from && depth < target) {
+            return i;
+        }
+    }
+
+    int node = index->leaves + chunk;
+    int offset = end;
+    while (node > 1) {
+        if (node % 2 == 0 && depth + index->tree[node + 1].min < target) {
+            node++;
+            while (node < index->leaves) {
+                const BracketSummary *left = &index->tree[2 * node];
+                if (depth + left->min < target) {
+                    node = 2 * node;
+                } else {
+                    depth += left->delta;
+                    offset += left->length;
+                    node = 2 * node + 1;
+                }
+            }
+            for (int i = offset; i < offset + index->tree[node].length; i++) {
+                depth += depth_change(data[i]);
+                if (depth < target) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+        if (node % 2 == 0) {
+            depth += index->tree[node + 1].delta;
+            offset += index->tree[node + 1].length;
+        }
+        node /= 2;
+    }
+    return -1;
+}
+
+// Last byte before from that leaves the depth below target, or -1
+static int search_backward(BracketIndex *index, const char *data, int from, int target) {
+    if (from <= 0) {
+        return -1;
+    }
+    int start, depth;
+    int chunk = locate(index, from - 1, &start, &depth);
+    int found = -1;
+    int scan = depth;
+    for (int i = start; i < from; i++) {
+        scan += depth_change(data[i]);
+        if (scan < target) {
+            found = i;
+        }
+    }
+    if (found >= 0) {
+        return found;
+    }
+
+    int node = index->leaves + chunk;
+    int offset = start;
+    while (node > 1) {
+        if (node % 2 == 1) {
+            const BracketSummary *sibling = &index->tree[node - 1];
+            depth -= sibling->delta;
+            offset -= sibling->length;
+            if (depth + sibling->min < target) {
+                node--;
+                while (node < index->leaves) {
+                    const BracketSummary *left = &index->tree[2 * node];
+                    const BracketSummary *right = &index->tree[2 * node + 1];
+                    if (depth + left->delta + right->min < target) {
+                        depth += left->delta;
+                        offset += left->length;
+                        node = 2 * node + 1;
+                    } else {
+                        node = 2 * node;
+                    }
+                }
+                for (int i = offset; i < offset + index->tree[node].length; i++) {
+                    depth += depth_change(data[i]);
+                    if (depth < target) {
+                        found = i;
+                    }
+                }
+                return found;
+            }
+        }
+        node /= 2;
+    }
+    return -1;
+}
+
+// Largest j before pos whose depth is below target: the opening bracket
+// that starts the block target deep
+static int opening_before(BracketIndex *index, const char *data, int pos, int target) {
+    if (pos <= 0) {
+        return -1;
+    }
+    int byte = search_backward(index, data, pos - 1, target);
+    if (byte >= 0) {
+        return byte + 1;
+    }
+    return target > 0 ? 0 : -1;
+}
+
+static int partners(char open, char close) {
+    return (open == '(' && close == ')') || (open == '[' && close == ']') || (open == '{' && close == '}');
+}
+
+int bracket_match(BracketIndex *index, const char *data, int size, int pos) {
+    if (pos < 0 || pos >= size || depth_change(data[pos]) == 0) {
+        return -1;
+    }
+    if (index->stale && build(index, data, size) != 0) {
+        return -1;
+    }
+
+    int depth = depth_at(index, data, pos);
+    int match;
+    if (depth_change(data[pos]) > 0) {
+        match = search_forward(index, data, pos + 1, depth + 1);
+        return match >= 0 && partners(data[pos], data[match]) ? match : -1;
+    }
+    match = opening_before(index, data, pos, depth);
+    return match >= 0 && partners(data[match], data[pos]) ? match : -1;
+}
+
+// From an opening bracket this is the block around it, so repeating the
+// jump walks outward
+int bracket_block_start(BracketIndex *index, const char *data, int size, int pos) {
+    if (pos < 0 || pos > size) {
+        return -1;
+    }
+    if (index->stale && build(index, data, size) != 0) {
+        return -1;
+    }
+    return opening_before(index, data, pos, depth_at(index, data, pos));
+}
+
+// A closing bracket counts as outside its block, likewise
+int bracket_block_end(BracketIndex *index, const char *data, int size, int pos) {
+    if (pos < 0 || pos >= size) {
+        return -1;
+    }
+    if (index->stale && build(index, data, size) != 0) {
+        return -1;
+    }
+    if (depth_change(data[pos]) < 0) {
+        pos++;
+    }
+    return pos < size ? search_forward(index, data, pos, depth_at(index, data, pos)) : -1;
+}
@@ -0,0 +1,40 @@
+#ifndef BRACKET_INDEX_H
+#define BRACKET_INDEX_H
+
+// Bracket depth over the text in chunks of a few KB. Each chunk keeps its
+// length, net depth change and the lowest and highest depth reached inside
+// it; a segment tree over the chunks combines them, so a match anywhere in
+// the file is found by walking the tree and scanning two chunks at most.
+// All three kinds of bracket share one depth; strings and comments are not
+// told apart.
+typedef struct BracketSummary {
+    int length;
+    int delta;
+    int min;     // lowest depth after any byte, relative to the chunk start
+    int max;
+} BracketSummary;
+
+typedef struct BracketIndex {
+    BracketSummary *chunks;
+    int count;
+    int capacity;
+    BracketSummary *tree;   // node i has children 2i and 2i + 1, leaves from `leaves`
+    int leaves;
+    int stale;              // rebuilt from the text on the next query
+} BracketIndex;
+
+void bracket_index_init(BracketIndex *index);
+void bracket_index_free(BracketIndex *index);
+void bracket_index_reset(BracketIndex *index);
+
+// Called after the byte ch was inserted at or deleted from pos
+void bracket_index_insert(BracketIndex *index, const char *data, int size, int pos, char ch);
+void bracket_index_delete(BracketIndex *index, const char *data, int size, int pos, char ch);
+
+// Offsets of the partner of the bracket at pos, and of the brackets around
+// the innermost block holding pos; -1 when there is none
+int bracket_match(BracketIndex *index, const char *data, int size, int pos);
+int bracket_block_start(BracketIndex *index, const char *data, int size, int pos);
+int bracket_block_end(BracketIndex *index, const char *data, int size, int pos);
+
+#endif
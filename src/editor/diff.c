@@ -0,0 +1,382 @@
+#include "diff.h"
+#include "../alloc/alloc.h"
+#include <string.h>
+
+#define DIFF_MIN_COST 256
+#define DIFF_FREQUENT_MIN_LINES (1 << 14)   // below this frequent lines still anchor
+#define DIFF_FAR 0x7fffffff
+
+typedef struct Context {
+    const uint64_t *a;
+    const uint64_t *b;
+    unsigned char *changed_a;
+    unsigned char *changed_b;
+    int *forward;   // furthest x reached on each diagonal, indexed by x - y
+    int *backward;
+    int max_cost;
+    const int *cancel;
+} Context;
+
+typedef struct Split {
+    int x;
+    int y;
+} Split;
+
+// Finds the middle snake of a[x0, x1) against b[y0, y1) by searching from
+// both ends at once; past max_cost edits it settles for the furthest point
+// either search has reached
+static void split(Context *ctx, int x0, int x1, int y0, int y1, Split *out) {
+    int *fwd = ctx->forward;
+    int *bwd = ctx->backward;
+    int dmin = x0 - y1;
+    int dmax = x1 - y0;
+    int fmid = x0 - y0;
+    int bmid = x1 - y1;
+    int odd = (fmid - bmid) & 1;
+    int fmin = fmid, fmax = fmid;
+    int bmin = bmid, bmax = bmid;
+
+    fwd[fmid] = x0;
+    bwd[bmid] = x1;
+
+    for (int cost = 1;; cost++) {
+        if (fmin > dmin) fwd[--fmin - 1] = -1; else fmin++;
+        if (fmax < dmax) fwd[++fmax + 1] = -1; else fmax--;
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int x = fwd[d - 1] >= fwd[d + 1] ? fwd[d - 1] + 1 : fwd[d + 1];
+            int y = x - d;
+            while (x < x1 && y < y1 && ctx->a[x] == ctx->b[y]) {
+                x++;
+                y++;
+            }
+            fwd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bwd[d] <= x) {
+                out->x = x;
+                out->y = y;
+                return;
+            }
+        }
+
+        if (bmin > dmin) bwd[--bmin - 1] = DIFF_FAR; else bmin++;
+        if (bmax < dmax) bwd[++bmax + 1] = DIFF_FAR; else bmax--;
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int x = bwd[d - 1] < bwd[d + 1] ? bwd[d - 1] : bwd[d + 1] - 1;
+            int y = x - d;
+            while (x > x0 && y > y0 && ctx->a[x - 1] == ctx->b[y - 1]) {
+                x--;
+                y--;
+            }
+            bwd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fwd[d]) {
+                out->x = x;
+                out->y = y;
+                return;
+            }
+        }
+
+        if (cost >= ctx->max_cost || (ctx->cancel && __atomic_load_n(ctx->cancel, __ATOMIC_RELAXED))) {
+            int fbest = -1, fbest_x = x0;
+            for (int d = fmax; d >= fmin; d -= 2) {
+                int x = fwd[d] < x1 ? fwd[d] : x1;
+                int y = x - d;
+                if (y > y1) {
+                    x = y1 + d;
+                    y = y1;
+                }
+                if (x + y > fbest) {
+                    fbest = x + y;
+                    fbest_x = x;
+                }
+            }
+            int bbest = DIFF_FAR, bbest_x = x1;
+            for (int d = bmax; d >= bmin; d -= 2) {
+                int x = bwd[d] > x0 ? bwd[d] : x0;
+                int y = x - d;
+                if (y < y0) {
+                    x = y0 + d;
+                    y = y0;
+                }
+                if (x + y < bbest) {
+                    bbest = x + y;
+                    bbest_x = x;
+                }
+            }
+            if ((x1 + y1) - bbest < fbest - (x0 + y0)) {
+                out->x = fbest_x;
+                out->y = fbest - fbest_x;
+            } else {
+                out->x = bbest_x;
+                out->y = bbest - bbest_x;
+            }
+            return;
+        }
+    }
+}
+
+// Marks the lines of a[x0, x1) and b[y0, y1) that aren't in the common
+// subsequence, trimming shared ends before each split
+static void compare(Context *ctx, int x0, int x1, int y0, int y1) {
+    while (x0 < x1 && y0 < y1 && ctx->a[x0] == ctx->b[y0]) {
+        x0++;
+        y0++;
+    }
+    while (x0 < x1 && y0 < y1 && ctx->a[x1 - 1] == ctx->b[y1 - 1]) {
+        x1--;
+        y1--;
+    }
+
+    if (x0 == x1) {
+        memset(ctx->changed_b + y0, 1, y1 - y0);
+    } else if (y0 == y1) {
+        memset(ctx->changed_a + x0, 1, x1 - x0);
+    } else {
+        Split mid;
+        split(ctx, x0, x1, y0, y1, &mid);
+        compare(ctx, x0, mid.x, y0, mid.y);
+        compare(ctx, mid.x, x1, mid.y, y1);
+    }
+}
+
+static int add_hunk(DiffResult *result, int old_start, int old_count, int new_start, int new_count) {
+    if (result->count == result->capacity) {
+        int capacity = result->capacity ? result->capacity * 2 : 64;
+        DiffHunk *hunks = alloc_realloc(ALLOC_DIFF, result->hunks, capacity * sizeof(DiffHunk));
+        if (hunks == NULL) {
+            return -1;
+        }
+        result->hunks = hunks;
+        result->capacity = capacity;
+    }
+    result->hunks[result->count++] = (DiffHunk){ old_start, old_count, new_start, new_count };
+    return 0;
+}
+
+// Open-addressing count of every hash on one side
+typedef struct HashCounts {
+    uint64_t *slots;
+    int *counts;    // 0 marks a free slot
+    size_t mask;
+} HashCounts;
+
+static int hash_counts_build(HashCounts *set, const uint64_t *hashes, int count) {
+    size_t size = 64;
+    while (size < (size_t)count * 2) size *= 2;
+    set->slots = alloc_malloc(ALLOC_DIFF, size * sizeof(uint64_t));
+    set->counts = alloc_calloc(ALLOC_DIFF, size, sizeof(int));
+    set->mask = size - 1;
+    if (set->slots == NULL || set->counts == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t slot = hashes[i] & set->mask;
+        while (set->counts[slot] && set->slots[slot] != hashes[i]) {
+            slot = (slot + 1) & set->mask;
+        }
+        set->slots[slot] = hashes[i];
+        set->counts[slot]++;
+    }
+    return 0;
+}
+
+static int hash_counts_get(const HashCounts *set, uint64_t hash) {
+    size_t slot = hash & set->mask;
+    while (set->counts[slot]) {
+        if (set->slots[slot] == hash) return set->counts[slot];
+        slot = (slot + 1) & set->mask;
+    }
+    return 0;
+}
+
+static void hash_counts_free(HashCounts *set) {
+    alloc_free(set->slots);
+    alloc_free(set->counts);
+}
+
+// Powers of two near the square root, like xdiff's bogosqrt
+static int rough_sqrt(long long n) {
+    int root = 1;
+    for (; n > 0; n >>= 2) root <<= 1;
+    return root;
+}
+
+// Picks the lines the search runs on. A line whose hash never occurs on the
+// other side can't be part of the common subsequence, so it is marked
+// changed up front; typical edits shrink the problem to a small fraction.
+// Lines occurring more than about sqrt(N) times on the other side, blank
+// lines and lone braces mostly, are left out as well, since they make the
+// search crawl without anchoring anything; they are matched up afterwards
+// in the gaps between anchors. Small inputs keep them, as the full search
+// is cheap there and stays minimal.
+static int keep_anchors(const uint64_t *hashes, int count, const uint64_t *other, int other_count,
+                        unsigned char *changed, uint64_t *kept, int *index) {
+    HashCounts set;
+    if (hash_counts_build(&set, other, other_count) != 0) {
+        hash_counts_free(&set);
+        return -1;
+    }
+    int limit = count + other_count < DIFF_FREQUENT_MIN_LINES ? other_count : rough_sqrt((long long)count + other_count);
+    int kept_count = 0;
+    for (int i = 0; i < count; i++) {
+        int occurrences = hash_counts_get(&set, hashes[i]);
+        if (occurrences == 0) {
+            changed[i] = 1;
+        } else if (occurrences <= limit) {
+            kept[kept_count] = hashes[i];
+            index[kept_count++] = i;
+        }
+    }
+    hash_counts_free(&set);
+    return kept_count;
+}
+
+// Settles the lines between two matched anchors. A gap small enough gets a
+// search of its own, a larger one only keeps its shared ends, so the whole
+// pass stays linear in the input.
+static void align_gap(Context *ctx, int *diagonal_buffer, int gap_limit, int x0, int x1, int y0, int y1) {
+    while (x0 < x1 && y0 < y1 && ctx->a[x0] == ctx->b[y0]) {
+        ctx->changed_a[x0++] = 0;
+        ctx->changed_b[y0++] = 0;
+    }
+    while (x0 < x1 && y0 < y1 && ctx->a[x1 - 1] == ctx->b[y1 - 1]) {
+        ctx->changed_a[--x1] = 0;
+        ctx->changed_b[--y1] = 0;
+    }
+    memset(ctx->changed_a + x0, 0, x1 - x0);
+    memset(ctx->changed_b + y0, 0, y1 - y0);
+    if ((x1 - x0) + (y1 - y0) <= gap_limit) {
+        // Diagonals of the gap run from x0 - y1 - 1 to x1 - y0 + 1
+        int diagonals = (x1 - x0) + (y1 - y0) + 3;
+        ctx->forward = diagonal_buffer + (y1 - x0) + 1;
+        ctx->backward = diagonal_buffer + diagonals + (y1 - x0) + 1;
+        compare(ctx, x0, x1, y0, y1);
+    } else {
+        memset(ctx->changed_a + x0, 1, x1 - x0);
+        memset(ctx->changed_b + y0, 1, y1 - y0);
+    }
+}
+
+int diff_lines(const uint64_t *old_hashes, int old_count, const uint64_t *new_hashes, int new_count,
+               const int *cancel, DiffResult *result) {
+    memset(result, 0, sizeof(*result));
+
+    unsigned char *changed_old = alloc_calloc(ALLOC_DIFF, old_count + 1, 1);
+    unsigned char *changed_new = alloc_calloc(ALLOC_DIFF, new_count + 1, 1);
+    uint64_t *kept = alloc_malloc(ALLOC_DIFF, (size_t)(old_count + new_count + 1) * sizeof(uint64_t));
+    int *index = alloc_malloc(ALLOC_DIFF, (size_t)(old_count + new_count + 1) * sizeof(int));
+    int n = -1, m = -1;
+    if (changed_old && changed_new && kept && index) {
+        n = keep_anchors(old_hashes, old_count, new_hashes, new_count, changed_old, kept, index);
+        m = n < 0 ? -1 : keep_anchors(new_hashes, new_count, old_hashes, old_count, changed_new, kept + n, index + n);
+    }
+
+    // Diagonals run from -(m + 1) to n + 1
+    int diagonals = n + m + 3;
+    Context ctx = { kept, kept + (n > 0 ? n : 0), NULL, NULL, NULL, NULL, 0, cancel };
+    int *diagonal_buffer = NULL;
+    if (m >= 0) {
+        ctx.changed_a = alloc_calloc(ALLOC_DIFF, n + 1, 1);
+        ctx.changed_b = alloc_calloc(ALLOC_DIFF, m + 1, 1);
+        diagonal_buffer = alloc_malloc(ALLOC_DIFF, 2 * (size_t)diagonals * sizeof(int));
+    }
+    if (m < 0 || ctx.changed_a == NULL || ctx.changed_b == NULL || diagonal_buffer == NULL) {
+        alloc_free(ctx.changed_a);
+        alloc_free(ctx.changed_b);
+        alloc_free(diagonal_buffer);
+        alloc_free(changed_old);
+        alloc_free(changed_new);
+        alloc_free(kept);
+        alloc_free(index);
+        return -1;
+    }
+    ctx.forward = diagonal_buffer + m + 1;
+    ctx.backward = diagonal_buffer + diagonals + m + 1;
+
+    // Same budget as xdiff: about the square root of the input size
+    ctx.max_cost = 1;
+    while ((long long)ctx.max_cost * ctx.max_cost < diagonals) {
+        ctx.max_cost *= 2;
+    }
+    if (ctx.max_cost < DIFF_MIN_COST) {
+        ctx.max_cost = DIFF_MIN_COST;
+    }
+
+    compare(&ctx, 0, n, 0, m);
+    for (int i = 0; i < n; i++) {
+        changed_old[index[i]] = ctx.changed_a[i];
+    }
+    for (int i = 0; i < m; i++) {
+        changed_new[index[n + i]] = ctx.changed_b[i];
+    }
+
+    alloc_free(diagonal_buffer);
+
+    // The k-th matched anchor of one side pairs with the k-th of the other;
+    // every gap between pairs is aligned on the full line hashes. Without
+    // memory for that the gaps keep only their shared ends.
+    int gap_limit = ctx.max_cost;
+    diagonal_buffer = alloc_malloc(ALLOC_DIFF, 2 * (size_t)(gap_limit + 3) * sizeof(int));
+    if (diagonal_buffer == NULL) {
+        gap_limit = 0;
+    }
+    Context gap = { old_hashes, new_hashes, changed_old, changed_new, NULL, NULL, ctx.max_cost, cancel };
+    int x = 0, y = 0;
+    for (int i = 0, j = 0; i <= n; i++, j++) {
+        while (i < n && ctx.changed_a[i]) i++;
+        while (j < m && ctx.changed_b[j]) j++;
+        int x1 = i < n ? index[i] : old_count;
+        int y1 = j < m ? index[n + j] : new_count;
+        align_gap(&gap, diagonal_buffer, gap_limit, x, x1, y, y1);
+        x = x1 + 1;
+        y = y1 + 1;
+    }
+    alloc_free(diagonal_buffer);
+    alloc_free(ctx.changed_a);
+    alloc_free(ctx.changed_b);
+    alloc_free(kept);
+    alloc_free(index);
+
+    int status = cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED) ? -1 : 0;
+    x = 0;
+    y = 0;
+    while (status == 0 && (x < old_count || y < new_count)) {
+        if (x < old_count && y < new_count && !changed_old[x] && !changed_new[y]) {
+            x++;
+            y++;
+            continue;
+        }
+        int old_start = x, new_start = y;
+        while (x < old_count && changed_old[x]) x++;
+        while (y < new_count && changed_new[y]) y++;
+        status = add_hunk(result, old_start, x - old_start, new_start, y - new_start);
+    }
+
+    alloc_free(changed_old);
+    alloc_free(changed_new);
+    if (status != 0) {
+        diff_free(result);
+    }
+    return status;
+}
+
+void diff_free(DiffResult *result) {
+    alloc_free(result->hunks);
+    result->hunks = NULL;
+    result->count = 0;
+    result->capacity = 0;
+}
+
+// Eight bytes per step; lines only need to tell apart, not resist attack
+uint64_t diff_hash(const char *data, int length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (uint64_t)length;
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 29);
+}
@@ -0,0 +1,33 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stdint.h>
+
+// One changed region: old lines [old_start, old_start + old_count) were
+// replaced by new lines [new_start, new_start + new_count). Everything
+// between hunks is equal, line for line.
+typedef struct DiffHunk {
+    int old_start;
+    int old_count;
+    int new_start;
+    int new_count;
+} DiffHunk;
+
+typedef struct DiffResult {
+    DiffHunk *hunks;
+    int count;
+    int capacity;
+} DiffResult;
+
+// Linear-space Myers diff over line hashes. Very different inputs switch
+// to a cheaper split past a cost limit, and on large inputs lines repeated
+// very often are only matched between the others, both trading a minimal
+// script for time.
+// Returns -1 when out of memory or when *cancel becomes non-zero.
+int diff_lines(const uint64_t *old_hashes, int old_count, const uint64_t *new_hashes, int new_count,
+               const int *cancel, DiffResult *result);
+void diff_free(DiffResult *result);
+
+uint64_t diff_hash(const char *data, int length);
+
+#endif
@@ -0,0 +1,29 @@
+#include "edit_span.h"
+
+void edit_span_clear(EditSpan *span) {
+    span->active = 0;
+    span->start = 0;
+    span->end = 0;
+    span->delta = 0;
+}
+
+// pos and the span are in post-edit offsets. An edit before the span's end
+// shifts it; one past the end stretches it to cover the bytes between.
+void edit_span_add(EditSpan *span, int pos, int removed, int inserted) {
+    span->delta += inserted - removed;
+    if (!span->active) {
+        span->active = 1;
+        span->start = pos;
+        span->end = pos + inserted;
+        return;
+    }
+    if (pos < span->end) {
+        span->end += inserted - removed;
+    }
+    if (span->end < pos + inserted) {
+        span->end = pos + inserted;
+    }
+    if (pos < span->start) {
+        span->start = pos;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef EDIT_SPAN_H
+#define EDIT_SPAN_H
+
+// The smallest byte range covering every edit since it was last cleared, in
+// current offsets. Text outside it is unchanged, only shifted by delta past
+// the end.
+typedef struct EditSpan {
+    int active;
+    int start;
+    int end;
+    int delta;
+} EditSpan;
+
+void edit_span_clear(EditSpan *span);
+void edit_span_add(EditSpan *span, int pos, int removed, int inserted);
+
+#endif
@@ -1,33 +1,57 @@
 #include "editor.h"
+#include "../profiler/profiler.h"
+#include "../io/io.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 void open_editor(Editor *editor) {
-    FILE *file = fopen(editor->path, "r");
-    if (file == NULL)
+    // Open, size and read go through the batched I/O queue
+    long long size = 0;
+    char *buffer = io_read_file(io_default_queue(), ALLOC_TEXT, editor->path, &size);
+    if (buffer == NULL)
     {
-        fprintf(stderr, "Error: Could not open file '%s'\n", editor->path);
+        fprintf(stderr, "Error: Could not open file '%s': %s\n", editor->path, strerror(errno));
+        return;
     }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long capacity = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    editor->buffer.buffer = buffer;
+    editor->buffer.size = size;
+    editor->buffer.capacity = size + 1;
+}
 
-    // Allocate memory for the buffer (+1 for null terminator)
-    char* buffer = (char*)malloc(capacity + 1);
-    if (buffer == NULL) {
-        fclose(file);
-        exit(1);
+// Copies a file to out_fd straight from a mapping, without a heap copy
+long long print_file_mapped(const char *path, int out_fd) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
     }
-    
-    // Read file content into buffer
-    size_t size = fread(buffer, 1, capacity, file);
-    buffer[size] = '\0'; // Add null terminator
-    
-    fclose(file);
 
-    editor->buffer.buffer = buffer;
-    editor->buffer.size = size;
-    editor->buffer.capacity = capacity + 1;
-}
\ No newline at end of file
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    long long written = 0;
+    while (written < st.st_size) {
+        ssize_t n = write(out_fd, data + written, st.st_size - written);
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    munmap(data, st.st_size);
+    return written;
+}
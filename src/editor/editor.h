@@ -1,17 +1,14 @@
 #ifndef EDITOR_H
 #define EDITOR_H
 
+#include "selection.h"
+
 typedef struct Buffer {
     char *buffer;
     int size;
     int capacity;
 } Buffer;
 
-typedef struct Cursor {
-    int x;
-    int y;
-} Cursor;
-
 typedef struct Viewport {
     int x;
     int y;
@@ -19,16 +16,12 @@ typedef struct Viewport {
     int height;
 } Viewport;
 
-typedef struct Selection {
-    Cursor start;
-    Cursor end;
-} Selection;
-
 typedef struct Editor {
     char* path;
     Buffer buffer;
 } Editor;
 
 void open_editor(Editor *editor);
+long long print_file_mapped(const char *path, int out_fd);
 
 #endif
\ No newline at end of file
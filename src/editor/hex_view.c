@@ -0,0 +1,123 @@
+#include "hex_view.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int hex_view_open(HexView *view, const char *path) {
+    view->fd = open(path, O_RDONLY);
+    view->window = NULL;
+    view->window_offset = 0;
+    view->window_length = 0;
+    if (view->fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(view->fd, &st) != 0) {
+        close(view->fd);
+        return -1;
+    }
+    view->size = st.st_size;
+    return 0;
+}
+
+void hex_view_close(HexView *view) {
+    if (view->window) {
+        munmap(view->window, view->window_length);
+    }
+    if (view->fd >= 0) {
+        close(view->fd);
+    }
+    view->window = NULL;
+    view->fd = -1;
+}
+
+long long hex_view_rows(const HexView *view) {
+    return (view->size + HEX_ROW_BYTES - 1) / HEX_ROW_BYTES;
+}
+
+// Maps the window holding [offset, offset + length), remapping only when the row leaves it
+static const unsigned char *window_at(HexView *view, long long offset, size_t length) {
+    if (view->window && offset >= view->window_offset
+        && offset + (long long)length <= view->window_offset + (long long)view->window_length) {
+        return view->window + (offset - view->window_offset);
+    }
+
+    if (view->window) {
+        munmap(view->window, view->window_length);
+        view->window = NULL;
+    }
+
+    // Windows start on a boundary so neighbouring rows share a mapping
+    long long start = offset - offset % HEX_WINDOW_SIZE;
+    size_t window_length = HEX_WINDOW_SIZE;
+    if (offset + (long long)length > start + HEX_WINDOW_SIZE) {
+        window_length *= 2;
+    }
+    if (start + (long long)window_length > view->size) {
+        window_length = view->size - start;
+    }
+
+    void *map = mmap(NULL, window_length, PROT_READ, MAP_PRIVATE, view->fd, start);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, window_length, MADV_SEQUENTIAL);
+    view->window = map;
+    view->window_offset = start;
+    view->window_length = window_length;
+    return view->window + (offset - start);
+}
+
+int hex_view_format_row(HexView *view, long long row, char *out, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    long long offset = row * HEX_ROW_BYTES;
+    if (offset >= view->size || size < HEX_ROW_WIDTH) {
+        return 0;
+    }
+
+    size_t count = view->size - offset < HEX_ROW_BYTES ? view->size - offset : HEX_ROW_BYTES;
+    const unsigned char *bytes = window_at(view, offset, count);
+    if (bytes == NULL) {
+        return 0;
+    }
+
+    int length = snprintf(out, size, "%010llx  ", offset);
+    for (size_t i = 0; i < HEX_ROW_BYTES; i++) {
+        if (i < count) {
+            out[length++] = digits[bytes[i] >> 4];
+            out[length++] = digits[bytes[i] & 15];
+        } else {
+            out[length++] = ' ';
+            out[length++] = ' ';
+        }
+        out[length++] = ' ';
+        if (i == 7) {
+            out[length++] = ' ';
+        }
+    }
+    out[length++] = '|';
+    for (size_t i = 0; i < count; i++) {
+        out[length++] = bytes[i] >= 0x20 && bytes[i] < 0x7f ? bytes[i] : '.';
+    }
+    out[length++] = '|';
+    out[length] = '\0';
+    return length;
+}
+
+long long hex_view_print(HexView *view, FILE *out) {
+    char line[HEX_ROW_WIDTH + 1];
+    long long written = 0;
+    long long rows = hex_view_rows(view);
+    for (long long row = 0; row < rows; row++) {
+        int length = hex_view_format_row(view, row, line, sizeof(line));
+        if (length == 0) {
+            break;
+        }
+        line[length++] = '\n';
+        written += fwrite(line, 1, length, out);
+    }
+    return written;
+}
@@ -0,0 +1,28 @@
+#ifndef HEX_VIEW_H
+#define HEX_VIEW_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define HEX_ROW_BYTES 16
+// "offset  16 hex pairs  |ascii|" plus the terminator
+#define HEX_ROW_WIDTH 80
+#define HEX_WINDOW_SIZE (4 << 20)
+
+// Fixed-width rows rendered from a sliding mmap window, so any row costs
+// the same to draw no matter how large the file is
+typedef struct HexView {
+    int fd;
+    long long size;
+    unsigned char *window;
+    long long window_offset;
+    size_t window_length;
+} HexView;
+
+int hex_view_open(HexView *view, const char *path);
+void hex_view_close(HexView *view);
+long long hex_view_rows(const HexView *view);
+int hex_view_format_row(HexView *view, long long row, char *out, size_t size);
+long long hex_view_print(HexView *view, FILE *out);
+
+#endif
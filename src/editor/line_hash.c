@@ -0,0 +1,112 @@
+#include "line_hash.h"
+#include "diff.h"
+#include "../alloc/alloc.h"
+#include <string.h>
+
+static int reserve(LineHashes *hashes, int count) {
+    if (count <= hashes->capacity) {
+        return 0;
+    }
+    int capacity = hashes->capacity ? hashes->capacity : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    uint64_t *grown = alloc_realloc(ALLOC_TEXT_INDEX, hashes->hashes, capacity * sizeof(uint64_t));
+    if (grown == NULL) {
+        return -1;
+    }
+    hashes->hashes = grown;
+    hashes->capacity = capacity;
+    return 0;
+}
+
+void line_hashes_init(LineHashes *hashes) {
+    hashes->hashes = NULL;
+    hashes->count = 0;
+    hashes->capacity = 0;
+    line_hashes_reset(hashes);
+}
+
+void line_hashes_free(LineHashes *hashes) {
+    alloc_free(hashes->hashes);
+    hashes->hashes = NULL;
+    hashes->count = 0;
+    hashes->capacity = 0;
+}
+
+// The text was replaced wholesale; nothing is hashed until someone asks
+void line_hashes_reset(LineHashes *hashes) {
+    hashes->stale = 1;
+    edit_span_clear(&hashes->dirty);
+}
+
+void line_hashes_edit(LineHashes *hashes, int pos, int removed, int inserted) {
+    if (!hashes->stale) {
+        edit_span_add(&hashes->dirty, pos, removed, inserted);
+    }
+}
+
+uint64_t line_hash_at(LineIndex *index, const char *data, int size, int line) {
+    int start = line_index_start(index, data, size, line);
+    int end = line_index_start(index, data, size, line + 1);
+    return diff_hash(data + start, end - start);
+}
+
+// Lines before the span's first line and after its last are byte-for-byte
+// what they were, so only the lines in between are rehashed and the tail
+// slides to its new line numbers. Returns how many lines were rehashed, or -1
+// when there was no memory for the table and it is left stale.
+int line_hashes_sync(LineHashes *hashes, LineIndex *index, const char *data, int size, int *first) {
+    if (!hashes->stale && !hashes->dirty.active) {
+        *first = 0;
+        return 0;
+    }
+
+    // Lookups can grow the line index, which may reclaim this table, so they
+    // all come first and a table dropped meanwhile is rehashed whole
+    int from = 0;
+    int to = index->count - 1;
+    if (!hashes->stale) {
+        int end = hashes->dirty.end < size ? hashes->dirty.end : size;
+        from = line_index_line_of(index, data, size, hashes->dirty.start);
+        to = line_index_line_of(index, data, size, end);
+    }
+    int start = line_index_start(index, data, size, from);
+    if (hashes->stale) {
+        from = 0;
+        to = index->count - 1;
+        start = 0;
+        hashes->count = 0;
+    }
+
+    int tail = index->count - to - 1;
+    if (reserve(hashes, index->count) != 0) {
+        line_hashes_reset(hashes);
+        return -1;
+    }
+    memmove(hashes->hashes + to + 1, hashes->hashes + hashes->count - tail, tail * sizeof(uint64_t));
+    for (int line = from; line <= to; line++) {
+        const char *newline = memchr(data + start, '\n', size - start);
+        int end = newline != NULL ? (int)(newline - data) + 1 : size;
+        hashes->hashes[line] = diff_hash(data + start, end - start);
+        start = end;
+    }
+    hashes->count = index->count;
+    hashes->stale = 0;
+    edit_span_clear(&hashes->dirty);
+    *first = from;
+    return to - from + 1;
+}
+
+// Takes over hashes already computed for the current text, or leaves the
+// table stale when they don't fit
+void line_hashes_assign(LineHashes *hashes, const uint64_t *values, int count) {
+    if (reserve(hashes, count) != 0) {
+        line_hashes_reset(hashes);
+        return;
+    }
+    memcpy(hashes->hashes, values, count * sizeof(uint64_t));
+    hashes->count = count;
+    hashes->stale = 0;
+    edit_span_clear(&hashes->dirty);
+}
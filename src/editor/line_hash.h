@@ -0,0 +1,27 @@
+#ifndef LINE_HASH_H
+#define LINE_HASH_H
+
+#include "line_index.h"
+#include "edit_span.h"
+#include <stdint.h>
+
+// Hash of every line, newline included, kept beside a LineIndex. Edits only
+// widen a dirty byte span, so typing costs nothing extra; line_hashes_sync
+// rehashes the lines inside the span and shifts the untouched tail.
+typedef struct LineHashes {
+    uint64_t *hashes;
+    int count;
+    int capacity;
+    int stale;        // every hash needs recomputing
+    EditSpan dirty;   // edits since the last sync
+} LineHashes;
+
+void line_hashes_init(LineHashes *hashes);
+void line_hashes_free(LineHashes *hashes);
+void line_hashes_reset(LineHashes *hashes);
+void line_hashes_edit(LineHashes *hashes, int pos, int removed, int inserted);
+int line_hashes_sync(LineHashes *hashes, LineIndex *index, const char *data, int size, int *first);
+void line_hashes_assign(LineHashes *hashes, const uint64_t *values, int count);
+uint64_t line_hash_at(LineIndex *index, const char *data, int size, int line);
+
+#endif
@@ -0,0 +1,155 @@
+#include "line_index.h"
+#include "scan.h"
+#include "../alloc/alloc.h"
+#include <string.h>
+
+static int reserve(LineIndex *index, int count) {
+    if (count <= index->capacity) {
+        return 0;
+    }
+    int capacity = index->capacity ? index->capacity : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    int *starts = alloc_realloc(ALLOC_TEXT_INDEX, index->starts, capacity * sizeof(int));
+    if (starts == NULL) {
+        return -1;
+    }
+    index->starts = starts;
+    index->capacity = capacity;
+    return 0;
+}
+
+// Rescans forward from the last valid start until line is covered. Short of
+// memory the table stays as it is and lookups past it scan the text.
+static void extend(LineIndex *index, const char *data, int size, int line) {
+    if (line >= index->count) {
+        line = index->count - 1;
+    }
+    if (line < index->valid || reserve(index, line + 1) != 0) {
+        return;
+    }
+    index->valid += scan_line_starts(data, index->starts[index->valid - 1], size,
+                                     index->starts + index->valid, line + 1 - index->valid);
+}
+
+// Fails only when even the first line's start can't be allocated
+int line_index_init(LineIndex *index) {
+    index->starts = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->valid = 0;
+    if (reserve(index, 1) != 0) {
+        return -1;
+    }
+    index->starts[0] = 0;
+    index->count = 1;
+    index->valid = 1;
+    return 0;
+}
+
+void line_index_free(LineIndex *index) {
+    alloc_free(index->starts);
+    index->starts = NULL;
+    index->count = 0;
+    index->valid = 0;
+    index->capacity = 0;
+}
+
+void line_index_build(LineIndex *index, const char *data, int size) {
+    index->count = 1;
+    index->valid = 1;
+    index->starts[0] = 0;
+    line_index_append(index, data, 0, size);
+}
+
+// Only the bytes in [old_size, new_size) are scanned. Counting first sizes
+// the table once instead of growing it per line.
+void line_index_append(LineIndex *index, const char *data, int old_size, int new_size) {
+    int lines = scan_count_newlines(data + old_size, new_size - old_size);
+    if (index->valid == index->count && reserve(index, index->count + lines) == 0) {
+        index->valid += scan_line_starts(data, old_size, new_size, index->starts + index->valid, lines);
+    }
+    index->count += lines;
+}
+
+static int search(const LineIndex *index, int pos) {
+    int low = 0;
+    int high = index->valid - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (index->starts[mid] <= pos) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// An edit at pos leaves every start up to pos intact, so the valid prefix
+// is only cut back when the edit lands inside it; nothing is rescanned here
+static void invalidate(LineIndex *index, int pos) {
+    if (pos < index->starts[index->valid - 1]) {
+        index->valid = search(index, pos) + 1;
+    }
+}
+
+// ch is the byte inserted at or deleted from pos
+void line_index_insert(LineIndex *index, int pos, char ch) {
+    invalidate(index, pos);
+    if (ch == '\n') {
+        index->count++;
+    }
+}
+
+void line_index_delete(LineIndex *index, int pos, char ch) {
+    invalidate(index, pos);
+    if (ch == '\n') {
+        index->count--;
+    }
+}
+
+// Bytes from pos on holding removed newlines were replaced by bytes holding
+// inserted ones
+void line_index_splice(LineIndex *index, int pos, int removed, int inserted) {
+    invalidate(index, pos);
+    index->count += inserted - removed;
+}
+
+int line_index_start(LineIndex *index, const char *data, int size, int line) {
+    if (line >= index->count) {
+        return size;
+    }
+    extend(index, data, size, line);
+    if (line < index->valid) {
+        return index->starts[line];
+    }
+    int pos = index->starts[index->valid - 1];
+    for (int i = index->valid - 1; i < line; i++) {
+        pos = (const char *)memchr(data + pos, '\n', size - pos) - data + 1;
+    }
+    return pos;
+}
+
+int line_index_line_of(LineIndex *index, const char *data, int size, int pos) {
+    // Make sure the table reaches past pos before searching it
+    while (index->valid < index->count && index->starts[index->valid - 1] <= pos) {
+        int valid = index->valid;
+        extend(index, data, size, index->valid);
+        if (index->valid == valid) {
+            int last = index->starts[valid - 1];
+            return valid - 1 + scan_count_newlines(data + last, pos - last);
+        }
+    }
+    return search(index, pos);
+}
+
+// Line length without its newline
+int line_index_length(LineIndex *index, const char *data, int size, int line) {
+    int start = line_index_start(index, data, size, line);
+    if (line + 1 < index->count) {
+        return line_index_start(index, data, size, line + 1) - start - 1;
+    }
+    return size - start;
+}
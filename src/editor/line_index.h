@@ -0,0 +1,25 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+// Byte offset of the start of every line; there is always at least one line.
+// Edits only invalidate the starts after the edited line, which are rebuilt
+// on demand, so typing doesn't shift the whole table on every key.
+typedef struct LineIndex {
+    int *starts;
+    int count;   // always exact
+    int valid;   // starts[0..valid) are up to date
+    int capacity;
+} LineIndex;
+
+int line_index_init(LineIndex *index);
+void line_index_free(LineIndex *index);
+void line_index_build(LineIndex *index, const char *data, int size);
+void line_index_append(LineIndex *index, const char *data, int old_size, int new_size);
+void line_index_insert(LineIndex *index, int pos, char ch);
+void line_index_delete(LineIndex *index, int pos, char ch);
+void line_index_splice(LineIndex *index, int pos, int removed, int inserted);
+int line_index_start(LineIndex *index, const char *data, int size, int line);
+int line_index_line_of(LineIndex *index, const char *data, int size, int pos);
+int line_index_length(LineIndex *index, const char *data, int size, int line);
+
+#endif
@@ -0,0 +1,501 @@
+#define _GNU_SOURCE
+#include "minimap.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include <string.h>
+
+#define MINIMAP_CHUNK 1024
+
+static const MinimapChunk empty = { 0, 0, 0, 0, 0 };
+
+static const unsigned char blank[256] = {
+    [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\r'] = 1,
+};
+
+static MinimapChunk add(MinimapChunk a, MinimapChunk b) {
+    MinimapChunk sum;
+    sum.length = a.length + b.length;
+    sum.lines = a.lines + b.lines;
+    sum.ink = a.ink + b.ink;
+    sum.hits = a.hits + b.hits;
+    sum.edited = a.edited + b.edited;
+    return sum;
+}
+
+static int count_ink(const char *data, int length) {
+    int ink = 0;
+    for (int i = 0; i < length; i++) {
+        ink += !blank[(unsigned char)data[i]];
+    }
+    return ink;
+}
+
+// Matches starting in [from, to); the last ones may run on past to
+static int count_hits(const MinimapIndex *index, const char *data, int size, int from, int to) {
+    int length = index->pattern_length;
+    if (length == 0) {
+        return 0;
+    }
+    int limit = to + length - 1 < size ? to + length - 1 : size;
+    const char *end = data + limit;
+    int hits = 0;
+    for (const char *p = data + from; p < end; p++) {
+        p = memmem(p, end - p, index->pattern, length);
+        if (p == NULL) {
+            break;
+        }
+        hits++;
+    }
+    return hits;
+}
+
+static MinimapChunk summarize(const MinimapIndex *index, const char *data, int size, int start, int length) {
+    MinimapChunk chunk = empty;
+    chunk.length = length;
+    for (int i = start; i < start + length; i++) {
+        unsigned char c = data[i];
+        chunk.lines += c == '\n';
+        chunk.ink += !blank[c];
+    }
+    chunk.hits = count_hits(index, data, size, start, start + length);
+    return chunk;
+}
+
+// Only allocates when the number of chunks crosses a power of two
+static int rebuild_tree(MinimapIndex *index) {
+    int leaves = 1;
+    while (leaves < index->count) {
+        leaves *= 2;
+    }
+    if (leaves != index->leaves) {
+        MinimapChunk *tree = alloc_realloc(ALLOC_TEXT_INDEX, index->tree, 2 * leaves * sizeof(MinimapChunk));
+        if (tree == NULL) {
+            return -1;
+        }
+        index->tree = tree;
+        index->leaves = leaves;
+    }
+    for (int i = 0; i < leaves; i++) {
+        index->tree[leaves + i] = i < index->count ? index->chunks[i] : empty;
+    }
+    for (int i = leaves - 1; i >= 1; i--) {
+        index->tree[i] = add(index->tree[2 * i], index->tree[2 * i + 1]);
+    }
+    return 0;
+}
+
+static void update_leaf(MinimapIndex *index, int chunk) {
+    int node = index->leaves + chunk;
+    index->tree[node] = index->chunks[chunk];
+    for (node /= 2; node >= 1; node /= 2) {
+        index->tree[node] = add(index->tree[2 * node], index->tree[2 * node + 1]);
+    }
+}
+
+static int reserve(MinimapIndex *index, int count) {
+    if (count <= index->capacity) {
+        return 0;
+    }
+    int capacity = index->capacity ? index->capacity : 16;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    MinimapChunk *chunks = alloc_realloc(ALLOC_TEXT_INDEX, index->chunks, capacity * sizeof(MinimapChunk));
+    if (chunks == NULL) {
+        return -1;
+    }
+    index->chunks = chunks;
+    MinimapMark *marks = alloc_realloc(ALLOC_TEXT_INDEX, index->marks, capacity * sizeof(MinimapMark));
+    if (marks == NULL) {
+        return -1;
+    }
+    index->marks = marks;
+    index->capacity = capacity;
+    return 0;
+}
+
+// Fails when short of memory, leaving the index stale
+static int build(MinimapIndex *index, const char *data, int size) {
+    PROF_SCOPE(PROF_BUFFER);
+    int count = size > 0 ? (size + MINIMAP_CHUNK - 1) / MINIMAP_CHUNK : 1;
+    if (reserve(index, count) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int start = i * MINIMAP_CHUNK;
+        int length = size - start < MINIMAP_CHUNK ? size - start : MINIMAP_CHUNK;
+        index->chunks[i] = summarize(index, data, size, start, length);
+    }
+    index->count = count;
+    if (rebuild_tree(index) != 0) {
+        return -1;
+    }
+    index->stale = 0;
+    return 0;
+}
+
+void minimap_init(MinimapIndex *index) {
+    memset(index, 0, sizeof(*index));
+    index->stale = 1;
+}
+
+void minimap_free(MinimapIndex *index) {
+    alloc_free(index->chunks);
+    alloc_free(index->marks);
+    alloc_free(index->tree);
+    alloc_free(index->pattern);
+    memset(index, 0, sizeof(*index));
+}
+
+// A new text drops the index and its marks; it is rebuilt when next used
+void minimap_reset(MinimapIndex *index) {
+    index->stale = 1;
+    index->version++;
+}
+
+// After a save nothing counts as edited any more
+void minimap_clear_marks(MinimapIndex *index) {
+    if (index->stale) {
+        return;
+    }
+    for (int i = 0; i < index->count; i++) {
+        index->chunks[i].edited = 0;
+    }
+    rebuild_tree(index);
+    index->version++;
+}
+
+// Chunk holding pos, and its start offset. An offset at the very end
+// belongs to the last chunk.
+static int locate(const MinimapIndex *index, int pos, int *start) {
+    const MinimapChunk *root = &index->tree[1];
+    if (pos >= root->length) {
+        int last = index->count - 1;
+        *start = root->length - index->chunks[last].length;
+        return last;
+    }
+    int node = 1;
+    *start = 0;
+    while (node < index->leaves) {
+        const MinimapChunk *left = &index->tree[2 * node];
+        if (pos < left->length) {
+            node = 2 * node;
+        } else {
+            pos -= left->length;
+            *start += left->length;
+            node = 2 * node + 1;
+        }
+    }
+    return node - index->leaves;
+}
+
+// Where an offset from before the edit ends up; bytes that were removed
+// collapse onto the edit
+static int shifted(int offset, int pos, int removed, int inserted) {
+    if (offset < pos) {
+        return offset;
+    }
+    return offset >= pos + removed ? offset - removed + inserted : pos;
+}
+
+static void widen(MinimapMark *mark, int *marked, int start, int end) {
+    if (start >= end) {
+        return;
+    }
+    if (!*marked) {
+        *mark = (MinimapMark){ start, end };
+        *marked = 1;
+        return;
+    }
+    mark->start = start < mark->start ? start : mark->start;
+    mark->end = end > mark->end ? end : mark->end;
+}
+
+// Adds the part of span, in text offsets, that falls inside the chunk
+static void mark_chunk(MinimapIndex *index, int chunk, int start, MinimapMark span) {
+    int end = start + index->chunks[chunk].length;
+    int from = span.start > start ? span.start : start;
+    int to = span.end < end ? span.end : end;
+    widen(&index->marks[chunk], &index->chunks[chunk].edited, from - start, to - start);
+}
+
+// The chunks the edit touched are cut again from the new text, into pieces
+// of one to two chunk sizes, so typing only rescans the chunk it is in.
+// Without memory to cut them the index goes stale and loses its marks.
+void minimap_edit(MinimapIndex *index, const char *data, int size, int pos, int removed, int inserted, int mark) {
+    if (index->stale) {
+        // Nothing was marked before; the edit is redone over its own bytes
+        if (build(index, data, size) != 0) {
+            return;
+        }
+        removed = inserted;
+    }
+    index->version++;
+
+    int start;
+    int first = locate(index, pos, &start);
+    int last = first;
+    int last_start = start;
+    if (removed > 0) {
+        last = locate(index, pos + removed - 1, &last_start);
+    }
+    int end = last_start + index->chunks[last].length - removed + inserted;
+
+    MinimapMark span = { 0, 0 };
+    int marked = 0;
+    for (int i = first, offset = start; i <= last; offset += index->chunks[i].length, i++) {
+        if (index->chunks[i].edited) {
+            widen(&span, &marked, shifted(offset + index->marks[i].start, pos, removed, inserted),
+                  shifted(offset + index->marks[i].end, pos, removed, inserted));
+        }
+    }
+    if (mark) {
+        // A deletion marks the byte that closed the gap
+        int from = pos;
+        int to = pos + inserted;
+        if (from == to && to < size) {
+            to++;
+        } else if (from == to && from > 0) {
+            from--;
+        }
+        widen(&span, &marked, from, to);
+    }
+
+    int length = end - start;
+    int replaced = last - first + 1;
+    int pieces = length / MINIMAP_CHUNK;
+    if (pieces < 1) {
+        pieces = length > 0 || index->count == replaced ? 1 : 0;
+    }
+    int count = index->count - replaced + pieces;
+    if (reserve(index, count) != 0) {
+        minimap_reset(index);
+        return;
+    }
+    memmove(index->chunks + first + pieces, index->chunks + last + 1, (index->count - last - 1) * sizeof(MinimapChunk));
+    memmove(index->marks + first + pieces, index->marks + last + 1, (index->count - last - 1) * sizeof(MinimapMark));
+    int resized = count != index->count;
+    index->count = count;
+
+    for (int i = 0; i < pieces; i++) {
+        int from = start + (int)((long long)length * i / pieces);
+        int to = start + (int)((long long)length * (i + 1) / pieces);
+        index->chunks[first + i] = summarize(index, data, size, from, to - from);
+        if (marked) {
+            mark_chunk(index, first + i, from, span);
+        }
+    }
+    // A deletion at the edge of the cut marks a byte of a neighbour
+    int after = first + pieces;
+    if (marked && span.end > end && after < count) {
+        mark_chunk(index, after, end, span);
+        if (!resized) {
+            update_leaf(index, after);
+        }
+    }
+    if (marked && span.start < start && first > 0) {
+        mark_chunk(index, first - 1, start - index->chunks[first - 1].length, span);
+        if (!resized) {
+            update_leaf(index, first - 1);
+        }
+    }
+
+    // Matches starting a little before the edit may have run into it
+    int reach = start;
+    for (int i = first - 1; i >= 0 && start - reach < index->pattern_length - 1; i--) {
+        reach -= index->chunks[i].length;
+        index->chunks[i].hits = count_hits(index, data, size, reach, reach + index->chunks[i].length);
+        if (!resized) {
+            update_leaf(index, i);
+        }
+    }
+
+    if (resized) {
+        if (rebuild_tree(index) != 0) {
+            minimap_reset(index);
+        }
+    } else {
+        for (int i = first; i < first + pieces; i++) {
+            update_leaf(index, i);
+        }
+    }
+}
+
+void minimap_set_pattern(MinimapIndex *index, const char *data, int size, const char *pattern, int length) {
+    alloc_free(index->pattern);
+    index->pattern = NULL;
+    index->pattern_length = 0;
+    if (length > 0 && (index->pattern = alloc_malloc(ALLOC_TEXT_INDEX, length)) != NULL) {
+        memcpy(index->pattern, pattern, length);
+        index->pattern_length = length;
+    }
+    index->version++;
+    if (index->stale) {
+        return;
+    }
+
+    PROF_SCOPE(PROF_BUFFER);
+    for (int i = 0, start = 0; i < index->count; start += index->chunks[i].length, i++) {
+        index->chunks[i].hits = count_hits(index, data, size, start, start + index->chunks[i].length);
+    }
+    rebuild_tree(index);
+}
+
+int minimap_hits(MinimapIndex *index, const char *data, int size) {
+    if (index->stale && build(index, data, size) != 0) {
+        return 0;
+    }
+    return index->tree[1].hits;
+}
+
+int minimap_find(const MinimapIndex *index, const char *data, int size, int from) {
+    if (index->pattern_length == 0) {
+        return -1;
+    }
+    from = from < size ? from : size;
+    const char *match = memmem(data + from, size - from, index->pattern, index->pattern_length);
+    if (match == NULL) {
+        match = memmem(data, size, index->pattern, index->pattern_length);
+    }
+    return match != NULL ? (int)(match - data) : -1;
+}
+
+// Sums of the chunks before chunk, from the tree
+static MinimapChunk sums_before(const MinimapIndex *index, int chunk) {
+    MinimapChunk sums = empty;
+    for (int node = index->leaves + chunk; node > 1; node /= 2) {
+        if (node % 2 == 1) {
+            sums = add(sums, index->tree[node - 1]);
+        }
+    }
+    return sums;
+}
+
+// Everything before the start of a line: whole chunks from the tree, then
+// the bytes of the chunk it starts in
+typedef struct LinePrefix {
+    int chunk;
+    int start;            // of the chunk
+    int offset;           // of the line
+    MinimapChunk before;  // sums of the chunks before
+    int ink;              // and of the chunk's bytes before offset
+    int hits;
+} LinePrefix;
+
+// Finds the chunk a line starts in by its line count, then the line's
+// newline inside it; fills all but the partial sums
+static void seek_line(const MinimapIndex *index, const char *data, int size, int line, LinePrefix *prefix) {
+    memset(prefix, 0, sizeof(*prefix));
+    if (line == 0) {
+        return;
+    }
+    if (line > index->tree[1].lines) {
+        // The line after the last newline runs to the end of the text
+        prefix->chunk = index->count - 1;
+        prefix->before = sums_before(index, prefix->chunk);
+        prefix->start = prefix->before.length;
+        prefix->offset = size;
+        return;
+    }
+
+    int node = 1;
+    while (node < index->leaves) {
+        const MinimapChunk *left = &index->tree[2 * node];
+        if (line <= left->lines) {
+            node = 2 * node;
+        } else {
+            line -= left->lines;
+            prefix->before = add(prefix->before, *left);
+            node = 2 * node + 1;
+        }
+    }
+    prefix->chunk = node - index->leaves;
+    prefix->start = prefix->before.length;
+
+    const char *p = data + prefix->start;
+    const char *end = p + index->chunks[prefix->chunk].length;
+    for (; line > 0; line--) {
+        p = (const char *)memchr(p, '\n', end - p) + 1;
+    }
+    prefix->offset = p - data;
+}
+
+static LinePrefix line_prefix(const MinimapIndex *index, const char *data, int size, int line) {
+    LinePrefix prefix;
+    seek_line(index, data, size, line, &prefix);
+    prefix.ink = count_ink(data + prefix.start, prefix.offset - prefix.start);
+    prefix.hits = count_hits(index, data, size, prefix.start, prefix.offset);
+    return prefix;
+}
+
+int minimap_line_start(MinimapIndex *index, const char *data, int size, int line) {
+    if (index->stale && build(index, data, size) != 0) {
+        return -1;
+    }
+    LinePrefix prefix;
+    seek_line(index, data, size, line, &prefix);
+    return prefix.offset;
+}
+
+int minimap_line_of(MinimapIndex *index, const char *data, int size, int pos) {
+    if (index->stale && build(index, data, size) != 0) {
+        return -1;
+    }
+    if (pos >= size) {
+        return index->tree[1].lines;
+    }
+    int node = 1;
+    int start = 0;
+    int line = 0;
+    while (node < index->leaves) {
+        const MinimapChunk *left = &index->tree[2 * node];
+        if (pos - start < left->length) {
+            node = 2 * node;
+        } else {
+            start += left->length;
+            line += left->lines;
+            node = 2 * node + 1;
+        }
+    }
+    for (const char *p = data + start; (p = memchr(p, '\n', data + pos - p)) != NULL; p++) {
+        line++;
+    }
+    return line;
+}
+
+static int marked(const MinimapIndex *index, int chunk, int start, int from, int to) {
+    const MinimapMark *mark = &index->marks[chunk];
+    return index->chunks[chunk].edited && start + mark->start < to && start + mark->end > from;
+}
+
+void minimap_rows(MinimapIndex *index, const char *data, int size, int line_count, MinimapRow *rows, int height) {
+    if (index->stale && build(index, data, size) != 0) {
+        memset(rows, 0, height * sizeof(MinimapRow));
+        return;
+    }
+
+    LinePrefix from = line_prefix(index, data, size, 0);
+    for (int r = 0; r < height; r++) {
+        int first, end;
+        if (line_count <= height) {
+            first = r < line_count ? r : line_count;
+            end = r < line_count ? r + 1 : line_count;
+        } else {
+            first = (int)((long long)line_count * r / height);
+            end = (int)((long long)line_count * (r + 1) / height);
+        }
+        LinePrefix to = end == first ? from : line_prefix(index, data, size, end);
+
+        MinimapRow *row = &rows[r];
+        row->first = first;
+        row->lines = end - first;
+        row->ink = to.before.ink + to.ink - from.before.ink - from.ink;
+        row->hits = to.before.hits + to.hits - from.before.hits - from.hits;
+        row->edited = marked(index, from.chunk, from.start, from.offset, to.offset);
+        if (to.chunk != from.chunk) {
+            row->edited |= marked(index, to.chunk, to.start, from.offset, to.offset);
+            row->edited |= to.before.edited - from.before.edited - index->chunks[from.chunk].edited > 0;
+        }
+        from = to;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+// Overview of the whole text in chunks of about a KB. Each chunk counts its
+// lines, the bytes that aren't blank and the search hits starting in it, and
+// remembers the range edited since the last save. A tree of sums over the
+// chunks finds where any line starts, so one ruler row costs two descents
+// and a scan of two chunks at most whatever the size of the file.
+typedef struct MinimapChunk {
+    int length;
+    int lines;    // newlines inside
+    int ink;      // bytes other than blanks
+    int hits;     // matches of the pattern starting inside
+    int edited;   // 1 when mark covers an edit
+} MinimapChunk;
+
+// Edited bytes of one chunk, relative to its start
+typedef struct MinimapMark {
+    int start;
+    int end;
+} MinimapMark;
+
+typedef struct MinimapIndex {
+    MinimapChunk *chunks;
+    MinimapMark *marks;
+    int count;
+    int capacity;
+    MinimapChunk *tree;     // sums; node i has children 2i and 2i + 1, leaves from `leaves`
+    int leaves;
+    char *pattern;
+    int pattern_length;
+    int stale;              // rebuilt from the text, unmarked, on the next use
+    unsigned version;       // changes whenever a row could have
+} MinimapIndex;
+
+// One ruler row: the first of the lines it stands for and their totals
+typedef struct MinimapRow {
+    int first;
+    int lines;
+    int ink;
+    int hits;
+    int edited;
+} MinimapRow;
+
+void minimap_init(MinimapIndex *index);
+void minimap_free(MinimapIndex *index);
+void minimap_reset(MinimapIndex *index);
+void minimap_clear_marks(MinimapIndex *index);
+
+// Called after removed bytes at pos were replaced by inserted ones; mark
+// shows the range as edited
+void minimap_edit(MinimapIndex *index, const char *data, int size, int pos, int removed, int inserted, int mark);
+
+// Counts matches of pattern from now on; an empty one clears them
+void minimap_set_pattern(MinimapIndex *index, const char *data, int size, const char *pattern, int length);
+int minimap_hits(MinimapIndex *index, const char *data, int size);
+
+// Offset of the first match at or after from, wrapping past the end; -1 when
+// there is none
+int minimap_find(const MinimapIndex *index, const char *data, int size, int from);
+
+// Where a line starts and which line holds pos, from the chunks' line
+// counts: a chunk or two is scanned however far the line is into the text.
+// -1 when there is no memory to build the index.
+int minimap_line_start(MinimapIndex *index, const char *data, int size, int line);
+int minimap_line_of(MinimapIndex *index, const char *data, int size, int pos);
+
+// Shares line_count lines out evenly over height rows, one line a row when
+// they all fit, and sums each; the rows are left empty without an index
+void minimap_rows(MinimapIndex *index, const char *data, int size, int line_count, MinimapRow *rows, int height);
+
+#endif
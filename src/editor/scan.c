@@ -0,0 +1,122 @@
+#include "scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+static int count_scalar(const char *data, int length) {
+    int count = 0;
+    const char *p = data;
+    const char *end = data + length;
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        count++;
+    }
+    return count;
+}
+
+static int starts_scalar(const char *data, int from, int to, int *starts, int max) {
+    int written = 0;
+    const char *p = data + from;
+    const char *end = data + to;
+    while (written < max && p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        starts[written++] = p - data;
+    }
+    return written;
+}
+
+#ifdef SCAN_X86
+// 64 bytes per step: two compares folded into one bitmask
+__attribute__((target("avx2,popcnt")))
+static int count_avx2(const char *data, int length) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    int count = 0;
+    int i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 32));
+        unsigned long long mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, newline));
+        mask |= (unsigned long long)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, newline)) << 32;
+        count += _mm_popcnt_u64(mask);
+    }
+    return count + count_scalar(data + i, length - i);
+}
+
+// Walks the set bits of each 32-byte mask, so short lines don't pay a call
+// per newline like the memchr loop does
+__attribute__((target("avx2,bmi")))
+static int starts_avx2(const char *data, int from, int to, int *starts, int max) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    int written = 0;
+    int i = from;
+    for (; i + 32 <= to && written < max; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+        while (mask != 0) {
+            starts[written++] = i + (int)_tzcnt_u32(mask) + 1;
+            if (written == max) {
+                return written;
+            }
+            mask = _blsr_u32(mask);
+        }
+    }
+    return written + starts_scalar(data, i, to, starts + written, max - written);
+}
+#endif
+
+typedef struct ScanKernel {
+    const char *name;
+    int (*count)(const char *data, int length);
+    int (*starts)(const char *data, int from, int to, int *starts, int max);
+} ScanKernel;
+
+static const ScanKernel scalar_kernel = { "scalar", count_scalar, starts_scalar };
+#ifdef SCAN_X86
+static const ScanKernel avx2_kernel = { "avx2", count_avx2, starts_avx2 };
+#endif
+
+static const ScanKernel *kernel = NULL;
+
+// QUARK_SCAN=scalar forces the fallback so the kernels can be compared
+static const ScanKernel *resolve(void) {
+    const ScanKernel *chosen = __atomic_load_n(&kernel, __ATOMIC_ACQUIRE);
+    if (chosen != NULL) {
+        return chosen;
+    }
+    chosen = &scalar_kernel;
+#ifdef SCAN_X86
+    const char *forced = getenv("QUARK_SCAN");
+    if (forced == NULL || strcmp(forced, "scalar") != 0) {
+#if defined(__AVX2__) && defined(__POPCNT__) && defined(__BMI__)
+        // A -march build that already assumes AVX2 skips the CPUID check
+        chosen = &avx2_kernel;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi")) {
+            chosen = &avx2_kernel;
+        }
+#endif
+    }
+#endif
+    __atomic_store_n(&kernel, chosen, __ATOMIC_RELEASE);
+    return chosen;
+}
+
+int scan_count_newlines(const char *data, int length) {
+    return resolve()->count(data, length);
+}
+
+int scan_line_starts(const char *data, int from, int to, int *starts, int max) {
+    if (max <= 0) {
+        return 0;
+    }
+    return resolve()->starts(data, from, to, starts, max);
+}
+
+const char *scan_kernel_name(void) {
+    return resolve()->name;
+}
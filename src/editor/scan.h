@@ -0,0 +1,14 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Newline kernels used by the line index. The widest implementation the CPU
+// supports is picked on first use, so one binary runs everywhere.
+int scan_count_newlines(const char *data, int length);
+
+// Writes the offset just past each newline in data[from, to) to starts,
+// stopping after max entries; returns how many were written
+int scan_line_starts(const char *data, int from, int to, int *starts, int max);
+
+const char *scan_kernel_name(void);
+
+#endif
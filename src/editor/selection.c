@@ -0,0 +1,37 @@
+#include "selection.h"
+
+SelectionRect selection_rect(const Selection *selection) {
+    SelectionRect rect;
+    rect.top = selection->start.y < selection->end.y ? selection->start.y : selection->end.y;
+    rect.bottom = selection->start.y < selection->end.y ? selection->end.y : selection->start.y;
+    rect.left = selection->start.x < selection->end.x ? selection->start.x : selection->end.x;
+    rect.right = selection->start.x < selection->end.x ? selection->end.x : selection->start.x;
+    return rect;
+}
+
+int selection_contains(const Selection *selection, int line, int column) {
+    if (selection->mode == SELECTION_BLOCK) {
+        SelectionRect rect = selection_rect(selection);
+        return line >= rect.top && line <= rect.bottom && column >= rect.left && column < rect.right;
+    }
+
+    // Linear selections run from one cursor to the other in reading order
+    Cursor first = selection->start;
+    Cursor last = selection->end;
+    if (first.y > last.y || (first.y == last.y && first.x > last.x)) {
+        first = selection->end;
+        last = selection->start;
+    }
+    if (line < first.y || line > last.y) {
+        return 0;
+    }
+    return (line > first.y || column >= first.x) && (line < last.y || column < last.x);
+}
+
+void selection_row_span(LineIndex *index, const char *data, int size, int line, int left, int right,
+                        int *start, int *end) {
+    int line_start = line_index_start(index, data, size, line);
+    int length = line_index_length(index, data, size, line);
+    *start = line_start + (left < length ? left : length);
+    *end = line_start + (right < length ? right : length);
+}
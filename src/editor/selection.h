@@ -0,0 +1,39 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include "line_index.h"
+
+typedef struct Cursor {
+    int x;
+    int y;
+} Cursor;
+
+typedef enum SelectionMode {
+    SELECTION_LINEAR,
+    SELECTION_BLOCK,
+} SelectionMode;
+
+// start is where the selection was anchored, end follows the cursor
+typedef struct Selection {
+    Cursor start;
+    Cursor end;
+    SelectionMode mode;
+} Selection;
+
+// A block selection as lines [top, bottom] and columns [left, right)
+typedef struct SelectionRect {
+    int top;
+    int bottom;
+    int left;
+    int right;
+} SelectionRect;
+
+SelectionRect selection_rect(const Selection *selection);
+int selection_contains(const Selection *selection, int line, int column);
+
+// Byte range of the columns [left, right) of a line, clipped to its length.
+// Line starts come from the index, so nothing is rescanned from byte 0.
+void selection_row_span(LineIndex *index, const char *data, int size, int line, int left, int right,
+                        int *start, int *end);
+
+#endif
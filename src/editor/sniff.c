@@ -0,0 +1,37 @@
+#include "sniff.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// A NUL byte, or more than one in ten bytes being control characters, marks
+// the sample as binary. UTF-8 sequences count as text.
+FileKind sniff_bytes(const unsigned char *data, size_t length) {
+    size_t suspicious = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = data[i];
+        if (c == '\0') {
+            return FILE_KIND_BINARY;
+        }
+        if (c < 0x20 && c != '\n' && c != '\r' && c != '\t' && c != '\f' && c != '\b' && c != 0x1b) {
+            suspicious++;
+        } else if (c == 0x7f) {
+            suspicious++;
+        }
+    }
+    return suspicious * 10 > length ? FILE_KIND_BINARY : FILE_KIND_TEXT;
+}
+
+// Only the first block is read, whatever the file size
+FileKind sniff_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return FILE_KIND_TEXT;
+    }
+
+    unsigned char sample[SNIFF_BLOCK_SIZE];
+    ssize_t length = read(fd, sample, sizeof(sample));
+    close(fd);
+    if (length <= 0) {
+        return FILE_KIND_TEXT;
+    }
+    return sniff_bytes(sample, length);
+}
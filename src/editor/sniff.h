@@ -0,0 +1,18 @@
+#ifndef SNIFF_H
+#define SNIFF_H
+
+#include <stddef.h>
+
+#define SNIFF_BLOCK_SIZE 8192
+// Text files past this size are shown straight from a mapping instead of loaded
+#define HUGE_FILE_SIZE (64LL << 20)
+
+typedef enum FileKind {
+    FILE_KIND_TEXT,
+    FILE_KIND_BINARY
+} FileKind;
+
+FileKind sniff_bytes(const unsigned char *data, size_t length);
+FileKind sniff_file(const char *path);
+
+#endif
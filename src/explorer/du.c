@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include "du.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PATH_MAX 4096
+
+struct DuPool
+{
+    Explorer *tree;
+    int root;
+    int *dirs;
+    int dir_count;
+    int dir_capacity;
+    int next;
+    int finished;
+    pthread_t *threads;
+    int thread_count;
+};
+
+// Queues the directories still missing totals; finished subtrees are the cache
+static int collect_dirs(DuPool *pool, int node)
+{
+    Explorer *tree = pool->tree;
+    if (NODE(tree, node, du_done))
+    {
+        return 0;
+    }
+
+    // A subtree that can't be queued counts as one directory that never
+    // finishes, so none of its ancestors is shown with partial totals
+    if (pool->dir_count == pool->dir_capacity)
+    {
+        int capacity = pool->dir_capacity ? pool->dir_capacity * 2 : 256;
+        int *grown = alloc_realloc(ALLOC_EXPLORER, pool->dirs, capacity * sizeof(int));
+        if (grown == NULL)
+        {
+            return 1;
+        }
+        pool->dirs = grown;
+        pool->dir_capacity = capacity;
+    }
+    pool->dirs[pool->dir_count++] = node;
+
+    int pending = 1;
+    for (int child = NODE(tree, node, first_child); child != NODE_NONE; child = NODE(tree, child, next_sibling))
+    {
+        if (NODE(tree, child, is_directory))
+        {
+            pending += collect_dirs(pool, child);
+        }
+    }
+    NODE(tree, node, du_pending) = pending;
+    return pending;
+}
+
+// Sums the files directly inside one directory, stat'ing them relative to
+// the directory fd so the kernel doesn't walk the full path each time
+static void size_directory(Explorer *tree, int root, int dir)
+{
+    long long bytes = 0;
+    long long files = 0;
+
+    char path[PATH_MAX];
+    int fd = node_path(tree, dir, path, sizeof(path)) < 0 ? -1 : open(path, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        for (int child = NODE(tree, dir, first_child); child != NODE_NONE; child = NODE(tree, child, next_sibling))
+        {
+            if (NODE(tree, child, is_directory))
+            {
+                continue;
+            }
+            struct statx st;
+            prof_count(PROF_STAT_CALLS, 1);
+            if (statx(fd, NODE(tree, child, name), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_SIZE, &st) == 0)
+            {
+                bytes += st.stx_size;
+                files++;
+            }
+        }
+        close(fd);
+    }
+
+    // Propagate up the parent links as far as root; the subtree pending
+    // count reaching zero marks a directory complete
+    for (int node = dir;; node = NODE(tree, node, parent))
+    {
+        __atomic_fetch_add(&NODE(tree, node, du_bytes), bytes, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&NODE(tree, node, du_files), files, __ATOMIC_RELAXED);
+        if (__atomic_sub_fetch(&NODE(tree, node, du_pending), 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            __atomic_store_n(&NODE(tree, node, du_done), 1, __ATOMIC_RELEASE);
+        }
+        if (node == root)
+        {
+            break;
+        }
+    }
+}
+
+static void *du_worker(void *arg)
+{
+    DuPool *pool = arg;
+    for (;;)
+    {
+        int index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= pool->dir_count)
+        {
+            break;
+        }
+        size_directory(pool->tree, pool->root, pool->dirs[index]);
+        __atomic_fetch_add(&pool->finished, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+DuPool *du_start(Explorer *tree, int root, int jobs)
+{
+    DuPool *pool = alloc_calloc(ALLOC_EXPLORER, 1, sizeof(DuPool));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    pool->tree = tree;
+    pool->root = root;
+    collect_dirs(pool, root);
+
+    if (jobs < 1)
+    {
+        jobs = 1;
+    }
+    pool->threads = alloc_malloc(ALLOC_EXPLORER, jobs * sizeof(pthread_t));
+    if (pool->threads == NULL)
+    {
+        jobs = 0;
+    }
+    for (int i = 0; i < jobs; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, du_worker, pool) != 0)
+        {
+            break;
+        }
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0)
+    {
+        du_worker(pool);
+    }
+    return pool;
+}
+
+int du_progress(const DuPool *pool, int *total)
+{
+    *total = pool->dir_count;
+    return __atomic_load_n(&pool->finished, __ATOMIC_ACQUIRE);
+}
+
+void du_wait(DuPool *pool)
+{
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->thread_count = 0;
+}
+
+void du_free(DuPool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+    du_wait(pool);
+    alloc_free(pool->threads);
+    alloc_free(pool->dirs);
+    alloc_free(pool);
+}
@@ -0,0 +1,19 @@
+#ifndef DU_H
+#define DU_H
+
+#include "explorer.h"
+
+typedef struct DuPool DuPool;
+
+// Sizes every directory below root on a background thread pool. Totals are
+// added to each directory and its ancestors up to root as it finishes, so a
+// node can be read at any time; du_pending of zero means its subtree is
+// complete, and out of memory some directories never get there. Ancestors
+// of root are left as they are. No nodes may be added to the tree until
+// du_wait returns.
+DuPool *du_start(Explorer *tree, int root, int jobs);
+int du_progress(const DuPool *pool, int *total);
+void du_wait(DuPool *pool);
+void du_free(DuPool *pool);
+
+#endif
@@ -1,116 +1,242 @@
+#define _GNU_SOURCE
 #include "explorer.h"
+#include "sort_key.h"
+#include "ignore.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include "../io/io.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define PATH_MAX 4096
+#define NAME_ARENA_BLOCK_SIZE (16 * 1024)
 
 int is_directory(const char *path)
 {
     struct stat buffer;
     int status = stat(path, &buffer);
+    prof_count(PROF_STAT_CALLS, 1);
     return status == 0 && S_ISDIR(buffer.st_mode);
 }
 
+long long stat_mtime(const struct stat *st)
+{
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
 int is_file(const char *path)
 {
     struct stat buffer;
     int status = stat(path, &buffer);
+    prof_count(PROF_STAT_CALLS, 1);
     return status == 0 && S_ISREG(buffer.st_mode);
 }
 
-void print_explorer(Explorer *node, int depth)
+static void format_size(long long bytes, char *out, size_t size)
+{
+    const char *units[] = { "B", "K", "M", "G", "T" };
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4)
+    {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(out, size, unit == 0 ? "%.0f%s" : "%.1f%s", value, units[unit]);
+}
+
+void print_explorer(Explorer *tree, int node, int depth, ExplorerExpand expand, void *context)
 {
     for (int i = 0; i < depth; i++)
     {
         printf("  ");
     }
-    printf("%s\n", node->name);
+    const char *name = NODE(tree, node, name);
+    if (NODE(tree, node, is_directory) && __atomic_load_n(&NODE(tree, node, du_done), __ATOMIC_ACQUIRE))
+    {
+        char size[32];
+        format_size(NODE(tree, node, du_bytes), size, sizeof(size));
+        prof_count(PROF_BYTES_WRITTEN, printf("%s  [%s, %lld files]\n", name, size, NODE(tree, node, du_files)) + depth * 2);
+    }
+    else
+    {
+        prof_count(PROF_BYTES_WRITTEN, printf("%s\n", name) + depth * 2);
+    }
 
-    if (node->is_directory)
+    if (expand != NULL && NODE(tree, node, is_directory))
     {
-        for (int i = 0; i < node->children_count; i++)
-        {
-            print_explorer(node->children[i], depth + 1);
-        }
+        expand(context, tree, node);
+    }
+    for (int child = NODE(tree, node, first_child); child != NODE_NONE; child = NODE(tree, child, next_sibling))
+    {
+        print_explorer(tree, child, depth + 1, expand, context);
+    }
+}
+
+int init_explorer(Explorer *tree, const char *path, long long mtime)
+{
+    node_table_init(tree, ALLOC_EXPLORER);
+    if (node_add(tree, NODE_NONE, path, 1) != EXPLORER_ROOT)
+    {
+        node_table_free(tree);
+        return -1;
+    }
+    NODE(tree, EXPLORER_ROOT, mtime) = mtime;
+    return 0;
+}
+
+int add_explorer_child(Explorer *tree, int node, const char *name, int is_directory, long long mtime)
+{
+    int child = node_add(tree, node, name, is_directory);
+    if (child != NODE_NONE)
+    {
+        NODE(tree, child, mtime) = mtime;
     }
+    return child;
 }
 
-void populate_explorer(Explorer *node)
+void populate_explorer_node(Explorer *tree, int node, IgnoreStack *ignore)
 {
+    char path[PATH_MAX];
+    if (node_path(tree, node, path, sizeof(path)) < 0)
+    {
+        return;
+    }
+
     // open directory
-    DIR *dir = opendir(node->full_path);
+    DIR *dir = opendir(path);
     struct dirent *entry;
+    IgnoreRules *rules = NULL;
+    if (dir != NULL && ignore != NULL)
+    {
+        rules = load_ignore_rules(path);
+        ignore_push(ignore, rules);
+    }
     if (dir != NULL)
     {
+        // Gather the listing first, then stat every entry in one batch. The
+        // names only live until the children are made, so they share an arena.
+        // Out of memory the directory lists what fit.
+        AllocArena arena;
+        alloc_arena_init(&arena, ALLOC_EXPLORER, NAME_ARENA_BLOCK_SIZE);
+        char **names = NULL;
+        int count = 0;
+        int capacity = 0;
         while ((entry = readdir(dir)) != NULL)
         {
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
             {
                 continue;
             }
+            if (count == capacity)
+            {
+                char **grown = alloc_realloc(ALLOC_EXPLORER, names, (capacity ? capacity * 2 : 64) * sizeof(char *));
+                if (grown == NULL)
+                {
+                    break;
+                }
+                names = grown;
+                capacity = capacity ? capacity * 2 : 64;
+            }
+            names[count] = alloc_arena_strdup(&arena, entry->d_name);
+            if (names[count] == NULL)
+            {
+                break;
+            }
+            count++;
+        }
 
-            // Create full path for the entry
-            char full_path[PATH_MAX];
-            snprintf(full_path, PATH_MAX, "%s/%s", node->full_path, entry->d_name);
+        struct statx *stats = alloc_malloc(ALLOC_EXPLORER, (count ? count : 1) * sizeof(struct statx));
+        IoRequest *requests = alloc_malloc(ALLOC_EXPLORER, (count ? count : 1) * sizeof(IoRequest));
+        if (stats == NULL || requests == NULL)
+        {
+            count = 0;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            requests[i] = (IoRequest) {
+                .op = IO_STATX,
+                .dirfd = dirfd(dir),
+                .path = names[i],
+                .flags = AT_STATX_SYNC_AS_STAT,
+                .mask = STATX_TYPE | STATX_MTIME,
+                .statx_buffer = &stats[i],
+            };
+        }
+        io_submit_batch(io_default_queue(), requests, count);
+        closedir(dir);
 
-            // create explorer node
-            Explorer *child = malloc(sizeof(Explorer));
-            child->name = strdup(entry->d_name);
-            child->full_path = strdup(full_path);
-            child->children_count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            mode_t mode = stats[i].stx_mode;
+            if (requests[i].result < 0 || (!S_ISREG(mode) && !S_ISDIR(mode)))
+            {
+                continue;
+            }
+            long long mtime = (long long)stats[i].stx_mtime.tv_sec * 1000000000LL + stats[i].stx_mtime.tv_nsec;
+            if (is_ignore_file(names[i]) && mtime > NODE(tree, node, ignore_mtime))
+            {
+                NODE(tree, node, ignore_mtime) = mtime;
+            }
 
-            // if file, just add to children
-            if (is_file(full_path))
+            // Create full path for the entry; deeper than PATH_MAX can't be opened
+            char full_path[PATH_MAX];
+            if (snprintf(full_path, PATH_MAX, "%s/%s", path, names[i]) >= PATH_MAX)
             {
-                child->is_directory = 0;
-                child->parent = node;
-                child->children = NULL;
-
-                // push to node->children
-                node->children = realloc(node->children, (node->children_count + 1) * sizeof(Explorer *));
-                node->children[node->children_count] = child;
-                node->children_count++;
+                continue;
             }
 
-            // if directory, DFS its children, and then add to node's children
-            if (is_directory(full_path))
+            // Ignored subtrees are never opened
+            int entry_is_directory = S_ISDIR(mode);
+            if (ignore != NULL && is_ignored(ignore, full_path, names[i], entry_is_directory))
             {
-                child->is_directory = 1;
-                child->children = NULL;
-                child->parent = node;
-                
-                // Add to parent's children first
-                node->children = realloc(node->children, (node->children_count + 1) * sizeof(Explorer *));
-                node->children[node->children_count] = child;
-                node->children_count++;
-                
-                // Then populate its children
-                populate_explorer(child);
+                continue;
+            }
+
+            int child = add_explorer_child(tree, node, names[i], entry_is_directory, mtime);
+
+            // if directory, DFS its children
+            if (child != NODE_NONE && entry_is_directory)
+            {
+                populate_explorer_node(tree, child, ignore);
             }
         }
-        closedir(dir);
+
+        alloc_arena_free(&arena);
+        alloc_free(names);
+        alloc_free(stats);
+        alloc_free(requests);
+    }
+    if (dir != NULL && ignore != NULL)
+    {
+        ignore_pop(ignore);
+        free_ignore_rules(rules);
     }
+
+    NODE(tree, node, children_sorted) = 0;
+    sort_explorer_children(tree, node);
 }
 
-void free_explorer(Explorer *node)
+void populate_explorer(Explorer *tree, int use_ignore)
 {
-    if (node == NULL) return;
+    IgnoreStack ignore = {0};
+    populate_explorer_node(tree, EXPLORER_ROOT, use_ignore ? &ignore : NULL);
+    free_ignore_stack(&ignore);
+}
 
-    // Free all children recursively
-    if (node->is_directory && node->children != NULL) {
-        for (int i = 0; i < node->children_count; i++) {
-            free_explorer(node->children[i]);
-        }
-        free(node->children);
-    }
+// Orders children by their precomputed keys, skipped while nothing changed
+void sort_explorer_children(Explorer *tree, int node)
+{
+    node_sort_children(tree, node);
+}
 
-    // Free the node's name and the node itself
-    free(node->name);
-    free(node->full_path);
-    free(node);
-}
\ No newline at end of file
+void free_explorer(Explorer *tree)
+{
+    node_table_free(tree);
+}
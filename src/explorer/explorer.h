@@ -1,17 +1,30 @@
 #ifndef EXPLORER_H
 #define EXPLORER_H
 
-typedef struct Explorer {
-    char *name;
-    char *full_path;
-    int is_directory;
-    struct Explorer *parent;
-    struct Explorer **children;
-    int children_count;
-} Explorer;
+#include "ignore.h"
+#include "node_table.h"
 
-void print_explorer(Explorer *node, int depth);
-void populate_explorer(Explorer *node);
-void free_explorer(Explorer *node);
+struct stat;
 
-#endif
\ No newline at end of file
+// A tree is one node table charged to the explorer. The root is node 0 and
+// is named by its full path.
+typedef NodeTable Explorer;
+
+#define EXPLORER_ROOT 0
+
+// Starts a tree with just the root; -1 when out of memory
+int init_explorer(Explorer *tree, const char *path, long long mtime);
+// Asked to fill in a directory's children just before they are walked
+typedef void (*ExplorerExpand)(void *context, Explorer *tree, int node);
+
+// expand may be NULL for a tree that is complete already
+void print_explorer(Explorer *tree, int node, int depth, ExplorerExpand expand, void *context);
+long long stat_mtime(const struct stat *st);
+// Returns the child's number, or NODE_NONE when out of memory
+int add_explorer_child(Explorer *tree, int node, const char *name, int is_directory, long long mtime);
+void populate_explorer_node(Explorer *tree, int node, IgnoreStack *ignore);
+void populate_explorer(Explorer *tree, int use_ignore);
+void sort_explorer_children(Explorer *tree, int node);
+void free_explorer(Explorer *tree);
+
+#endif
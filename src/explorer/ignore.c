@@ -0,0 +1,634 @@
+#include "ignore.h"
+#include "../alloc/alloc.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_PATTERN_LENGTH 1024
+#define MAX_PREFIX_LENGTHS 16
+
+typedef enum TokenType
+{
+    TOKEN_LITERAL,
+    TOKEN_ANY,
+    TOKEN_CLASS,
+    TOKEN_STAR,
+    TOKEN_GLOBSTAR,
+    TOKEN_GLOBSTAR_SLASH
+} TokenType;
+
+typedef struct Token
+{
+    TokenType type;
+    unsigned char c;
+    int negate;
+    uint8_t bits[32];
+} Token;
+
+typedef struct Rule
+{
+    int negate;
+    int dir_only;
+    int anchored;
+    Token *tokens;
+    int token_count;
+} Rule;
+
+// Literal pattern table, remembering the last rule using each literal
+typedef struct LiteralEntry
+{
+    char *key;
+    size_t length;
+    uint32_t hash;
+    int best_any;
+    int best_dir;
+} LiteralEntry;
+
+typedef struct LiteralTable
+{
+    LiteralEntry *entries;
+    int capacity;
+    int count;
+} LiteralTable;
+
+struct IgnoreRules
+{
+    size_t base_length;
+    Rule *rules;
+    int rule_count;
+    int rule_capacity;
+    LiteralTable exact;
+    LiteralTable suffixes;
+    LiteralTable prefixes;
+    int prefix_lengths[MAX_PREFIX_LENGTHS];
+    int prefix_length_count;
+    int *globs;
+    int glob_count;
+};
+
+static uint32_t hash_bytes(const char *key, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static LiteralEntry *table_find(const LiteralTable *table, const char *key, size_t length, uint32_t hash)
+{
+    if (table->capacity == 0)
+    {
+        return NULL;
+    }
+    for (int i = hash & (table->capacity - 1);; i = (i + 1) & (table->capacity - 1))
+    {
+        LiteralEntry *entry = &table->entries[i];
+        if (entry->key == NULL)
+        {
+            return entry;
+        }
+        if (entry->hash == hash && entry->length == length && memcmp(entry->key, key, length) == 0)
+        {
+            return entry;
+        }
+    }
+}
+
+static int table_add(LiteralTable *table, const char *key, size_t length, int rule, int dir_only)
+{
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        LiteralTable grown = { .capacity = table->capacity ? table->capacity * 2 : 16 };
+        grown.entries = alloc_calloc(ALLOC_EXPLORER, grown.capacity, sizeof(LiteralEntry));
+        if (grown.entries == NULL)
+        {
+            return -1;
+        }
+        for (int i = 0; i < table->capacity; i++)
+        {
+            LiteralEntry *entry = &table->entries[i];
+            if (entry->key)
+            {
+                *table_find(&grown, entry->key, entry->length, entry->hash) = *entry;
+                grown.count++;
+            }
+        }
+        alloc_free(table->entries);
+        *table = grown;
+    }
+
+    uint32_t hash = hash_bytes(key, length);
+    LiteralEntry *entry = table_find(table, key, length, hash);
+    if (entry->key == NULL)
+    {
+        entry->key = alloc_strndup(ALLOC_EXPLORER, key, length);
+        if (entry->key == NULL)
+        {
+            return -1;
+        }
+        entry->length = length;
+        entry->hash = hash;
+        entry->best_any = -1;
+        entry->best_dir = -1;
+        table->count++;
+    }
+    if (dir_only)
+    {
+        entry->best_dir = rule;
+    }
+    else
+    {
+        entry->best_any = rule;
+    }
+    return 0;
+}
+
+static int table_lookup(const LiteralTable *table, const char *key, size_t length, int is_directory)
+{
+    LiteralEntry *entry = table_find(table, key, length, hash_bytes(key, length));
+    if (entry == NULL || entry->key == NULL)
+    {
+        return -1;
+    }
+    if (is_directory && entry->best_dir > entry->best_any)
+    {
+        return entry->best_dir;
+    }
+    return entry->best_any;
+}
+
+static void free_table(LiteralTable *table)
+{
+    for (int i = 0; i < table->capacity; i++)
+    {
+        alloc_free(table->entries[i].key);
+    }
+    alloc_free(table->entries);
+}
+
+static int has_wildcards(const char *s, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\')
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Compiles a glob into a token program; returns the token count
+static int compile_glob(const char *pattern, Token *tokens)
+{
+    int n = 0;
+    for (const char *p = pattern; *p;)
+    {
+        Token *token = &tokens[n++];
+        memset(token, 0, sizeof(Token));
+
+        if (p[0] == '*' && p[1] == '*' && (p == pattern || p[-1] == '/') && (p[2] == '/' || p[2] == '\0'))
+        {
+            token->type = p[2] == '/' ? TOKEN_GLOBSTAR_SLASH : TOKEN_GLOBSTAR;
+            p += p[2] == '/' ? 3 : 2;
+        }
+        else if (*p == '*')
+        {
+            token->type = TOKEN_STAR;
+            while (*p == '*')
+            {
+                p++;
+            }
+        }
+        else if (*p == '?')
+        {
+            token->type = TOKEN_ANY;
+            p++;
+        }
+        else if (*p == '[' && strchr(p + 1, ']') != NULL)
+        {
+            token->type = TOKEN_CLASS;
+            p++;
+            if (*p == '!' || *p == '^')
+            {
+                token->negate = 1;
+                p++;
+            }
+            int first = 1;
+            while (*p && (*p != ']' || first))
+            {
+                unsigned char low = *p++;
+                unsigned char high = low;
+                if (p[0] == '-' && p[1] && p[1] != ']')
+                {
+                    high = p[1];
+                    p += 2;
+                }
+                for (int c = low; c <= high; c++)
+                {
+                    token->bits[c >> 3] |= 1 << (c & 7);
+                }
+                first = 0;
+            }
+            if (*p == ']')
+            {
+                p++;
+            }
+        }
+        else
+        {
+            if (*p == '\\' && p[1])
+            {
+                p++;
+            }
+            token->type = TOKEN_LITERAL;
+            token->c = *p++;
+        }
+    }
+    return n;
+}
+
+static int glob_match(const Token *t, int n, const char *s)
+{
+    while (n > 0)
+    {
+        switch (t->type)
+        {
+        case TOKEN_STAR:
+            // '*' never crosses a directory separator
+            for (;; s++)
+            {
+                if (glob_match(t + 1, n - 1, s))
+                {
+                    return 1;
+                }
+                if (*s == '\0' || *s == '/')
+                {
+                    return 0;
+                }
+            }
+        case TOKEN_GLOBSTAR:
+            return 1;
+        case TOKEN_GLOBSTAR_SLASH:
+            // Zero or more whole directories
+            for (;;)
+            {
+                if (glob_match(t + 1, n - 1, s))
+                {
+                    return 1;
+                }
+                s = strchr(s, '/');
+                if (s == NULL)
+                {
+                    return 0;
+                }
+                s++;
+            }
+        case TOKEN_ANY:
+            if (*s == '\0' || *s == '/')
+            {
+                return 0;
+            }
+            break;
+        case TOKEN_CLASS:
+        {
+            unsigned char c = *s;
+            if (c == '\0' || c == '/')
+            {
+                return 0;
+            }
+            int in_class = (t->bits[c >> 3] >> (c & 7)) & 1;
+            if (in_class == t->negate)
+            {
+                return 0;
+            }
+            break;
+        }
+        case TOKEN_LITERAL:
+            if (*s != t->c)
+            {
+                return 0;
+            }
+            break;
+        }
+        s++;
+        t++;
+        n--;
+    }
+    return *s == '\0';
+}
+
+static void add_prefix_length(IgnoreRules *rules, int length)
+{
+    for (int i = 0; i < rules->prefix_length_count; i++)
+    {
+        if (rules->prefix_lengths[i] == length)
+        {
+            return;
+        }
+    }
+    rules->prefix_lengths[rules->prefix_length_count++] = length;
+}
+
+static void add_pattern(IgnoreRules *rules, char *line)
+{
+    size_t length = strcspn(line, "\r\n");
+    line[length] = '\0';
+
+    // Trailing unescaped spaces are ignored
+    while (length > 0 && line[length - 1] == ' ' && (length < 2 || line[length - 2] != '\\'))
+    {
+        line[--length] = '\0';
+    }
+    if (length == 0 || line[0] == '#')
+    {
+        return;
+    }
+
+    Rule rule = {0};
+    char *pattern = line;
+    if (pattern[0] == '!')
+    {
+        rule.negate = 1;
+        pattern++;
+    }
+    else if (pattern[0] == '\\' && (pattern[1] == '!' || pattern[1] == '#'))
+    {
+        pattern++;
+    }
+
+    length = strlen(pattern);
+    if (length > 0 && pattern[length - 1] == '/')
+    {
+        rule.dir_only = 1;
+        pattern[--length] = '\0';
+    }
+    if (strncmp(pattern, "**/", 3) == 0 && strchr(pattern + 3, '/') == NULL)
+    {
+        pattern += 3;
+        length -= 3;
+    }
+    if (strchr(pattern, '/') != NULL)
+    {
+        rule.anchored = 1;
+        if (pattern[0] == '/')
+        {
+            pattern++;
+            length--;
+        }
+    }
+    if (length == 0)
+    {
+        return;
+    }
+
+    // Out of memory the rule is dropped, which only lets more entries through
+    if (rules->rule_count == rules->rule_capacity)
+    {
+        int capacity = rules->rule_capacity ? rules->rule_capacity * 2 : 16;
+        Rule *grown_rules = alloc_realloc(ALLOC_EXPLORER, rules->rules, capacity * sizeof(Rule));
+        if (grown_rules == NULL)
+        {
+            return;
+        }
+        rules->rules = grown_rules;
+        int *grown_globs = alloc_realloc(ALLOC_EXPLORER, rules->globs, capacity * sizeof(int));
+        if (grown_globs == NULL)
+        {
+            return;
+        }
+        rules->globs = grown_globs;
+        rules->rule_capacity = capacity;
+    }
+    int index = rules->rule_count;
+
+    // Plain names and "*.ext" / "name*" shapes go to hash tables, the rest is matched as a glob
+    if (!rule.anchored && !has_wildcards(pattern, length))
+    {
+        if (table_add(&rules->exact, pattern, length, index, rule.dir_only) != 0)
+        {
+            return;
+        }
+    }
+    else if (!rule.anchored && pattern[0] == '*' && pattern[1] == '.' && !has_wildcards(pattern + 1, length - 1))
+    {
+        if (table_add(&rules->suffixes, pattern + 1, length - 1, index, rule.dir_only) != 0)
+        {
+            return;
+        }
+    }
+    else if (!rule.anchored && pattern[length - 1] == '*' && length > 1 && !has_wildcards(pattern, length - 1)
+             && rules->prefix_length_count < MAX_PREFIX_LENGTHS)
+    {
+        add_prefix_length(rules, length - 1);
+        if (table_add(&rules->prefixes, pattern, length - 1, index, rule.dir_only) != 0)
+        {
+            return;
+        }
+    }
+    else
+    {
+        rule.tokens = alloc_malloc(ALLOC_EXPLORER, length * sizeof(Token));
+        if (rule.tokens == NULL)
+        {
+            return;
+        }
+        rule.token_count = compile_glob(pattern, rule.tokens);
+        rules->globs[rules->glob_count++] = index;
+    }
+    rules->rules[index] = rule;
+    rules->rule_count++;
+}
+
+static void load_file(IgnoreRules *rules, const char *dir_path, const char *file_name)
+{
+    char path[MAX_PATTERN_LENGTH * 4];
+    snprintf(path, sizeof(path), "%s/%s", dir_path, file_name);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return;
+    }
+    char line[MAX_PATTERN_LENGTH];
+    while (fgets(line, sizeof(line), file))
+    {
+        add_pattern(rules, line);
+    }
+    fclose(file);
+}
+
+int is_ignore_file(const char *name)
+{
+    return strcmp(name, ".gitignore") == 0 || strcmp(name, ".ignore") == 0;
+}
+
+long long ignore_files_mtime(const char *dir_path)
+{
+    static const char *const names[] = { ".gitignore", ".ignore" };
+    long long newest = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        char path[MAX_PATTERN_LENGTH * 4];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        if (stat(path, &st) == 0)
+        {
+            long long mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            newest = mtime > newest ? mtime : newest;
+        }
+    }
+    return newest;
+}
+
+IgnoreRules *load_ignore_rules(const char *dir_path)
+{
+    IgnoreRules *rules = alloc_calloc(ALLOC_EXPLORER, 1, sizeof(IgnoreRules));
+    if (rules == NULL)
+    {
+        return NULL;
+    }
+    rules->base_length = strlen(dir_path);
+
+    // .ignore comes last so it takes precedence over .gitignore
+    load_file(rules, dir_path, ".gitignore");
+    load_file(rules, dir_path, ".ignore");
+
+    if (rules->rule_count == 0)
+    {
+        free_ignore_rules(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+void free_ignore_rules(IgnoreRules *rules)
+{
+    if (rules == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < rules->rule_count; i++)
+    {
+        alloc_free(rules->rules[i].tokens);
+    }
+    alloc_free(rules->rules);
+    alloc_free(rules->globs);
+    free_table(&rules->exact);
+    free_table(&rules->suffixes);
+    free_table(&rules->prefixes);
+    alloc_free(rules);
+}
+
+// Index of the last rule of this level matching the entry, or -1
+static int match_level(const IgnoreRules *rules, const char *relative_path, const char *name, int is_directory)
+{
+    size_t name_length = strlen(name);
+    int best = table_lookup(&rules->exact, name, name_length, is_directory);
+
+    for (const char *dot = strchr(name, '.'); dot != NULL; dot = strchr(dot + 1, '.'))
+    {
+        int found = table_lookup(&rules->suffixes, dot, name_length - (dot - name), is_directory);
+        if (found > best)
+        {
+            best = found;
+        }
+    }
+
+    for (int i = 0; i < rules->prefix_length_count; i++)
+    {
+        if ((size_t)rules->prefix_lengths[i] <= name_length)
+        {
+            int found = table_lookup(&rules->prefixes, name, rules->prefix_lengths[i], is_directory);
+            if (found > best)
+            {
+                best = found;
+            }
+        }
+    }
+
+    for (int i = rules->glob_count - 1; i >= 0 && rules->globs[i] > best; i--)
+    {
+        const Rule *rule = &rules->rules[rules->globs[i]];
+        if (rule->dir_only && !is_directory)
+        {
+            continue;
+        }
+        if (glob_match(rule->tokens, rule->token_count, rule->anchored ? relative_path : name))
+        {
+            best = rules->globs[i];
+            break;
+        }
+    }
+    return best;
+}
+
+void ignore_push(IgnoreStack *stack, const IgnoreRules *rules)
+{
+    if (stack->dropped == 0 && stack->count == stack->capacity)
+    {
+        int capacity = stack->capacity ? stack->capacity * 2 : 16;
+        const IgnoreRules **grown = alloc_realloc(ALLOC_EXPLORER, stack->levels, capacity * sizeof(IgnoreRules *));
+        if (grown != NULL)
+        {
+            stack->levels = grown;
+            stack->capacity = capacity;
+        }
+    }
+    if (stack->dropped > 0 || stack->count == stack->capacity)
+    {
+        stack->dropped++;
+        return;
+    }
+    stack->levels[stack->count++] = rules;
+}
+
+void ignore_pop(IgnoreStack *stack)
+{
+    if (stack->dropped > 0)
+    {
+        stack->dropped--;
+    }
+    else if (stack->count > 0)
+    {
+        stack->count--;
+    }
+}
+
+void free_ignore_stack(IgnoreStack *stack)
+{
+    alloc_free(stack->levels);
+    stack->levels = NULL;
+    stack->count = 0;
+    stack->capacity = 0;
+    stack->dropped = 0;
+}
+
+int is_ignored(const IgnoreStack *stack, const char *full_path, const char *name, int is_directory)
+{
+    if (is_directory && strcmp(name, ".git") == 0)
+    {
+        return 1;
+    }
+
+    // Deeper directories override their parents
+    for (int i = stack->count - 1; i >= 0; i--)
+    {
+        const IgnoreRules *rules = stack->levels[i];
+        if (rules == NULL || strlen(full_path) <= rules->base_length)
+        {
+            continue;
+        }
+        int rule = match_level(rules, full_path + rules->base_length + 1, name, is_directory);
+        if (rule >= 0)
+        {
+            return !rules->rules[rule].negate;
+        }
+    }
+    return 0;
+}
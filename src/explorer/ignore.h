@@ -0,0 +1,26 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+typedef struct IgnoreRules IgnoreRules;
+
+// Rules of the directories from the crawl root down to the current one
+typedef struct IgnoreStack {
+    const IgnoreRules **levels;
+    int count;
+    int capacity;
+    int dropped;    // levels past the first push there was no memory for
+} IgnoreStack;
+
+IgnoreRules *load_ignore_rules(const char *dir_path);
+void free_ignore_rules(IgnoreRules *rules);
+// Whether name is one of the files load_ignore_rules reads
+int is_ignore_file(const char *name);
+// Newest mtime among a directory's ignore files, 0 when it has none
+long long ignore_files_mtime(const char *dir_path);
+
+void ignore_push(IgnoreStack *stack, const IgnoreRules *rules);
+void ignore_pop(IgnoreStack *stack);
+void free_ignore_stack(IgnoreStack *stack);
+int is_ignored(const IgnoreStack *stack, const char *full_path, const char *name, int is_directory);
+
+#endif
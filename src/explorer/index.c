@@ -0,0 +1,531 @@
+#include "index.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PATH_MAX 4096
+#define INDEX_MAGIC "QIDX"
+#define INDEX_VERSION 2
+
+// File layout: header, node table, then the NUL-terminated names.
+// Children of a node are stored contiguously and in sorted order, and
+// node 0 is the root, named by its full path.
+typedef struct IndexHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t use_ignore;
+    uint32_t node_count;
+    uint64_t names_size;
+} IndexHeader;
+
+typedef struct IndexNode
+{
+    int64_t mtime;
+    int64_t ignore_mtime;
+    uint32_t name;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t is_directory;
+} IndexNode;
+
+// A directory restored from the index, checked against the disk only once
+// it is expanded
+typedef struct Pending
+{
+    uint32_t slot;      // UINT32_MAX once expanded
+    uint32_t rescan;    // an ancestor's ignore rules changed, so its listing is stale
+} Pending;
+
+typedef struct ExplorerIndex
+{
+    void *data;
+    size_t size;
+    const IndexNode *nodes;
+    const char *names;
+    uint32_t node_count;
+    uint64_t names_size;
+    int use_ignore;
+    int rescanned;
+    Pending *pending;   // by tree node
+    int pending_capacity;
+} Index;
+
+static uint32_t hash_name(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+    {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// $XDG_CACHE_HOME/quark/<hash of root>.idx, creating the directories on the way
+static int index_path(const char *root, int use_ignore, char *path, size_t size)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache != NULL && cache[0] != '\0')
+    {
+        snprintf(path, size, "%s/quark", cache);
+    }
+    else if (home != NULL)
+    {
+        snprintf(path, size, "%s/.cache", home);
+        mkdir(path, 0755);
+        snprintf(path, size, "%s/.cache/quark", home);
+    }
+    else
+    {
+        return 0;
+    }
+    mkdir(path, 0755);
+
+    size_t length = strlen(path);
+    snprintf(path + length, size - length, "/%08x%s.idx", hash_name(root), use_ignore ? "" : "-all");
+    return 1;
+}
+
+static int valid_node(const Index *index, uint32_t slot)
+{
+    const IndexNode *node = &index->nodes[slot];
+    // Children always come after their parent, so a corrupt file can't loop
+    return node->name < index->names_size
+        && (node->first_child > slot || node->child_count == 0)
+        && node->first_child <= index->node_count
+        && node->child_count <= index->node_count - node->first_child;
+}
+
+// Index children of a directory, keyed by name for rescans
+typedef struct ChildTable
+{
+    uint32_t *slots;
+    uint32_t mask;
+} ChildTable;
+
+static void build_child_table(const Index *index, const IndexNode *node, ChildTable *table)
+{
+    uint32_t capacity = 16;
+    while (capacity < node->child_count * 2)
+    {
+        capacity *= 2;
+    }
+    // Without a table every child is rescanned rather than restored
+    table->slots = alloc_malloc(ALLOC_EXPLORER, capacity * sizeof(uint32_t));
+    table->mask = capacity - 1;
+    if (table->slots == NULL)
+    {
+        return;
+    }
+    memset(table->slots, 0xff, capacity * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < node->child_count; i++)
+    {
+        uint32_t slot = node->first_child + i;
+        uint32_t at = hash_name(index->names + index->nodes[slot].name) & table->mask;
+        while (table->slots[at] != UINT32_MAX)
+        {
+            at = (at + 1) & table->mask;
+        }
+        table->slots[at] = slot;
+    }
+}
+
+static uint32_t find_child(const Index *index, const ChildTable *table, const char *name)
+{
+    if (table->slots == NULL)
+    {
+        return UINT32_MAX;
+    }
+    for (uint32_t at = hash_name(name) & table->mask; table->slots[at] != UINT32_MAX; at = (at + 1) & table->mask)
+    {
+        if (strcmp(index->names + index->nodes[table->slots[at]].name, name) == 0)
+        {
+            return table->slots[at];
+        }
+    }
+    return UINT32_MAX;
+}
+
+// The ignore rules of a directory and all its ancestors, outermost first
+static IgnoreRules **load_ancestor_rules(const Explorer *tree, int node, IgnoreStack *stack)
+{
+    int depth = NODE(tree, node, depth) + 1;
+    IgnoreRules **rules = alloc_malloc(ALLOC_EXPLORER, depth * sizeof(IgnoreRules *));
+    if (rules == NULL)
+    {
+        return NULL;
+    }
+
+    int level = depth;
+    for (int p = node; p != NODE_NONE; p = NODE(tree, p, parent))
+    {
+        char path[PATH_MAX];
+        rules[--level] = node_path(tree, p, path, sizeof(path)) < 0 ? NULL : load_ignore_rules(path);
+    }
+    for (int i = 0; i < depth; i++)
+    {
+        ignore_push(stack, rules[i]);
+    }
+    return rules;
+}
+
+static void expand_slot(Index *index, Explorer *tree, int node, uint32_t slot, int rescan);
+
+// Leaves a directory to be checked when it is expanded, or checks it now
+// when there's no memory to remember it
+static void defer_directory(Index *index, Explorer *tree, int node, uint32_t slot, int rescan)
+{
+    if (node >= index->pending_capacity)
+    {
+        int capacity = index->pending_capacity ? index->pending_capacity : 1024;
+        while (capacity <= node)
+        {
+            capacity *= 2;
+        }
+        Pending *grown = alloc_realloc(ALLOC_EXPLORER, index->pending, capacity * sizeof(Pending));
+        if (grown == NULL)
+        {
+            expand_slot(index, tree, node, slot, rescan);
+            return;
+        }
+        for (int i = index->pending_capacity; i < capacity; i++)
+        {
+            grown[i].slot = UINT32_MAX;
+        }
+        index->pending = grown;
+        index->pending_capacity = capacity;
+    }
+    index->pending[node] = (Pending){ slot, rescan };
+}
+
+// Re-reads a changed directory; subdirectories the index knows are left to
+// be checked when expanded, and only under changed ignore rules are they
+// re-read as well
+static void rescan_directory(Index *index, Explorer *tree, int node, uint32_t slot, int rules_changed)
+{
+    index->rescanned++;
+    NODE(tree, node, ignore_mtime) = 0;
+
+    char path[PATH_MAX];
+    DIR *dir = node_path(tree, node, path, sizeof(path)) < 0 ? NULL : opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    IgnoreStack stack = {0};
+    IgnoreRules **rules = index->use_ignore ? load_ancestor_rules(tree, node, &stack) : NULL;
+    IgnoreStack *ignore = rules != NULL ? &stack : NULL;
+
+    ChildTable table;
+    build_child_table(index, &index->nodes[slot], &table);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char full_path[PATH_MAX];
+        if (snprintf(full_path, PATH_MAX, "%s/%s", path, entry->d_name) >= PATH_MAX)
+        {
+            continue;
+        }
+
+        struct stat st;
+        prof_count(PROF_STAT_CALLS, 1);
+        if (stat(full_path, &st) != 0 || (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)))
+        {
+            continue;
+        }
+        if (is_ignore_file(entry->d_name) && stat_mtime(&st) > NODE(tree, node, ignore_mtime))
+        {
+            NODE(tree, node, ignore_mtime) = stat_mtime(&st);
+        }
+        int is_directory = S_ISDIR(st.st_mode);
+        if (ignore != NULL && is_ignored(ignore, full_path, entry->d_name, is_directory))
+        {
+            continue;
+        }
+
+        int child = add_explorer_child(tree, node, entry->d_name, is_directory, stat_mtime(&st));
+        if (child == NODE_NONE || !is_directory)
+        {
+            continue;
+        }
+
+        uint32_t found = find_child(index, &table, entry->d_name);
+        if (found != UINT32_MAX && index->nodes[found].is_directory && valid_node(index, found))
+        {
+            NODE(tree, child, mtime) = index->nodes[found].mtime;
+            NODE(tree, child, ignore_mtime) = index->nodes[found].ignore_mtime;
+            defer_directory(index, tree, child, found, rules_changed);
+        }
+        else
+        {
+            populate_explorer_node(tree, child, ignore);
+        }
+    }
+    closedir(dir);
+    alloc_free(table.slots);
+
+    if (rules != NULL)
+    {
+        for (int i = 0; i < stack.count + stack.dropped; i++)
+        {
+            free_ignore_rules(rules[i]);
+        }
+        alloc_free(rules);
+        free_ignore_stack(&stack);
+    }
+    sort_explorer_children(tree, node);
+}
+
+// Trusts the stored listing while the directory's mtime and its ignore
+// files' mtimes are unchanged; only directories and ignore files are
+// stat'ed on this path
+static void expand_slot(Index *index, Explorer *tree, int node, uint32_t slot, int rescan)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    prof_count(PROF_STAT_CALLS, 1);
+    if (node_path(tree, node, path, sizeof(path)) < 0 || stat(path, &st) != 0)
+    {
+        return;
+    }
+
+    // An ignore file edited in place leaves the directory's mtime alone
+    const IndexNode *stored = &index->nodes[slot];
+    int rules_changed = rescan;
+    if (index->use_ignore && !rules_changed)
+    {
+        prof_count(PROF_STAT_CALLS, 2);
+        rules_changed = ignore_files_mtime(path) != stored->ignore_mtime;
+    }
+    long long mtime = stat_mtime(&st);
+    if (rules_changed || mtime != NODE(tree, node, mtime))
+    {
+        NODE(tree, node, mtime) = mtime;
+        rescan_directory(index, tree, node, slot, rules_changed);
+        return;
+    }
+
+    for (uint32_t i = 0; i < stored->child_count; i++)
+    {
+        uint32_t child_slot = stored->first_child + i;
+        const IndexNode *child_node = &index->nodes[child_slot];
+        if (!valid_node(index, child_slot))
+        {
+            continue;
+        }
+
+        int child = add_explorer_child(tree, node, index->names + child_node->name,
+                                       child_node->is_directory, child_node->mtime);
+        if (child != NODE_NONE && child_node->is_directory)
+        {
+            NODE(tree, child, ignore_mtime) = child_node->ignore_mtime;
+            defer_directory(index, tree, child, child_slot, 0);
+        }
+    }
+    NODE(tree, node, ignore_mtime) = stored->ignore_mtime;
+    NODE(tree, node, children_sorted) = 1;
+}
+
+ExplorerIndex *open_explorer_index(Explorer *tree, int use_ignore)
+{
+    const char *root_path = NODE(tree, EXPLORER_ROOT, name);
+    char path[PATH_MAX];
+    if (!index_path(root_path, use_ignore, path, sizeof(path)))
+    {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    Index *index = alloc_calloc(ALLOC_EXPLORER, 1, sizeof(Index));
+    if (index == NULL)
+    {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    const IndexHeader *header = data;
+    index->data = data;
+    index->size = st.st_size;
+    index->nodes = (const IndexNode *)(header + 1);
+    index->node_count = header->node_count;
+    index->names_size = header->names_size;
+    index->use_ignore = use_ignore;
+    index->names = (const char *)(index->nodes + index->node_count);
+
+    int usable = memcmp(header->magic, INDEX_MAGIC, 4) == 0
+        && header->version == INDEX_VERSION
+        && header->use_ignore == (uint32_t)use_ignore
+        && header->node_count > 0
+        && sizeof(IndexHeader) + (uint64_t)header->node_count * sizeof(IndexNode) + header->names_size == (uint64_t)st.st_size
+        && index->names[index->names_size - 1] == '\0'
+        && valid_node(index, 0)
+        && strcmp(index->names + index->nodes[0].name, root_path) == 0;
+    if (!usable)
+    {
+        close_explorer_index(index);
+        return NULL;
+    }
+    NODE(tree, EXPLORER_ROOT, mtime) = index->nodes[0].mtime;
+    defer_directory(index, tree, EXPLORER_ROOT, 0, 0);
+    return index;
+}
+
+void expand_explorer_index(ExplorerIndex *index, Explorer *tree, int node)
+{
+    if (index == NULL || node >= index->pending_capacity || index->pending[node].slot == UINT32_MAX)
+    {
+        return;
+    }
+    Pending pending = index->pending[node];
+    index->pending[node].slot = UINT32_MAX;
+    expand_slot(index, tree, node, pending.slot, pending.rescan);
+}
+
+void expand_explorer_tree(ExplorerIndex *index, Explorer *tree, int node)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+    expand_explorer_index(index, tree, node);
+    for (int child = NODE(tree, node, first_child); child != NODE_NONE; child = NODE(tree, child, next_sibling))
+    {
+        if (NODE(tree, child, is_directory))
+        {
+            expand_explorer_tree(index, tree, child);
+        }
+    }
+}
+
+int explorer_index_rescanned(const ExplorerIndex *index)
+{
+    return index->rescanned;
+}
+
+void close_explorer_index(ExplorerIndex *index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+    munmap(index->data, index->size);
+    alloc_free(index->pending);
+    alloc_free(index);
+}
+
+int save_explorer_index(const Explorer *tree, int use_ignore)
+{
+    char path[PATH_MAX];
+    char temp_path[PATH_MAX + 32];
+    if (!index_path(NODE(tree, EXPLORER_ROOT, name), use_ignore, path, sizeof(path)))
+    {
+        return -1;
+    }
+
+    // Every node of the table is in the tree, the root named by its full path
+    uint64_t names_size = 0;
+    for (int i = 0; i < tree->count; i++)
+    {
+        names_size += strlen(NODE(tree, i, name)) + 1;
+    }
+    IndexHeader header = { .version = INDEX_VERSION, .use_ignore = use_ignore };
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.node_count = tree->count;
+    header.names_size = names_size;
+
+    // Breadth-first, so every child list is contiguous
+    int *queue = alloc_malloc(ALLOC_EXPLORER, header.node_count * sizeof(int));
+    IndexNode *nodes = alloc_calloc(ALLOC_EXPLORER, header.node_count, sizeof(IndexNode));
+    char *names = alloc_malloc(ALLOC_EXPLORER, names_size);
+    if (queue == NULL || nodes == NULL || names == NULL)
+    {
+        alloc_free(queue);
+        alloc_free(nodes);
+        alloc_free(names);
+        return -1;
+    }
+
+    uint32_t next = 1;
+    uint64_t names_length = 0;
+    queue[0] = EXPLORER_ROOT;
+    for (uint32_t i = 0; i < header.node_count; i++)
+    {
+        int node = queue[i];
+        const char *name = NODE(tree, node, name);
+        size_t length = strlen(name) + 1;
+        memcpy(names + names_length, name, length);
+
+        nodes[i].mtime = NODE(tree, node, mtime);
+        nodes[i].ignore_mtime = NODE(tree, node, ignore_mtime);
+        nodes[i].name = names_length;
+        nodes[i].is_directory = NODE(tree, node, is_directory);
+        nodes[i].first_child = next;
+        nodes[i].child_count = NODE(tree, node, child_count);
+        names_length += length;
+
+        for (int child = NODE(tree, node, first_child); child != NODE_NONE; child = NODE(tree, child, next_sibling))
+        {
+            queue[next++] = child;
+        }
+    }
+
+    // Written beside the old index and renamed over it, so readers never see a partial file
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, (int)getpid());
+    FILE *file = fopen(temp_path, "wb");
+    int status = -1;
+    if (file != NULL)
+    {
+        int ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(nodes, sizeof(IndexNode), header.node_count, file) == header.node_count
+            && fwrite(names, 1, names_size, file) == names_size;
+        ok = fclose(file) == 0 && ok;
+        if (ok && rename(temp_path, path) == 0)
+        {
+            status = 0;
+        }
+        else
+        {
+            unlink(temp_path);
+        }
+    }
+
+    alloc_free(queue);
+    alloc_free(nodes);
+    alloc_free(names);
+    return status;
+}
@@ -0,0 +1,24 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "explorer.h"
+
+typedef struct ExplorerIndex ExplorerIndex;
+
+// Opens the cached index for the tree, whose root must be its only node yet.
+// Nothing is checked against the disk until a directory is expanded. NULL
+// when there is no usable index.
+ExplorerIndex *open_explorer_index(Explorer *tree, int use_ignore);
+// Gives a directory its children: from the index while its mtime and its
+// ignore files' mtimes are unchanged, otherwise read from disk. Directories
+// that weren't restored from the index are left alone, as is a NULL index.
+void expand_explorer_index(ExplorerIndex *index, Explorer *tree, int node);
+void expand_explorer_tree(ExplorerIndex *index, Explorer *tree, int node);
+// Directories read from disk so far
+int explorer_index_rescanned(const ExplorerIndex *index);
+void close_explorer_index(ExplorerIndex *index);
+
+// Every directory of the tree must have been expanded
+int save_explorer_index(const Explorer *tree, int use_ignore);
+
+#endif
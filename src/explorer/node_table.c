@@ -0,0 +1,173 @@
+#include "node_table.h"
+#include "sort_key.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STRING_BLOCK_SIZE (64 * 1024)
+
+void node_table_init(NodeTable *table, AllocSubsystem subsystem)
+{
+    memset(table, 0, sizeof(NodeTable));
+    table->subsystem = subsystem;
+    alloc_arena_init(&table->strings, subsystem, STRING_BLOCK_SIZE);
+}
+
+void node_table_free(NodeTable *table)
+{
+    for (int i = 0; i < table->page_count; i++)
+    {
+        alloc_free(table->pages[i]);
+    }
+    alloc_free(table->pages);
+    alloc_arena_free(&table->strings);
+    table->pages = NULL;
+    table->page_count = 0;
+    table->page_capacity = 0;
+    table->count = 0;
+}
+
+// Only the small page list is ever resized; pages stay where they are
+static int add_page(NodeTable *table)
+{
+    if (table->page_count == table->page_capacity)
+    {
+        int capacity = table->page_capacity ? table->page_capacity * 2 : 8;
+        NodePage **pages = alloc_realloc(table->subsystem, table->pages, capacity * sizeof(NodePage *));
+        if (pages == NULL)
+        {
+            return -1;
+        }
+        table->pages = pages;
+        table->page_capacity = capacity;
+    }
+
+    NodePage *page = alloc_malloc(table->subsystem, sizeof(NodePage));
+    if (page == NULL)
+    {
+        return -1;
+    }
+    table->pages[table->page_count++] = page;
+    return 0;
+}
+
+int node_add(NodeTable *table, int parent, const char *name, int is_directory)
+{
+    if (table->count == table->page_count * NODE_PAGE_SIZE && add_page(table) != 0)
+    {
+        return NODE_NONE;
+    }
+
+    // Name and key share one arena push
+    size_t name_size = strlen(name) + 1;
+    char *strings = alloc_arena_push(&table->strings, name_size + sort_key_size(name));
+    if (strings == NULL)
+    {
+        return NODE_NONE;
+    }
+    memcpy(strings, name, name_size);
+    write_sort_key(strings + name_size, name, is_directory);
+
+    int node = table->count++;
+    NODE(table, node, name) = strings;
+    NODE(table, node, sort_key) = strings + name_size;
+    NODE(table, node, parent) = parent;
+    NODE(table, node, first_child) = NODE_NONE;
+    NODE(table, node, last_child) = NODE_NONE;
+    NODE(table, node, next_sibling) = NODE_NONE;
+    NODE(table, node, child_count) = 0;
+    NODE(table, node, depth) = parent == NODE_NONE ? 0 : NODE(table, parent, depth) + 1;
+    NODE(table, node, mtime) = 0;
+    NODE(table, node, ignore_mtime) = 0;
+    NODE(table, node, is_directory) = is_directory;
+    NODE(table, node, children_sorted) = 0;
+    NODE(table, node, is_expanded) = 0;
+    NODE(table, node, ignore) = NULL;
+    NODE(table, node, du_bytes) = 0;
+    NODE(table, node, du_files) = 0;
+    NODE(table, node, du_pending) = 0;
+    NODE(table, node, du_done) = 0;
+
+    if (parent != NODE_NONE)
+    {
+        if (NODE(table, parent, last_child) == NODE_NONE)
+        {
+            NODE(table, parent, first_child) = node;
+        }
+        else
+        {
+            NODE(table, NODE(table, parent, last_child), next_sibling) = node;
+        }
+        NODE(table, parent, last_child) = node;
+        NODE(table, parent, child_count)++;
+        NODE(table, parent, children_sorted) = 0;
+    }
+    return node;
+}
+
+void node_sort_children(NodeTable *table, int node)
+{
+    int count = NODE(table, node, child_count);
+    if (NODE(table, node, children_sorted) || count < 2)
+    {
+        NODE(table, node, children_sorted) = 1;
+        return;
+    }
+
+    // Out of memory the children keep the order they were added in
+    SortItem *items = alloc_malloc(table->subsystem, count * sizeof(SortItem));
+    if (items == NULL)
+    {
+        return;
+    }
+    int i = 0;
+    for (int child = NODE(table, node, first_child); child != NODE_NONE; child = NODE(table, child, next_sibling))
+    {
+        items[i].key = NODE(table, child, sort_key);
+        items[i].name = NODE(table, child, name);
+        items[i].item = (void *)(intptr_t)child;
+        i++;
+    }
+    sort_items(items, count);
+
+    // Relink the siblings in the sorted order
+    int previous = NODE_NONE;
+    for (i = 0; i < count; i++)
+    {
+        int child = (int)(intptr_t)items[i].item;
+        if (previous == NODE_NONE)
+        {
+            NODE(table, node, first_child) = child;
+        }
+        else
+        {
+            NODE(table, previous, next_sibling) = child;
+        }
+        previous = child;
+    }
+    NODE(table, previous, next_sibling) = NODE_NONE;
+    NODE(table, node, last_child) = previous;
+    alloc_free(items);
+    NODE(table, node, children_sorted) = 1;
+}
+
+int node_path(const NodeTable *table, int node, char *path, size_t size)
+{
+    int parent = NODE(table, node, parent);
+    int length = 0;
+    if (parent != NODE_NONE)
+    {
+        length = node_path(table, parent, path, size);
+        if (length < 0)
+        {
+            return -1;
+        }
+    }
+
+    int written = snprintf(path + length, size - length, parent == NODE_NONE ? "%s" : "/%s", NODE(table, node, name));
+    if (written < 0 || (size_t)(length + written) >= size)
+    {
+        return -1;
+    }
+    return length + written;
+}
@@ -0,0 +1,64 @@
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include "ignore.h"
+#include "../alloc/alloc.h"
+
+// File tree nodes stored column by column in fixed-size pages. Nodes are
+// numbered in the order they were added and link to each other by number, so
+// walking a tree reads a few dense columns instead of chasing a pointer per
+// node, and adding a node never moves the ones already there.
+#define NODE_PAGE_SHIFT 10
+#define NODE_PAGE_SIZE (1 << NODE_PAGE_SHIFT)
+#define NODE_NONE (-1)
+
+typedef struct NodePage {
+    const char *name[NODE_PAGE_SIZE];
+    const char *sort_key[NODE_PAGE_SIZE];
+    int parent[NODE_PAGE_SIZE];
+    int first_child[NODE_PAGE_SIZE];
+    int last_child[NODE_PAGE_SIZE];
+    int next_sibling[NODE_PAGE_SIZE];
+    int child_count[NODE_PAGE_SIZE];
+    int depth[NODE_PAGE_SIZE];
+    long long mtime[NODE_PAGE_SIZE];
+    long long ignore_mtime[NODE_PAGE_SIZE]; // newest of its ignore files, 0 for none
+    unsigned char is_directory[NODE_PAGE_SIZE];
+    unsigned char children_sorted[NODE_PAGE_SIZE];
+    unsigned char is_expanded[NODE_PAGE_SIZE];
+    IgnoreRules *ignore[NODE_PAGE_SIZE];    // rules loaded with the children, owned by the caller
+    // Directory totals, filled in by the du pool
+    long long du_bytes[NODE_PAGE_SIZE];
+    long long du_files[NODE_PAGE_SIZE];
+    int du_pending[NODE_PAGE_SIZE];
+    int du_done[NODE_PAGE_SIZE];
+} NodePage;
+
+typedef struct NodeTable {
+    AllocSubsystem subsystem;
+    NodePage **pages;
+    int page_count;
+    int page_capacity;
+    int count;
+    AllocArena strings;     // names and sort keys, freed with the table
+} NodeTable;
+
+// One column of one node, usable as an lvalue: NODE(table, node, mtime) = 0
+#define NODE(table, node, column) \
+    ((table)->pages[(node) >> NODE_PAGE_SHIFT]->column[(node) & (NODE_PAGE_SIZE - 1)])
+
+void node_table_init(NodeTable *table, AllocSubsystem subsystem);
+void node_table_free(NodeTable *table);
+
+// Appends a node as the last child of parent, or as a root for NODE_NONE.
+// Returns its number, or NODE_NONE when out of memory.
+int node_add(NodeTable *table, int parent, const char *name, int is_directory);
+
+// Orders children by their sort keys, skipped while nothing changed
+void node_sort_children(NodeTable *table, int node);
+
+// Joins the names from the root down, the root being named by its path.
+// Returns the length, or -1 when it doesn't fit.
+int node_path(const NodeTable *table, int node, char *path, size_t size);
+
+#endif
@@ -0,0 +1,195 @@
+#include "sort_key.h"
+#include "../alloc/alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DIGIT_RUN 254
+
+// A digit run grows by two bytes at most, so n bytes alternating single
+// digits with other bytes take 2n + 1, plus the directory flag and the NUL
+size_t sort_key_size(const char *name)
+{
+    return 2 * strlen(name) + 3;
+}
+
+// Builds a key whose plain byte order is the display order: directories
+// first, ASCII case folded, and digit runs ordered by numeric value. A digit
+// run becomes '0', a length byte and the digits without leading zeros, so
+// "file2" sorts before "file10".
+void write_sort_key(char *key, const char *name, int is_directory)
+{
+    size_t length = strlen(name);
+    size_t k = 0;
+    key[k++] = is_directory ? '0' : '1';
+
+    for (size_t i = 0; i < length;)
+    {
+        unsigned char c = name[i];
+        if (c >= '0' && c <= '9')
+        {
+            size_t start = i;
+            while (i < length && name[i] >= '0' && name[i] <= '9')
+            {
+                i++;
+            }
+            while (start + 1 < i && name[start] == '0')
+            {
+                start++;
+            }
+            size_t digits = i - start;
+            if (digits > MAX_DIGIT_RUN)
+            {
+                digits = MAX_DIGIT_RUN;
+            }
+            key[k++] = '0';
+            key[k++] = (char)(digits + 1);
+            memcpy(key + k, name + start, digits);
+            k += digits;
+            continue;
+        }
+
+        key[k++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        i++;
+    }
+    key[k] = '\0';
+}
+
+char *make_sort_key(const char *name, int is_directory)
+{
+    char *key = alloc_malloc(ALLOC_EXPLORER, sort_key_size(name));
+    if (key != NULL)
+    {
+        write_sort_key(key, name, is_directory);
+    }
+    return key;
+}
+
+// Eight key bytes from offset packed big-endian, so most comparisons are one
+// integer compare. Bytes past the end of the key are zero.
+static uint64_t key_prefix(const char *key, size_t offset)
+{
+    uint64_t prefix = 0;
+    const char *p = key + offset;
+    int i = 0;
+    for (; i < 8 && p[i]; i++)
+    {
+        prefix = (prefix << 8) | (unsigned char)p[i];
+    }
+    return i == 8 ? prefix : prefix << (8 * (8 - i));
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    const SortItem *x = a;
+    const SortItem *y = b;
+    int result = strcmp(x->key, y->key);
+    return result != 0 ? result : strcmp(x->name, y->name);
+}
+
+// Length of the prefix every key in the range shares, starting at offset
+static size_t common_prefix(SortItem *items, int count, size_t offset)
+{
+    size_t common = strlen(items[0].key + offset);
+    for (int i = 1; i < count && common > 0; i++)
+    {
+        const char *a = items[0].key + offset;
+        const char *b = items[i].key + offset;
+        size_t n = 0;
+        while (n < common && a[n] == b[n])
+        {
+            n++;
+        }
+        common = n;
+    }
+    return common;
+}
+
+static void radix_sort(SortItem *items, SortItem *scratch, int count)
+{
+    SortItem *source = items;
+    SortItem *target = scratch;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int histogram[257] = {0};
+        for (int i = 0; i < count; i++)
+        {
+            histogram[((source[i].prefix >> shift) & 0xff) + 1]++;
+        }
+        if (histogram[((source[0].prefix >> shift) & 0xff) + 1] == count)
+        {
+            continue;
+        }
+        for (int b = 0; b < 256; b++)
+        {
+            histogram[b + 1] += histogram[b];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            target[histogram[(source[i].prefix >> shift) & 0xff]++] = source[i];
+        }
+        SortItem *swap = source;
+        source = target;
+        target = swap;
+    }
+    if (source != items)
+    {
+        memcpy(items, source, count * sizeof(SortItem));
+    }
+}
+
+// Radix sorts on the eight bytes after the range's common prefix, then
+// recurses into runs that still tie. Keys that end inside a tied run are
+// equal and fall back to comparing names.
+static void sort_range(SortItem *items, SortItem *scratch, int count, size_t offset)
+{
+    if (count < 16)
+    {
+        qsort(items, count, sizeof(SortItem), compare_items);
+        return;
+    }
+
+    offset += common_prefix(items, count, offset);
+    for (int i = 0; i < count; i++)
+    {
+        items[i].prefix = key_prefix(items[i].key, offset);
+    }
+    radix_sort(items, scratch, count);
+
+    for (int start = 0; start < count;)
+    {
+        int end = start + 1;
+        while (end < count && items[end].prefix == items[start].prefix)
+        {
+            end++;
+        }
+        if (end - start > 1)
+        {
+            if ((items[start].prefix & 0xff) == 0)
+            {
+                qsort(items + start, end - start, sizeof(SortItem), compare_items);
+            }
+            else
+            {
+                sort_range(items + start, scratch, end - start, offset + 8);
+            }
+        }
+        start = end;
+    }
+}
+
+void sort_items(SortItem *items, int count)
+{
+    if (count < 2)
+    {
+        return;
+    }
+
+    SortItem *scratch = alloc_malloc(ALLOC_EXPLORER, count * sizeof(SortItem));
+    if (scratch == NULL)
+    {
+        qsort(items, count, sizeof(SortItem), compare_items);
+        return;
+    }
+    sort_range(items, scratch, count, 0);
+    alloc_free(scratch);
+}
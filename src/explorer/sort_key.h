@@ -0,0 +1,21 @@
+#ifndef SORT_KEY_H
+#define SORT_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SortItem {
+    uint64_t prefix;
+    const char *key;
+    const char *name;
+    void *item;
+} SortItem;
+
+// Room write_sort_key needs for the key of name
+size_t sort_key_size(const char *name);
+void write_sort_key(char *key, const char *name, int is_directory);
+// Keys are charged to the explorer and released with alloc_free
+char *make_sort_key(const char *name, int is_directory);
+void sort_items(SortItem *items, int count);
+
+#endif
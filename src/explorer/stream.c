@@ -0,0 +1,566 @@
+#include "stream.h"
+#include "sort_key.h"
+#include "ignore.h"
+#include "../alloc/alloc.h"
+#include "../profiler/profiler.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PATH_MAX 4096
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+typedef struct Output
+{
+    int fd;
+    size_t length;
+    char data[OUTPUT_BUFFER_SIZE];
+} Output;
+
+typedef struct Entry
+{
+    char *name;
+    char *sort_key;
+    int is_directory;
+    int is_link;
+} Entry;
+
+// One open directory on the walk stack
+typedef struct Frame
+{
+    DIR *dir;
+    Entry *entries;
+    int entry_count;
+    int next;
+    size_t path_length;
+    int depth;
+    IgnoreRules *rules;
+} Frame;
+
+typedef struct Task
+{
+    Entry entry;
+    FILE *spool;    // NULL when the consumer has to walk it itself
+    int done;
+} Task;
+
+typedef struct Pool
+{
+    const char *root;
+    const StreamOptions *options;
+    const IgnoreRules *root_rules;
+    Task *tasks;
+    int task_count;
+    int next_task;
+    int emitted;        // tasks the consumer is through with
+    int max_spools;     // how far past emitted a directory may be spooled
+    pthread_mutex_t lock;
+    pthread_cond_t task_done;
+    pthread_cond_t spool_free;
+} Pool;
+
+static void flush_output(Output *out)
+{
+    size_t written = 0;
+    while (written < out->length)
+    {
+        ssize_t n = write(out->fd, out->data + written, out->length - written);
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    prof_count(PROF_BYTES_WRITTEN, written);
+    out->length = 0;
+}
+
+static void emit_entry(Output *out, const char *name, int depth)
+{
+    size_t name_length = strlen(name);
+    if (out->length + depth * 2 + name_length + 1 > OUTPUT_BUFFER_SIZE)
+    {
+        flush_output(out);
+    }
+    if (depth * 2 + name_length + 1 > OUTPUT_BUFFER_SIZE)
+    {
+        return;
+    }
+
+    memset(out->data + out->length, ' ', depth * 2);
+    out->length += depth * 2;
+    memcpy(out->data + out->length, name, name_length);
+    out->length += name_length;
+    out->data[out->length++] = '\n';
+}
+
+// Resolves the entry type, only falling back to stat when readdir can't tell.
+// Symlinked directories are listed but never descended into, so link cycles
+// can't make the walk run forever.
+static int classify(const char *path, struct dirent *entry, int *is_directory, int *is_link)
+{
+    *is_link = entry->d_type == DT_LNK;
+    if (entry->d_type == DT_DIR || entry->d_type == DT_REG)
+    {
+        *is_directory = entry->d_type == DT_DIR;
+        return 1;
+    }
+
+    struct stat st;
+    prof_count(PROF_STAT_CALLS, 1);
+    if (stat(path, &st) != 0)
+    {
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))
+    {
+        return 0;
+    }
+    *is_directory = S_ISDIR(st.st_mode);
+    return 1;
+}
+
+static void sort_entries(Entry *entries, int count)
+{
+    SortItem *items = alloc_malloc(ALLOC_EXPLORER, count * sizeof(SortItem));
+    Entry *sorted = alloc_malloc(ALLOC_EXPLORER, count * sizeof(Entry));
+    if (items == NULL || sorted == NULL)
+    {
+        alloc_free(items);
+        alloc_free(sorted);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        items[i].key = entries[i].sort_key;
+        items[i].name = entries[i].name;
+        items[i].item = &entries[i];
+    }
+    sort_items(items, count);
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = *(Entry *)items[i].item;
+    }
+    memcpy(entries, sorted, count * sizeof(Entry));
+    alloc_free(sorted);
+    alloc_free(items);
+}
+
+// Reads a whole directory, used when the listing has to be sorted
+static int read_entries(DIR *dir, char *path, size_t path_length, Entry **entries, int sort, const IgnoreStack *ignore)
+{
+    int count = 0;
+    int capacity = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        if (snprintf(path + path_length, PATH_MAX - path_length, "/%s", entry->d_name) >= (int)(PATH_MAX - path_length))
+        {
+            continue;
+        }
+        int is_directory, is_link;
+        if (!classify(path, entry, &is_directory, &is_link))
+        {
+            continue;
+        }
+        if (ignore != NULL && is_ignored(ignore, path, entry->d_name, is_directory))
+        {
+            continue;
+        }
+
+        // Out of memory the listing stops at what was read so far
+        if (count == capacity)
+        {
+            Entry *grown = alloc_realloc(ALLOC_EXPLORER, *entries, (capacity == 0 ? 64 : capacity * 2) * sizeof(Entry));
+            if (grown == NULL)
+            {
+                break;
+            }
+            *entries = grown;
+            capacity = capacity == 0 ? 64 : capacity * 2;
+        }
+        Entry *added = &(*entries)[count];
+        added->name = alloc_strdup(ALLOC_EXPLORER, entry->d_name);
+        added->is_directory = is_directory;
+        added->is_link = is_link;
+        added->sort_key = sort ? make_sort_key(entry->d_name, is_directory) : NULL;
+        if (added->name == NULL || (sort && added->sort_key == NULL))
+        {
+            alloc_free(added->name);
+            alloc_free(added->sort_key);
+            break;
+        }
+        count++;
+    }
+    path[path_length] = '\0';
+
+    if (sort)
+    {
+        sort_entries(*entries, count);
+    }
+    return count;
+}
+
+static void free_entries(Entry *entries, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        alloc_free(entries[i].name);
+        alloc_free(entries[i].sort_key);
+    }
+    alloc_free(entries);
+}
+
+// Opens a directory and pushes its ignore rules, which stay active until the frame closes
+static int open_frame(Frame *frame, char *path, size_t path_length, int depth, int sort, IgnoreStack *ignore)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+
+    memset(frame, 0, sizeof(Frame));
+    frame->path_length = path_length;
+    frame->depth = depth;
+    if (ignore != NULL)
+    {
+        frame->rules = load_ignore_rules(path);
+        ignore_push(ignore, frame->rules);
+    }
+    if (sort)
+    {
+        frame->entry_count = read_entries(dir, path, path_length, &frame->entries, 1, ignore);
+        closedir(dir);
+    }
+    else
+    {
+        frame->dir = dir;
+    }
+    return 1;
+}
+
+static void close_frame(Frame *frame, IgnoreStack *ignore)
+{
+    if (frame->dir)
+    {
+        closedir(frame->dir);
+    }
+    free_entries(frame->entries, frame->entry_count);
+    if (ignore != NULL)
+    {
+        ignore_pop(ignore);
+        free_ignore_rules(frame->rules);
+    }
+}
+
+// Fetches the next entry of a frame into path, returns 0 when exhausted
+static int next_entry(Frame *frame, char *path, const char **name, int *is_directory, int *is_link, const IgnoreStack *ignore)
+{
+    if (frame->dir == NULL)
+    {
+        if (frame->next == frame->entry_count)
+        {
+            return 0;
+        }
+        Entry *entry = &frame->entries[frame->next++];
+        snprintf(path + frame->path_length, PATH_MAX - frame->path_length, "/%s", entry->name);
+        *name = entry->name;
+        *is_directory = entry->is_directory;
+        *is_link = entry->is_link;
+        return 1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(frame->dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        if (snprintf(path + frame->path_length, PATH_MAX - frame->path_length, "/%s", entry->d_name) >= (int)(PATH_MAX - frame->path_length))
+        {
+            continue;
+        }
+        if (classify(path, entry, is_directory, is_link)
+            && (ignore == NULL || !is_ignored(ignore, path, entry->d_name, *is_directory)))
+        {
+            *name = entry->d_name;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Depth-first walk with an explicit stack, so memory only grows with depth
+static void walk(const char *root, int depth, int sort, IgnoreStack *ignore, Output *out)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", root);
+
+    int stack_capacity = 16;
+    int stack_size = 0;
+    Frame *stack = alloc_malloc(ALLOC_EXPLORER, stack_capacity * sizeof(Frame));
+    if (stack == NULL)
+    {
+        return;
+    }
+
+    if (open_frame(&stack[0], path, strlen(path), depth, sort, ignore))
+    {
+        stack_size = 1;
+    }
+
+    while (stack_size > 0)
+    {
+        Frame *frame = &stack[stack_size - 1];
+        const char *name;
+        int is_directory, is_link;
+
+        if (!next_entry(frame, path, &name, &is_directory, &is_link, ignore))
+        {
+            close_frame(frame, ignore);
+            stack_size--;
+            continue;
+        }
+
+        emit_entry(out, name, frame->depth);
+        if (!is_directory || is_link)
+        {
+            continue;
+        }
+
+        // Without memory for a deeper frame the directory is listed but not entered
+        if (stack_size == stack_capacity)
+        {
+            Frame *grown = alloc_realloc(ALLOC_EXPLORER, stack, stack_capacity * 2 * sizeof(Frame));
+            if (grown == NULL)
+            {
+                continue;
+            }
+            stack = grown;
+            stack_capacity *= 2;
+            frame = &stack[stack_size - 1];
+        }
+        if (open_frame(&stack[stack_size], path, strlen(path), frame->depth + 1, sort, ignore))
+        {
+            stack_size++;
+        }
+    }
+
+    alloc_free(stack);
+}
+
+static int is_subtree(const Entry *entry)
+{
+    return entry->is_directory && !entry->is_link;
+}
+
+static void *worker(void *arg)
+{
+    Pool *pool = arg;
+    Output *out = alloc_malloc(ALLOC_EXPLORER, sizeof(Output));
+    char path[PATH_MAX];
+
+    // Every subtree sits below the root's ignore rules
+    IgnoreStack stack = {0};
+    IgnoreStack *ignore = pool->options->ignore ? &stack : NULL;
+    if (ignore != NULL)
+    {
+        ignore_push(ignore, pool->root_rules);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next_task++;
+        if (index >= pool->task_count)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        // Only a few spools are open at once, however far behind the consumer is
+        Task *task = &pool->tasks[index];
+        while (is_subtree(&task->entry) && index >= pool->emitted + pool->max_spools)
+        {
+            pthread_cond_wait(&pool->spool_free, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        // Each subtree is spooled to its own temporary file; one that can't
+        // be is left for the consumer to walk
+        if (is_subtree(&task->entry) && out != NULL
+            && snprintf(path, sizeof(path), "%s/%s", pool->root, task->entry.name) < (int)sizeof(path))
+        {
+            task->spool = tmpfile();
+        }
+        if (task->spool)
+        {
+            out->fd = fileno(task->spool);
+            out->length = 0;
+            walk(path, 2, pool->options->sort, ignore, out);
+            flush_output(out);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&pool->task_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free_ignore_stack(&stack);
+    alloc_free(out);
+    return NULL;
+}
+
+static void copy_spool(FILE *spool, Output *out)
+{
+    flush_output(out);
+    lseek(fileno(spool), 0, SEEK_SET);
+
+    ssize_t n;
+    while ((n = read(fileno(spool), out->data, OUTPUT_BUFFER_SIZE)) > 0)
+    {
+        out->length = n;
+        flush_output(out);
+    }
+}
+
+// Walks top-level subtrees on a thread pool, emitting them in listing order
+static void walk_parallel(const char *root, const StreamOptions *options, Output *out)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", root);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    Pool pool = { .root = root, .options = options };
+    IgnoreStack ignore = {0};
+    IgnoreRules *root_rules = NULL;
+    if (options->ignore)
+    {
+        root_rules = load_ignore_rules(root);
+        ignore_push(&ignore, root_rules);
+        pool.root_rules = root_rules;
+    }
+
+    Entry *entries = NULL;
+    int entry_count = read_entries(dir, path, strlen(path), &entries, options->sort, options->ignore ? &ignore : NULL);
+    pool.task_count = entry_count;
+    closedir(dir);
+
+    pool.tasks = alloc_calloc(ALLOC_EXPLORER, pool.task_count, sizeof(Task));
+    if (pool.tasks == NULL)
+    {
+        pool.task_count = 0;
+    }
+    for (int i = 0; i < pool.task_count; i++)
+    {
+        pool.tasks[i].entry = entries[i];
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.task_done, NULL);
+    pthread_cond_init(&pool.spool_free, NULL);
+
+    // Without threads, or memory for them, this thread walks every subtree
+    int jobs = options->jobs < pool.task_count ? options->jobs : pool.task_count;
+    pthread_t *threads = alloc_malloc(ALLOC_EXPLORER, jobs * sizeof(pthread_t));
+    int started = 0;
+    pool.max_spools = jobs;
+    while (threads != NULL && started < jobs && pthread_create(&threads[started], NULL, worker, &pool) == 0)
+    {
+        started++;
+    }
+
+    for (int i = 0; i < pool.task_count; i++)
+    {
+        // A task no worker has claimed yet is walked here, straight to the output
+        Task *task = &pool.tasks[i];
+        pthread_mutex_lock(&pool.lock);
+        if (pool.next_task == i)
+        {
+            pool.next_task++;
+        }
+        else
+        {
+            while (!task->done)
+            {
+                pthread_cond_wait(&pool.task_done, &pool.lock);
+            }
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        emit_entry(out, task->entry.name, 1);
+        if (task->spool)
+        {
+            copy_spool(task->spool, out);
+            fclose(task->spool);
+        }
+        else if (is_subtree(&task->entry)
+                 && snprintf(path, sizeof(path), "%s/%s", root, task->entry.name) < (int)sizeof(path))
+        {
+            walk(path, 2, options->sort, options->ignore ? &ignore : NULL, out);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        pool.emitted = i + 1;
+        pthread_cond_broadcast(&pool.spool_free);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    alloc_free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.task_done);
+    pthread_cond_destroy(&pool.spool_free);
+    alloc_free(pool.tasks);
+    free_entries(entries, entry_count);
+    free_ignore_stack(&ignore);
+    free_ignore_rules(root_rules);
+}
+
+int stream_explorer(const char *path, int out_fd, const StreamOptions *options)
+{
+    Output *out = alloc_malloc(ALLOC_EXPLORER, sizeof(Output));
+    if (out == NULL)
+    {
+        return -1;
+    }
+    out->fd = out_fd;
+    out->length = 0;
+
+    emit_entry(out, path, 0);
+    if (options->jobs > 1)
+    {
+        walk_parallel(path, options, out);
+    }
+    else
+    {
+        IgnoreStack ignore = {0};
+        walk(path, 1, options->sort, options->ignore ? &ignore : NULL, out);
+        free_ignore_stack(&ignore);
+    }
+    flush_output(out);
+
+    alloc_free(out);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+typedef struct StreamOptions {
+    int sort;
+    int jobs;
+    int ignore;
+} StreamOptions;
+
+int stream_explorer(const char *path, int out_fd, const StreamOptions *options);
+
+#endif
@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include "io_backend.h"
+#include "../profiler/profiler.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IO_THREADS 8
+#define IO_CHUNK_SIZE (1 << 20)
+#define IO_PENDING INT_MIN
+
+struct IoQueue {
+    void *ring;
+
+    // Thread pool fallback: workers claim requests of the current batch
+    pthread_t threads[IO_THREADS];
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    IoRequest *requests;
+    int count;
+    int next;
+    int finished;
+    int stopping;
+};
+
+static IoQueue *default_queue = NULL;
+
+static void run_request(IoRequest *request) {
+    int result = 0;
+    switch (request->op) {
+    case IO_STATX:
+        result = statx(request->dirfd, request->path, request->flags, request->mask, request->statx_buffer);
+        break;
+    case IO_OPENAT:
+        result = openat(request->dirfd, request->path, request->flags, 0644);
+        break;
+    case IO_READ:
+        result = pread(request->fd, request->buffer, request->length, request->offset);
+        break;
+    case IO_CLOSE:
+        result = close(request->fd);
+        break;
+    }
+    request->result = result < 0 ? -errno : result;
+}
+
+static void *io_worker(void *arg) {
+    IoQueue *queue = arg;
+    pthread_mutex_lock(&queue->lock);
+    while (1) {
+        while (!queue->stopping && queue->next >= queue->count) {
+            pthread_cond_wait(&queue->work, &queue->lock);
+        }
+        if (queue->stopping) {
+            break;
+        }
+
+        int index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        run_request(&queue->requests[index]);
+        pthread_mutex_lock(&queue->lock);
+
+        if (++queue->finished == queue->count) {
+            pthread_cond_signal(&queue->done);
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+static void start_threads(IoQueue *queue) {
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->work, NULL);
+    pthread_cond_init(&queue->done, NULL);
+    for (int i = 0; i < IO_THREADS; i++) {
+        if (pthread_create(&queue->threads[i], NULL, io_worker, queue) != 0) {
+            break;
+        }
+        queue->thread_count++;
+    }
+}
+
+// QUARK_IO=threads skips io_uring, which is handy when comparing backends
+IoQueue *io_queue_create(unsigned depth) {
+    IoQueue *queue = alloc_calloc(ALLOC_IO, 1, sizeof(IoQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    const char *backend = getenv("QUARK_IO");
+    if (backend == NULL || strcmp(backend, "threads") != 0) {
+        queue->ring = uring_create(depth);
+    }
+    if (queue->ring == NULL) {
+        start_threads(queue);
+    }
+    return queue;
+}
+
+void io_queue_destroy(IoQueue *queue) {
+    if (queue == NULL) {
+        return;
+    }
+    if (queue->ring) {
+        uring_destroy(queue->ring);
+    } else {
+        pthread_mutex_lock(&queue->lock);
+        queue->stopping = 1;
+        pthread_cond_broadcast(&queue->work);
+        pthread_mutex_unlock(&queue->lock);
+        for (int i = 0; i < queue->thread_count; i++) {
+            pthread_join(queue->threads[i], NULL);
+        }
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->work);
+        pthread_cond_destroy(&queue->done);
+    }
+    alloc_free(queue);
+}
+
+const char *io_backend_name(const IoQueue *queue) {
+    return queue != NULL && queue->ring ? "io_uring" : "threads";
+}
+
+void io_submit_batch(IoQueue *queue, IoRequest *requests, int count) {
+    if (count <= 0) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        requests[i].result = IO_PENDING;
+        if (requests[i].op == IO_STATX) {
+            prof_count(PROF_STAT_CALLS, 1);
+        }
+    }
+
+    if (queue != NULL && queue->ring) {
+        if (uring_submit(queue->ring, requests, count) == 0) {
+            return;
+        }
+        // The ring failed mid-batch: later batches go to the thread pool, and
+        // whatever this one didn't complete runs here
+        uring_destroy(queue->ring);
+        queue->ring = NULL;
+        start_threads(queue);
+        for (int i = 0; i < count; i++) {
+            if (requests[i].result == IO_PENDING) {
+                run_request(&requests[i]);
+            }
+        }
+        return;
+    }
+
+    // A single request isn't worth a thread handoff; without a queue at all
+    // everything runs here
+    if (queue == NULL || count == 1 || queue->thread_count == 0) {
+        for (int i = 0; i < count; i++) {
+            run_request(&requests[i]);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->requests = requests;
+    queue->count = count;
+    queue->next = 0;
+    queue->finished = 0;
+    pthread_cond_broadcast(&queue->work);
+    while (queue->finished < count) {
+        pthread_cond_wait(&queue->done, &queue->lock);
+    }
+    queue->requests = NULL;
+    queue->count = 0;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+IoQueue *io_default_queue(void) {
+    if (default_queue == NULL) {
+        default_queue = io_queue_create(256);
+    }
+    return default_queue;
+}
+
+void io_shutdown(void) {
+    io_queue_destroy(default_queue);
+    default_queue = NULL;
+}
+
+char *io_read_file(IoQueue *queue, AllocSubsystem owner, const char *path, long long *size) {
+    // Open and size in one round trip
+    struct statx st;
+    IoRequest open_stat[2] = {
+        { .op = IO_OPENAT, .dirfd = AT_FDCWD, .path = path, .flags = O_RDONLY | O_CLOEXEC },
+        { .op = IO_STATX, .dirfd = AT_FDCWD, .path = path, .mask = STATX_SIZE, .statx_buffer = &st },
+    };
+    io_submit_batch(queue, open_stat, 2);
+    int fd = open_stat[0].result;
+    if (fd < 0 || open_stat[1].result < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        errno = fd < 0 ? -fd : -open_stat[1].result;
+        return NULL;
+    }
+
+    long long length = st.stx_size;
+    // Every chunk is in flight at once
+    int chunks = (int)((length + IO_CHUNK_SIZE - 1) / IO_CHUNK_SIZE);
+    char *data = alloc_malloc(owner, length + 1);
+    IoRequest *reads = alloc_calloc(ALLOC_IO, chunks ? chunks : 1, sizeof(IoRequest));
+    if (data == NULL || reads == NULL) {
+        alloc_free(data);
+        alloc_free(reads);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (int i = 0; i < chunks; i++) {
+        long long offset = (long long)i * IO_CHUNK_SIZE;
+        reads[i] = (IoRequest) {
+            .op = IO_READ,
+            .fd = fd,
+            .buffer = data + offset,
+            .length = length - offset < IO_CHUNK_SIZE ? length - offset : IO_CHUNK_SIZE,
+            .offset = offset,
+        };
+    }
+    io_submit_batch(queue, reads, chunks);
+
+    // Short reads (a file shrinking underneath us) end the content early
+    long long total = 0;
+    for (int i = 0; i < chunks && reads[i].result > 0; i++) {
+        total += reads[i].result;
+        if (reads[i].result < (int)reads[i].length) {
+            break;
+        }
+    }
+    alloc_free(reads);
+    close(fd);
+
+    data[total] = '\0';
+    *size = total;
+    return data;
+}
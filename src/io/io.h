@@ -0,0 +1,50 @@
+#ifndef IO_H
+#define IO_H
+
+#include "../alloc/alloc.h"
+
+struct statx;
+
+// Batched file I/O. A batch is handed over in one call and all its
+// operations are in flight together; the call returns once every request
+// has its result. io_uring is used when the kernel allows it, otherwise a
+// small thread pool runs the same requests with plain syscalls.
+
+typedef enum IoOp {
+    IO_STATX,
+    IO_OPENAT,
+    IO_READ,
+    IO_CLOSE
+} IoOp;
+
+typedef struct IoRequest {
+    IoOp op;
+    int dirfd;                  // statx, openat
+    const char *path;           // statx, openat
+    int flags;                  // statx AT_* / openat O_* flags
+    unsigned mask;              // statx
+    struct statx *statx_buffer; // statx
+    int fd;                     // read, close
+    void *buffer;               // read
+    unsigned length;            // read
+    long long offset;           // read
+    int result;                 // >= 0 on success, -errno on failure
+} IoRequest;
+
+typedef struct IoQueue IoQueue;
+
+IoQueue *io_queue_create(unsigned depth);
+void io_queue_destroy(IoQueue *queue);
+const char *io_backend_name(const IoQueue *queue);
+void io_submit_batch(IoQueue *queue, IoRequest *requests, int count);
+
+// Shared queue for callers that don't manage their own
+IoQueue *io_default_queue(void);
+void io_shutdown(void);
+
+// Whole-file read through the queue: open, size, then parallel chunk reads.
+// The content is charged to owner and released with alloc_free; NULL with
+// errno set when the file can't be opened or there's no memory for it.
+char *io_read_file(IoQueue *queue, AllocSubsystem owner, const char *path, long long *size);
+
+#endif
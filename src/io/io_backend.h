@@ -0,0 +1,11 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include "io.h"
+
+// io_uring backend, NULL when the kernel refuses to set up a ring
+void *uring_create(unsigned depth);
+void uring_destroy(void *ring);
+int uring_submit(void *ring, IoRequest *requests, int count);
+
+#endif
@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include "io_backend.h"
+#include "../alloc/alloc.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Minimal io_uring driver over the raw syscalls; liburing isn't required
+typedef struct Uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Uring;
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+void *uring_create(unsigned depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = uring_setup(depth, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Uring *ring = alloc_calloc(ALLOC_IO, 1, sizeof(Uring));
+    if (ring == NULL) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(fd);
+        alloc_free(ring);
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(fd);
+            alloc_free(ring);
+            return NULL;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+void uring_destroy(void *handle) {
+    Uring *ring = handle;
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    alloc_free(ring);
+}
+
+static void prepare(struct io_uring_sqe *sqe, IoRequest *request, unsigned long long index) {
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = index;
+    switch (request->op) {
+    case IO_STATX:
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = request->dirfd;
+        sqe->addr = (unsigned long)request->path;
+        sqe->len = request->mask;
+        sqe->off = (unsigned long)request->statx_buffer;
+        sqe->statx_flags = request->flags;
+        break;
+    case IO_OPENAT:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = request->dirfd;
+        sqe->addr = (unsigned long)request->path;
+        sqe->len = 0644;
+        sqe->open_flags = request->flags;
+        break;
+    case IO_READ:
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = request->fd;
+        sqe->addr = (unsigned long)request->buffer;
+        sqe->len = request->length;
+        sqe->off = request->offset;
+        break;
+    case IO_CLOSE:
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = request->fd;
+        break;
+    }
+}
+
+// Applies the completions posted so far, returns how many there were
+static int reap(Uring *ring, IoRequest *requests) {
+    int reaped = 0;
+    unsigned cq_head = *ring->cq_head;
+    unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (cq_head != cq_tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[cq_head & *ring->cq_mask];
+        requests[cqe->user_data].result = cqe->res;
+        cq_head++;
+        reaped++;
+    }
+    __atomic_store_n(ring->cq_head, cq_head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+// Fills as many SQEs as fit, submits them with one io_uring_enter that also
+// waits for completions, and repeats until the whole batch is done. On
+// failure what is still in flight is waited for first, and the ring must not
+// be used again.
+int uring_submit(void *handle, IoRequest *requests, int count) {
+    Uring *ring = handle;
+    int next = 0;
+    int completed = 0;
+    int in_flight = 0;
+    int unsubmitted = 0;
+
+    while (completed < count) {
+        unsigned tail = *ring->sq_tail;
+        unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        int queued = 0;
+        while (next < count && in_flight + unsubmitted + queued < (int)ring->entries && tail - head < ring->entries) {
+            unsigned slot = tail & *ring->sq_mask;
+            prepare(&ring->sqes[slot], &requests[next], next);
+            ring->sq_array[slot] = slot;
+            tail++;
+            next++;
+            queued++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        // Wait for everything in flight, so a full ring costs one syscall. The
+        // kernel skips the wait when it accepts fewer entries than offered.
+        int to_submit = unsubmitted + queued;
+        int ret = uring_enter(ring->fd, to_submit, in_flight + to_submit, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                break;
+            }
+            ret = 0;
+        }
+        in_flight += ret;
+        unsubmitted = to_submit - ret;
+
+        int reaped = reap(ring, requests);
+        completed += reaped;
+        in_flight -= reaped;
+    }
+    if (completed == count) {
+        return 0;
+    }
+
+    // The kernel still owns the buffers of whatever is in flight, so wait
+    // those out before the caller redoes the rest
+    while (in_flight > 0) {
+        if (uring_enter(ring->fd, 0, in_flight, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            break;
+        }
+        in_flight -= reap(ring, requests);
+    }
+    return -1;
+}
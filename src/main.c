@@ -1,13 +1,57 @@
 #include "./explorer/explorer.h"
+#include "./explorer/stream.h"
+#include "./explorer/index.h"
+#include "./explorer/du.h"
 #include "./editor/editor.h"
+#include "./editor/sniff.h"
+#include "./editor/hex_view.h"
+#include "./profiler/profiler.h"
+#include "./alloc/alloc.h"
+#include "./io/io.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #define PATH_MAX 4096
 
+static void expand_from_index(void *index, Explorer *tree, int node) {
+    expand_explorer_index(index, tree, node);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    const char *arg_path = NULL;
+    // Piped output streams the tree instead of building it in memory first
+    int stream = !isatty(STDOUT_FILENO);
+    StreamOptions stream_options = { .sort = 0, .jobs = 1, .ignore = 1 };
+    int rescan = 0;
+    int du = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+        } else if (strcmp(argv[i], "--no-stream") == 0) {
+            stream = 0;
+        } else if (strcmp(argv[i], "--sort") == 0) {
+            stream_options.sort = 1;
+        } else if (strcmp(argv[i], "--du") == 0) {
+            du = 1;
+        } else if (strcmp(argv[i], "--rescan") == 0) {
+            rescan = 1;
+        } else if (strcmp(argv[i], "--no-ignore") == 0) {
+            stream_options.ignore = 0;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            stream_options.jobs = atoi(argv[++i]);
+        } else if (arg_path == NULL && argv[i][0] != '-') {
+            arg_path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [--stream | --no-stream] [--sort] [--jobs n] [--no-ignore] [--rescan] [--du] <path>\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (arg_path == NULL) {
         // TODO: Open an empty file
         printf("This will soon open an empty file\n");
         return 1;
@@ -15,10 +59,10 @@ int main(int argc, char *argv[]) {
 
     // Resolve path
     char path[PATH_MAX];
-    char *result = realpath(argv[1], path);
+    char *result = realpath(arg_path, path);
     
     if (!result) {
-        fprintf(stderr, "Error: Cannot resolve path '%s'\n", argv[1]);
+        fprintf(stderr, "Error: Cannot resolve path '%s'\n", arg_path);
         return 1;
     }
 
@@ -31,25 +75,86 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    Explorer explorer = {0};
+    // QUARK_MEM_BUDGET=explorer=256M caps memory per subsystem;
+    // QUARK_MEM_DUMP=<file> gets the memory stats on exit
+    alloc_init(getenv("QUARK_MEM_BUDGET"), getenv("QUARK_MEM_DUMP"));
+
+    // QUARK_TRACE=<file> dumps a Chrome trace on exit
+    prof_init(getenv("QUARK_TRACE"));
+    prof_frame_begin();
+
+    Explorer explorer;
     Editor editor = {0};
 
     // Check if path is directory or file
-    if (S_ISDIR(statbuf.st_mode)) {
-        explorer = (Explorer) {
-            .name = path,
-            .full_path = path,
-            .is_directory = 1,
-            .parent = NULL,
-            .children = NULL,
-            .children_count = 0
-        };
+    // Sizes need the whole tree, so --du never streams
+    if (S_ISDIR(statbuf.st_mode) && stream && !du) {
+        fflush(stdout);
+        if (stream_explorer(path, STDOUT_FILENO, &stream_options) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+
+    } else if (S_ISDIR(statbuf.st_mode)) {
+        if (init_explorer(&explorer, path, stat_mtime(&statbuf)) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
 
-        // Populate explorer
-        populate_explorer(&explorer);
+        // Warm start from the cached index: each directory is checked as it
+        // is printed, and only the ones that changed are walked.
+        size_t failures = alloc_stats(ALLOC_EXPLORER).failures;
+        ExplorerIndex *index = rescan ? NULL : open_explorer_index(&explorer, stream_options.ignore);
+        if (index == NULL) {
+            populate_explorer(&explorer, stream_options.ignore);
+        }
+
+        // Directory sizes are summed in the background; report progress meanwhile
+        if (du) {
+            int jobs = stream_options.jobs > 1 ? stream_options.jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+            expand_explorer_tree(index, &explorer, EXPLORER_ROOT);
+            DuPool *pool = du_start(&explorer, EXPLORER_ROOT, jobs);
+            int done, total;
+            while (pool != NULL && (done = du_progress(pool, &total)) < total) {
+                if (isatty(STDERR_FILENO)) {
+                    fprintf(stderr, "\rsizing %d/%d directories", done, total);
+                }
+                usleep(20000);
+            }
+            if (isatty(STDERR_FILENO)) {
+                fprintf(stderr, "\r\033[K");
+            }
+            du_free(pool);
+            if (!NODE(&explorer, EXPLORER_ROOT, du_done)) {
+                fprintf(stderr, "Error: Out of memory, some sizes are missing\n");
+            }
+        }
 
         // Display explorer content
-        print_explorer(&explorer, 0);
+        print_explorer(&explorer, EXPLORER_ROOT, 0, index != NULL ? expand_from_index : NULL, index);
+
+        // A tree missing entries for lack of memory is never saved as the index
+        if ((index == NULL || explorer_index_rescanned(index) != 0) &&
+            alloc_stats(ALLOC_EXPLORER).failures == failures) {
+            save_explorer_index(&explorer, stream_options.ignore);
+        }
+        close_explorer_index(index);
+        free_explorer(&explorer);
+
+    } else if (S_ISREG(statbuf.st_mode) && sniff_file(path) == FILE_KIND_BINARY) {
+        // Binaries get a hex dump rendered from a moving mapping
+        HexView view;
+        if (hex_view_open(&view, path) != 0) {
+            fprintf(stderr, "Error: Cannot open '%s'\n", path);
+            return 1;
+        }
+        prof_count(PROF_BYTES_WRITTEN, hex_view_print(&view, stdout));
+        hex_view_close(&view);
+
+    } else if (S_ISREG(statbuf.st_mode) && statbuf.st_size > HUGE_FILE_SIZE) {
+        // Huge text is never copied into a buffer
+        fflush(stdout);
+        prof_count(PROF_BYTES_WRITTEN, print_file_mapped(path, STDOUT_FILENO));
 
     } else if (S_ISREG(statbuf.st_mode)) {
         // open editor
@@ -62,13 +167,21 @@ int main(int argc, char *argv[]) {
             }
         };
         open_editor(&editor);
-        // print buffer content
-        printf("%s\n", editor.buffer.buffer);
+        if (editor.buffer.buffer == NULL) {
+            return 1;
+        }
+        // print buffer content; fwrite keeps any embedded NULs
+        prof_count(PROF_BYTES_WRITTEN, fwrite(editor.buffer.buffer, 1, editor.buffer.size, stdout));
+        prof_count(PROF_BYTES_WRITTEN, printf("\n"));
 
     } else {
         fprintf(stderr, "Error: Unsupported file type\n");
         return 1;
     }
 
+    prof_frame_end();
+    io_shutdown();
+    prof_shutdown();
+    alloc_shutdown();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+#include "profiler.h"
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_HISTORY 512
+#define MAX_TRACE_EVENTS (1 << 20)
+
+typedef struct TraceEvent {
+    const char *name;
+    char phase;
+    uint64_t start;
+    uint64_t duration;
+    long values[PROF_COUNTER_COUNT];
+} TraceEvent;
+
+static const char *zone_names[PROF_ZONE_COUNT] = {
+    "input", "buffer", "layout", "output"
+};
+
+static const char *counter_names[PROF_COUNTER_COUNT] = {
+    "bytes_written", "allocs", "stat_calls"
+};
+
+static uint64_t epoch = 0;
+static int overlay_visible = 0;
+
+static uint64_t zone_ns[PROF_ZONE_COUNT];
+static uint64_t last_zone_ns[PROF_ZONE_COUNT];
+static long counters[PROF_COUNTER_COUNT];
+static long last_counters[PROF_COUNTER_COUNT];
+
+static uint64_t frame_start = 0;
+static uint64_t frame_times[FRAME_HISTORY];
+static int frame_count = 0;
+
+static char *trace_path = NULL;
+static TraceEvent *trace_events = NULL;
+static int trace_count = 0;
+static int trace_capacity = 0;
+
+uint64_t prof_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TraceEvent *push_event(const char *name, char phase, uint64_t start) {
+    if (trace_path == NULL || trace_count >= MAX_TRACE_EVENTS) return NULL;
+
+    if (trace_count == trace_capacity) {
+        int new_capacity = trace_capacity == 0 ? 4096 : trace_capacity * 2;
+        TraceEvent *new_trace = realloc(trace_events, new_capacity * sizeof(TraceEvent));
+        if (new_trace == NULL) return NULL;
+        trace_events = new_trace;
+        trace_capacity = new_capacity;
+    }
+
+    TraceEvent *event = &trace_events[trace_count++];
+    event->name = name;
+    event->phase = phase;
+    event->start = start;
+    event->duration = 0;
+    return event;
+}
+
+void prof_init(const char *path) {
+    epoch = prof_now_ns();
+    if (path != NULL && path[0] != '\0') {
+        trace_path = strdup(path);
+    }
+}
+
+void prof_shutdown(void) {
+    if (trace_path != NULL) {
+        prof_dump_trace(trace_path);
+        free(trace_path);
+        trace_path = NULL;
+    }
+    free(trace_events);
+    trace_events = NULL;
+    trace_count = 0;
+    trace_capacity = 0;
+}
+
+ProfScope prof_scope_begin(ProfZone zone) {
+    return (ProfScope) { .zone = zone, .start = prof_now_ns() };
+}
+
+void prof_scope_end(ProfScope *scope) {
+    uint64_t end = prof_now_ns();
+    zone_ns[scope->zone] += end - scope->start;
+
+    TraceEvent *event = push_event(zone_names[scope->zone], 'X', scope->start);
+    if (event) event->duration = end - scope->start;
+}
+
+void prof_count(ProfCounter counter, long amount) {
+    // Counters may be bumped from worker threads
+    __atomic_fetch_add(&counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+long prof_counter_total(ProfCounter counter) {
+    return counters[counter];
+}
+
+void prof_frame_begin(void) {
+    frame_start = prof_now_ns();
+    memset(zone_ns, 0, sizeof(zone_ns));
+}
+
+void prof_frame_end(void) {
+    if (frame_start == 0) return;
+
+    uint64_t end = prof_now_ns();
+    frame_times[frame_count % FRAME_HISTORY] = end - frame_start;
+    frame_count++;
+
+    memcpy(last_zone_ns, zone_ns, sizeof(zone_ns));
+    memcpy(last_counters, counters, sizeof(counters));
+
+    TraceEvent *event = push_event("frame", 'X', frame_start);
+    if (event) event->duration = end - frame_start;
+
+    event = push_event("counters", 'C', end);
+    if (event) memcpy(event->values, counters, sizeof(counters));
+
+    frame_start = 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+void prof_frame_percentiles(double *p50_ms, double *p99_ms) {
+    uint64_t sorted[FRAME_HISTORY];
+    int n = frame_count < FRAME_HISTORY ? frame_count : FRAME_HISTORY;
+
+    if (n == 0) {
+        *p50_ms = 0;
+        *p99_ms = 0;
+        return;
+    }
+
+    memcpy(sorted, frame_times, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), compare_u64);
+    *p50_ms = sorted[(n - 1) * 50 / 100] / 1e6;
+    *p99_ms = sorted[(n - 1) * 99 / 100] / 1e6;
+}
+
+void prof_toggle_overlay(void) {
+    overlay_visible = !overlay_visible;
+}
+
+int prof_overlay_visible(void) {
+    return overlay_visible;
+}
+
+void prof_draw_overlay(void) {
+    prof_draw_overlay_window(stdscr);
+}
+
+void prof_draw_overlay_window(void *window) {
+    if (!overlay_visible) return;
+
+    WINDOW *win = window;
+    int width = 30;
+    int x = getmaxx(win) - width - 2;
+    if (x < 0) x = 0;
+
+    double p50, p99;
+    prof_frame_percentiles(&p50, &p99);
+
+    int y = 0;
+    wattron(win, A_REVERSE);
+    mvwprintw(win, y++, x, " %-*s", width, "profiler");
+    mvwprintw(win, y++, x, " frame p50 %6.2fms p99 %6.2fms ", p50, p99);
+    for (int i = 0; i < PROF_ZONE_COUNT; i++) {
+        mvwprintw(win, y++, x, " %-8s %18.3fms ", zone_names[i], last_zone_ns[i] / 1e6);
+    }
+    for (int i = 0; i < PROF_COUNTER_COUNT; i++) {
+        mvwprintw(win, y++, x, " %-14s %14ld ", counter_names[i], last_counters[i]);
+    }
+    wattroff(win, A_REVERSE);
+}
+
+int prof_dump_trace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    // Chrome trace event format, timestamps in microseconds
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int i = 0; i < trace_count; i++) {
+        TraceEvent *event = &trace_events[i];
+        double ts = (event->start - epoch) / 1e3;
+
+        if (event->phase == 'X') {
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                    event->name, ts, event->duration / 1e3);
+        } else {
+            fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{", event->name, ts);
+            for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+                fprintf(file, "%s\"%s\":%ld", c ? "," : "", counter_names[c], event->values[c]);
+            }
+            fprintf(file, "}}");
+        }
+        fprintf(file, "%s\n", i + 1 < trace_count ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    fclose(file);
+    return 0;
+}
+
+void prof_histogram_add(ProfHistogram *histogram, uint64_t ns) {
+    int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    if (bucket >= PROF_HISTOGRAM_BUCKETS) bucket = PROF_HISTOGRAM_BUCKETS - 1;
+
+    histogram->buckets[bucket]++;
+    if (histogram->count == 0 || ns < histogram->min) histogram->min = ns;
+    if (ns > histogram->max) histogram->max = ns;
+    histogram->count++;
+    histogram->total += ns;
+}
+
+uint64_t prof_histogram_percentile(const ProfHistogram *histogram, double percentile) {
+    if (histogram->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (histogram->count - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < PROF_HISTOGRAM_BUCKETS; i++) {
+        if (seen + histogram->buckets[i] > rank) {
+            // Interpolate inside [2^(i-1), 2^i)
+            uint64_t low = i == 0 ? 0 : 1ull << (i - 1);
+            uint64_t high = i == 0 ? 1 : 1ull << i;
+            double fraction = (rank - seen + 0.5) / histogram->buckets[i];
+            uint64_t value = low + (uint64_t)((high - low) * fraction);
+            if (value < histogram->min) value = histogram->min;
+            if (value > histogram->max) value = histogram->max;
+            return value;
+        }
+        seen += histogram->buckets[i];
+    }
+    return histogram->max;
+}
+
+void prof_histogram_print(FILE *file, const char *name, const ProfHistogram *histogram) {
+    if (histogram->count == 0) return;
+
+    fprintf(file, "%-16s n=%-8llu mean %9.1fus  p50 %9.1fus  p90 %9.1fus  p99 %9.1fus  max %9.1fus\n",
+            name, (unsigned long long)histogram->count,
+            histogram->total / (double)histogram->count / 1e3,
+            prof_histogram_percentile(histogram, 50) / 1e3,
+            prof_histogram_percentile(histogram, 90) / 1e3,
+            prof_histogram_percentile(histogram, 99) / 1e3,
+            histogram->max / 1e3);
+
+    uint64_t peak = 0;
+    for (int i = 0; i < PROF_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] > peak) peak = histogram->buckets[i];
+    }
+    for (int i = 0; i < PROF_HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] == 0) continue;
+        int bar = (int)(histogram->buckets[i] * 40 / peak);
+        fprintf(file, "  < %10.1fus %8llu %.*s\n", (1ull << i) / 1e3,
+                (unsigned long long)histogram->buckets[i], bar > 0 ? bar : 1,
+                "########################################");
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROF_HISTOGRAM_BUCKETS 40
+
+// Timed regions of a frame
+typedef enum ProfZone {
+    PROF_INPUT,
+    PROF_BUFFER,
+    PROF_LAYOUT,
+    PROF_OUTPUT,
+    PROF_ZONE_COUNT
+} ProfZone;
+
+// Event counters
+typedef enum ProfCounter {
+    PROF_BYTES_WRITTEN,
+    PROF_ALLOCS,
+    PROF_STAT_CALLS,
+    PROF_COUNTER_COUNT
+} ProfCounter;
+
+typedef struct ProfScope {
+    ProfZone zone;
+    uint64_t start;
+} ProfScope;
+
+// Log2-bucketed latency histogram in nanoseconds
+typedef struct ProfHistogram {
+    uint64_t buckets[PROF_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} ProfHistogram;
+
+void prof_init(const char *trace_path);
+void prof_shutdown(void);
+
+uint64_t prof_now_ns(void);
+ProfScope prof_scope_begin(ProfZone zone);
+void prof_scope_end(ProfScope *scope);
+void prof_count(ProfCounter counter, long amount);
+long prof_counter_total(ProfCounter counter);
+
+void prof_frame_begin(void);
+void prof_frame_end(void);
+void prof_frame_percentiles(double *p50_ms, double *p99_ms);
+
+void prof_toggle_overlay(void);
+int prof_overlay_visible(void);
+void prof_draw_overlay(void);
+// Same overlay drawn into an ncurses WINDOW, at its own top-right corner
+void prof_draw_overlay_window(void *window);
+int prof_dump_trace(const char *path);
+
+void prof_histogram_add(ProfHistogram *histogram, uint64_t ns);
+uint64_t prof_histogram_percentile(const ProfHistogram *histogram, double percentile);
+void prof_histogram_print(FILE *file, const char *name, const ProfHistogram *histogram);
+
+// Times the rest of the enclosing block
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_SCOPE(zone) \
+    ProfScope PROF_CONCAT(prof_scope_, __LINE__) \
+        __attribute__((cleanup(prof_scope_end))) = prof_scope_begin(zone)
+
+#endif